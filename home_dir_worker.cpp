@@ -0,0 +1,240 @@
+#include "home_dir_worker.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <system_error>
+#include <utility>
+
+namespace phosphor
+{
+namespace user
+{
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+constexpr auto trashDirName = ".deleted";
+
+constexpr auto homeDirPerms =
+    fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec |
+    fs::perms::others_read | fs::perms::others_exec;
+
+constexpr auto copyOptions =
+    fs::copy_options::recursive | fs::copy_options::copy_symlinks;
+
+/** @brief change the owner of a directory tree, not following symlinks */
+void chownTree(const fs::path& dir, uid_t uid, gid_t gid)
+{
+    if (lchown(dir.c_str(), uid, gid) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), dir.native());
+    }
+    for (const auto& entry : fs::recursive_directory_iterator(dir))
+    {
+        if (lchown(entry.path().c_str(), uid, gid) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    entry.path().native());
+        }
+    }
+}
+
+} // namespace
+
+HomeDirWorker::HomeDirWorker(const fs::path& homeRoot,
+                             const fs::path& skelDir) :
+    homeRoot(homeRoot), skelDir(skelDir), trashDir(homeRoot / trashDirName)
+{
+    thread = std::thread([this]() { run(); });
+    enqueue([this]() { reclaimTrash(); });
+}
+
+HomeDirWorker::~HomeDirWorker()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    thread.join();
+}
+
+void HomeDirWorker::create(const std::string& userName, uid_t uid, gid_t gid)
+{
+    enqueue([this, userName, uid, gid]() { createHome(userName, uid, gid); });
+}
+
+void HomeDirWorker::rename(const std::string& userName,
+                           const std::string& newUserName)
+{
+    enqueue([this, userName, newUserName]() {
+        renameHome(userName, newUserName);
+    });
+}
+
+void HomeDirWorker::remove(const std::string& userName)
+{
+    enqueue([this, userName]() { removeHome(userName); });
+}
+
+void HomeDirWorker::drain()
+{
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [this]() { return jobs.empty() && !busy; });
+}
+
+void HomeDirWorker::enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wakeup.notify_one();
+}
+
+void HomeDirWorker::run()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex);
+            wakeup.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+        }
+
+        try
+        {
+            job();
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Home directory job failed: {ERR}", "ERR", e);
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            busy = false;
+        }
+        idle.notify_all();
+    }
+}
+
+void HomeDirWorker::createHome(const std::string& userName, uid_t uid,
+                               gid_t gid)
+{
+    auto home = homeRoot / userName;
+    if (!fs::create_directory(home))
+    {
+        lg2::info("Home directory {PATH} already exists", "PATH",
+                  home.string());
+        return;
+    }
+    fs::permissions(home, homeDirPerms);
+    if (fs::is_directory(skelDir))
+    {
+        fs::copy(skelDir, home, copyOptions);
+    }
+    chownTree(home, uid, gid);
+}
+
+void HomeDirWorker::renameHome(const std::string& userName,
+                               const std::string& newUserName)
+{
+    auto from = homeRoot / userName;
+    auto to = homeRoot / newUserName;
+    if (!fs::exists(fs::symlink_status(from)))
+    {
+        return;
+    }
+
+    std::error_code ec;
+    fs::rename(from, to, ec);
+    if (ec != std::errc::cross_device_link &&
+        ec != std::errc::device_or_resource_busy)
+    {
+        if (ec)
+        {
+            throw fs::filesystem_error("rename home", from, to, ec);
+        }
+        return;
+    }
+
+    // The old home is a mount point of its own (EBUSY) or on another file
+    // system than the home root (EXDEV), fall back to a copy.
+    struct stat st{};
+    if (lstat(from.c_str(), &st) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), from.native());
+    }
+    fs::create_directory(to, from);
+    fs::copy(from, to, copyOptions);
+    chownTree(to, st.st_uid, st.st_gid);
+
+    // A mount point can only be emptied, not removed
+    for (const auto& entry : fs::directory_iterator(from))
+    {
+        fs::remove_all(entry.path());
+    }
+    fs::remove(from, ec);
+    if (ec)
+    {
+        lg2::info("Left the emptied {PATH} in place: {ERR}", "PATH",
+                  from.string(), "ERR", ec.message());
+    }
+}
+
+void HomeDirWorker::removeHome(const std::string& userName)
+{
+    auto home = homeRoot / userName;
+    if (!fs::exists(fs::symlink_status(home)))
+    {
+        return;
+    }
+
+    fs::create_directories(trashDir);
+    auto trash = trashDir / (userName + "." + std::to_string(trashCount++));
+    while (fs::exists(fs::symlink_status(trash)))
+    {
+        trash = trashDir / (userName + "." + std::to_string(trashCount++));
+    }
+
+    std::error_code ec;
+    fs::rename(home, trash, ec);
+    if (ec)
+    {
+        lg2::error("Unable to move {PATH} to trash: {ERR}", "PATH",
+                   home.string(), "ERR", ec.message());
+        fs::remove_all(home);
+        return;
+    }
+    fs::remove_all(trash);
+}
+
+void HomeDirWorker::reclaimTrash()
+{
+    std::error_code ec;
+    if (!fs::is_directory(trashDir, ec))
+    {
+        return;
+    }
+    for (const auto& entry : fs::directory_iterator(trashDir))
+    {
+        lg2::info("Reclaiming {PATH}", "PATH", entry.path().string());
+        fs::remove_all(entry.path());
+    }
+}
+
+} // namespace user
+} // namespace phosphor
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace phosphor
+{
+namespace user
+{
+
+/** @class HomeDirWorker
+ *  @brief Creates, moves and removes user home directories off the D-Bus
+ *         request path.
+ *  @details Jobs run one at a time on a single thread in the order they were
+ *  queued, so the jobs of one user (create, rename, remove) are never
+ *  reordered. Removal first renames the home directory into a trash directory
+ *  under the home root and then deletes it; anything left in there by a crash
+ *  is reclaimed when the worker starts.
+ */
+class HomeDirWorker
+{
+  public:
+    HomeDirWorker() = delete;
+    HomeDirWorker(const HomeDirWorker&) = delete;
+    HomeDirWorker& operator=(const HomeDirWorker&) = delete;
+    HomeDirWorker(HomeDirWorker&&) = delete;
+    HomeDirWorker& operator=(HomeDirWorker&&) = delete;
+
+    /** @brief Starts the worker thread.
+     *
+     *  @param[in] homeRoot - directory holding the home directories
+     *  @param[in] skelDir - skeleton copied into new home directories
+     */
+    HomeDirWorker(const std::filesystem::path& homeRoot,
+                  const std::filesystem::path& skelDir);
+
+    /** @brief Runs the jobs still queued and stops the worker thread. */
+    ~HomeDirWorker();
+
+    /** @brief Queue creation of a home directory from the skeleton.
+     *
+     *  @param[in] userName - name of the user
+     *  @param[in] uid - owner of the new home directory
+     *  @param[in] gid - group of the new home directory
+     */
+    void create(const std::string& userName, uid_t uid, gid_t gid);
+
+    /** @brief Queue the move of a home directory after a user rename.
+     *
+     *  @param[in] userName - current name of the user
+     *  @param[in] newUserName - new name of the user
+     */
+    void rename(const std::string& userName, const std::string& newUserName);
+
+    /** @brief Queue the removal of a home directory.
+     *
+     *  @param[in] userName - name of the deleted user
+     */
+    void remove(const std::string& userName);
+
+    /** @brief Wait until all queued jobs have run. */
+    void drain();
+
+  private:
+    void enqueue(std::function<void()> job);
+    void run();
+
+    void createHome(const std::string& userName, uid_t uid, gid_t gid);
+    void renameHome(const std::string& userName,
+                    const std::string& newUserName);
+    void removeHome(const std::string& userName);
+    void reclaimTrash();
+
+    const std::filesystem::path homeRoot;
+    const std::filesystem::path skelDir;
+    const std::filesystem::path trashDir;
+
+    /** @brief only used by the worker thread */
+    uint64_t trashCount = 0;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+    std::deque<std::function<void()>> jobs;
+    bool busy = false;
+    bool stopping = false;
+    std::thread thread;
+};
+
+} // namespace user
+} // namespace phosphor
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "phosphor-ldap-config/ldap_config_mgr.hpp"
+#include "user_mgr.hpp"
+
+namespace phosphor
+{
+namespace user
+{
+
+/** @class LdapUserMgr
+ *  @brief UserMgr sharing a process with the LDAP config manager.
+ *  @details LDAP privilege mappings are read straight from the in-process
+ *  config manager instead of a GetManagedObjects call to the
+ *  phosphor-ldap-conf service on every remote user lookup. The groups of a
+ *  remote user come from its group resolver, if started, which needs the
+ *  bind credentials only this process has.
+ */
+class LdapUserMgr : public UserMgr
+{
+  public:
+    /** @brief Constructs LdapUserMgr object.
+     *
+     *  @param[in] bus  - sdbusplus handler
+     *  @param[in] path - D-Bus path
+     *  @param[in] snapshotFile - user snapshot, empty to not publish one
+     *  @param[in] ldapMgr - LDAP config manager, nullptr if LDAP is not
+     *                       configured on this system
+     *  @param[in] homeDirWorker - worker managing the home directories,
+     *                             nullptr to leave them to the shadow tools
+     */
+    LdapUserMgr(sdbusplus::bus_t& bus, const char* path,
+                const std::string& snapshotFile,
+                const ldap::ConfigMgr* ldapMgr,
+                std::unique_ptr<HomeDirWorker> homeDirWorker = nullptr) :
+        UserMgr(bus, path, snapshotFile, std::move(homeDirWorker)),
+        ldapMgr(ldapMgr)
+    {}
+
+  protected:
+    std::optional<PrivilegeMappings> getLdapPrivilegeMappings() override
+    {
+        const ldap::Config* config =
+            ldapMgr ? ldapMgr->enabledConfig() : nullptr;
+        if (config == nullptr)
+        {
+            return std::nullopt;
+        }
+        return config->privilegeMappings();
+    }
+
+    std::optional<std::vector<GroupName>>
+        getLdapUserGroups(const std::string& userName,
+                          gid_t primaryGid) override
+    {
+        if (ldapMgr == nullptr)
+        {
+            return std::nullopt;
+        }
+        return ldapMgr->userGroups(userName, primaryGid);
+    }
+
+  private:
+    const ldap::ConfigMgr* ldapMgr;
+};
+
+} // namespace user
+} // namespace phosphor
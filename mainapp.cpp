@@ -2,32 +2,209 @@
 
 #include "user_mgr.hpp"
 
+#ifdef SINGLE_PROCESS
+#include "ldap_user_mgr.hpp"
+#endif
+
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
 #include <phosphor-logging/lg2.hpp>
 #include <sdbusplus/bus.hpp>
 #include <sdbusplus/server/manager.hpp>
+#include <signal.h>
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
 
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 
 // D-Bus root for user manager
 constexpr auto userManagerRoot = "/xyz/openbmc_project/user";
+// Calibrated password hash cost, kept next to the user snapshot
+constexpr auto passwordHashCostFile =
+    "/run/phosphor-user-manager/password-hash-cost";
+// Home directories and the skeleton they are created from
+constexpr auto homeRoot = "/home";
+constexpr auto skelDir = "/etc/skel";
 using namespace phosphor::logging;
 
+/** @brief process requests until the bus has been idle for 'timeout'
+ *  The bus name is released before leaving, D-Bus activation starts a new
+ *  instance for the next request. Requests that were queued meanwhile are
+ *  still answered.
+ */
+static void processUntilIdle(sdbusplus::bus_t& bus,
+                             std::chrono::microseconds timeout)
+{
+    using clock = std::chrono::steady_clock;
+    auto lastActivity = clock::now();
+    while (true)
+    {
+        if (bus.process_discard())
+        {
+            lastActivity = clock::now();
+            continue;
+        }
+        auto idle = clock::now() - lastActivity;
+        if (idle >= timeout)
+        {
+            break;
+        }
+        bus.wait(std::chrono::duration_cast<std::chrono::microseconds>(
+                     timeout - idle)
+                     .count());
+    }
+
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    lg2::info("Idle for {TIMEOUT}s, exiting", "TIMEOUT", seconds.count());
+    sd_bus_release_name(bus.get(), USER_MANAGER_BUSNAME);
+    while (bus.process_discard())
+    {}
+}
+
+#ifdef SINGLE_PROCESS
+/** @brief check that the files the LDAP config manager renders from exist
+ *  Without them only local users are served, the user manager still runs.
+ */
+static bool ldapConfigAvailable()
+{
+    std::filesystem::path configDir =
+        std::filesystem::path(LDAP_CONFIG_FILE).parent_path();
+    return std::filesystem::exists(configDir /
+                                   phosphor::ldap::defaultNslcdFile) &&
+           std::filesystem::exists(configDir / phosphor::ldap::nsSwitchFile);
+}
+#endif
+
 int main(int /*argc*/, char** /*argv*/)
 {
+#ifdef SINGLE_PROCESS
+    // Handled by the event loop, blocked before any thread is started so
+    // that none of them gets the signal either.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+#endif
+
     auto bus = sdbusplus::bus::new_default();
     sdbusplus::server::manager_t objManager(bus, userManagerRoot);
 
     try
     {
-        phosphor::user::UserMgr userMgr(bus, userManagerRoot);
+        std::unique_ptr<phosphor::user::HomeDirWorker> homeDirWorker;
+#ifdef ENABLE_USER_HOME_DIR_CREATE
+        homeDirWorker =
+            std::make_unique<phosphor::user::HomeDirWorker>(homeRoot, skelDir);
+#endif
+
+#ifdef SINGLE_PROCESS
+        // Add sdbusplus ObjectManager for the 'root' path of the LDAP config.
+        sdbusplus::server::manager_t ldapObjManager(bus, LDAP_CONFIG_ROOT);
+
+        std::optional<phosphor::ldap::ConfigMgr> ldapMgr;
+        if (ldapConfigAvailable())
+        {
+            ldapMgr.emplace(bus, LDAP_CONFIG_ROOT, LDAP_CONFIG_FILE,
+                            LDAP_CONF_PERSIST_PATH, TLS_CACERT_PATH,
+                            TLS_CERT_FILE);
+            ldapMgr->restore();
+        }
+        else
+        {
+            lg2::error("LDAP config file(s) are missing, LDAP is unavailable");
+        }
+
+        phosphor::user::LdapUserMgr userMgr(
+            bus, userManagerRoot, phosphor::user::snapshot::defaultFile,
+            ldapMgr ? &*ldapMgr : nullptr, std::move(homeDirWorker));
+#else
+        phosphor::user::UserMgr userMgr(bus, userManagerRoot,
+                                        phosphor::user::snapshot::defaultFile,
+                                        std::move(homeDirWorker));
+#endif
+        userMgr.calibratePasswordHash(passwordHashCostFile);
 
         // Claim the bus now
         bus.request_name(USER_MANAGER_BUSNAME);
+#ifdef SINGLE_PROCESS
+        if (ldapMgr)
+        {
+            bus.request_name(LDAP_CONFIG_BUSNAME);
+        }
+#endif
 
         // Wait for client request
-        bus.process_loop();
+#ifdef SINGLE_PROCESS
+        // The LDAP config manager coalesces restarts on an event loop timer
+        sd_event* event = nullptr;
+        int r = sd_event_default(&event);
+        if (r < 0)
+        {
+            lg2::error("Failed to get the default event loop: {ERRNO}",
+                       "ERRNO", -r);
+            return -1;
+        }
+        bus.attach_event(event, SD_EVENT_PRIORITY_NORMAL);
+        if (ldapMgr)
+        {
+            ldapMgr->attachEvent(
+                event, std::chrono::milliseconds(LDAP_RESTART_DEBOUNCE_MS),
+                std::chrono::milliseconds(LDAP_PERSIST_DELAY_MS));
+            if constexpr (LDAP_PROBE_INTERVAL_SEC > 0)
+            {
+                ldapMgr->startProbe(
+                    std::chrono::seconds(LDAP_PROBE_INTERVAL_SEC));
+            }
+            if constexpr (LDAP_SERVER_RANK_INTERVAL_SEC > 0)
+            {
+                ldapMgr->startServerRanking(
+                    std::chrono::seconds(LDAP_SERVER_RANK_INTERVAL_SEC));
+            }
+            if constexpr (LDAP_CACHE_WARMUP_CONCURRENCY > 0)
+            {
+                ldapMgr->startCacheWarmUp(LDAP_CACHE_WARMUP_CONCURRENCY);
+            }
+            if constexpr (LDAP_GROUP_RESOLVER_CONNECTIONS > 0)
+            {
+                ldapMgr->startGroupResolver(LDAP_GROUP_RESOLVER_CONNECTIONS);
+            }
+            if constexpr (!std::string_view(LDAP_METRICS_FILE).empty())
+            {
+                ldapMgr->startMetricsDump(LDAP_METRICS_FILE);
+            }
+        }
+        // Without a handler the loop just exits, see the flush below
+        sd_event_add_signal(event, nullptr, SIGTERM, nullptr, nullptr);
+        sd_event_add_signal(event, nullptr, SIGINT, nullptr, nullptr);
+        r = sd_event_loop(event);
+        // Write the LDAP changes still waiting for the persist delay
+        if (ldapMgr)
+        {
+            ldapMgr->flushPersist();
+        }
+        bus.detach_event();
+        sd_event_unref(event);
+        if (r < 0)
+        {
+            lg2::error("Event loop failed: {ERRNO}", "ERRNO", -r);
+            return -1;
+        }
+#else
+        if constexpr (IDLE_EXIT_TIMEOUT > 0)
+        {
+            processUntilIdle(bus, std::chrono::seconds(IDLE_EXIT_TIMEOUT));
+        }
+        else
+        {
+            bus.process_loop();
+        }
+#endif
     }
     catch (const std::exception& e)
     {
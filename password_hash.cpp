@@ -0,0 +1,139 @@
+#include "password_hash.hpp"
+
+#include <crypt.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+namespace phosphor
+{
+namespace user
+{
+namespace password
+{
+
+namespace
+{
+
+// Calibration never goes below the library defaults, a slow CPU gets the
+// default cost rather than a weak hash.
+constexpr unsigned long sha512MinRounds = 5000;
+constexpr unsigned long sha512MaxRounds = 999999999;
+constexpr unsigned long yescryptMinCost = 5;
+// Every yescrypt step doubles the memory as well; 7 needs 64 MiB per
+// concurrent login, which is as much as a BMC can spare.
+constexpr unsigned long yescryptMaxCost = 7;
+constexpr int measureRuns = 3;
+
+/** @brief crypt_r() on a zeroed, heap allocated work area
+ *  @return - the hash, or an empty string on failure
+ */
+std::string cryptOnce(const std::string& phrase, const char* setting)
+{
+    // struct crypt_data is too large (~32 KiB) for the stack.
+    auto data = std::make_unique<struct crypt_data>();
+    const char* out = crypt_r(phrase.c_str(), setting, data.get());
+    // On failure libxcrypt returns NULL or a string starting with '*'
+    if (out == nullptr || out[0] == '*')
+    {
+        return {};
+    }
+    std::string result(out);
+    std::fill(std::begin(data->input), std::end(data->input), '\0');
+    return result;
+}
+
+bool constantTimeEqual(const std::string& a, const std::string& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    unsigned char diff = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+} // namespace
+
+std::string hash(const std::string& password, const std::string& prefix,
+                 unsigned long cost)
+{
+    char setting[CRYPT_GENSALT_OUTPUT_SIZE];
+    // A NULL rbytes makes libxcrypt draw the salt from the OS entropy source.
+    if (crypt_gensalt_rn(prefix.c_str(), cost, nullptr, 0, setting,
+                         sizeof(setting)) == nullptr)
+    {
+        throw std::runtime_error("unsupported crypt setting " + prefix);
+    }
+
+    auto hashed = cryptOnce(password, setting);
+    if (hashed.empty())
+    {
+        throw std::runtime_error("crypt failed for setting " + prefix);
+    }
+    return hashed;
+}
+
+bool verify(const std::string& password, const std::string& hashed)
+{
+    // Locked ("!..."), disabled ("*") or empty hashes never match.
+    if (hashed.empty() || hashed[0] != '$')
+    {
+        return false;
+    }
+    return constantTimeEqual(cryptOnce(password, hashed.c_str()), hashed);
+}
+
+std::chrono::microseconds measure(const std::string& prefix,
+                                  unsigned long cost)
+{
+    auto best = std::chrono::microseconds::max();
+    for (int i = 0; i < measureRuns; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        hash("calibration", prefix, cost);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        best = std::min(best, elapsed);
+    }
+    return std::max(best, std::chrono::microseconds(1));
+}
+
+unsigned long calibrate(const std::string& prefix,
+                        std::chrono::microseconds target)
+{
+    if (target.count() <= 0)
+    {
+        return 0;
+    }
+
+    if (prefix == sha512)
+    {
+        auto probe = measure(prefix, sha512MinRounds);
+        auto rounds = static_cast<unsigned long long>(sha512MinRounds) *
+                      target.count() / probe.count();
+        return std::clamp<unsigned long long>(rounds, sha512MinRounds,
+                                              sha512MaxRounds);
+    }
+
+    if (prefix == yescrypt)
+    {
+        unsigned long cost = yescryptMinCost;
+        while (cost < yescryptMaxCost && measure(prefix, cost + 1) <= target)
+        {
+            ++cost;
+        }
+        return cost;
+    }
+
+    return 0;
+}
+
+} // namespace password
+} // namespace user
+} // namespace phosphor
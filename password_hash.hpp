@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+namespace phosphor
+{
+namespace user
+{
+namespace password
+{
+
+/** @brief crypt(3) setting prefix of yescrypt */
+inline constexpr const char* yescrypt = "$y$";
+/** @brief crypt(3) setting prefix of SHA-512 */
+inline constexpr const char* sha512 = "$6$";
+
+/** @brief Hash a password with a fresh random salt.
+ *
+ *  @param[in] password - clear text password
+ *  @param[in] prefix - setting prefix selecting the algorithm, e.g. "$6$"
+ *  @param[in] cost - algorithm specific cost (yescrypt cost factor, SHA-512
+ *                    rounds), 0 for the library default
+ *  @return - crypt(3) hash string suitable for /etc/shadow
+ *  @throws std::runtime_error if the algorithm or cost isn't supported
+ */
+std::string hash(const std::string& password, const std::string& prefix,
+                 unsigned long cost);
+
+/** @brief Check a password against a crypt(3) hash string.
+ *
+ *  @param[in] password - clear text password
+ *  @param[in] hashed - hash string, as found in /etc/shadow
+ *  @return - true if the password matches
+ */
+bool verify(const std::string& password, const std::string& hashed);
+
+/** @brief Measure how long a single hash takes on this machine.
+ *
+ *  @param[in] prefix - setting prefix selecting the algorithm
+ *  @param[in] cost - cost to measure
+ *  @return - the fastest of a few runs
+ */
+std::chrono::microseconds measure(const std::string& prefix,
+                                  unsigned long cost);
+
+/** @brief Find the cost that makes a verify take about 'target'.
+ *  @details SHA-512 rounds scale linearly, so one measurement is enough.
+ *  The yescrypt cost factor doubles the work on every step; the highest one
+ *  staying within the target is picked. The result is clamped between the
+ *  library default and a memory bound. Other algorithms are left at their
+ *  default cost.
+ *
+ *  @param[in] prefix - setting prefix selecting the algorithm
+ *  @param[in] target - desired verify latency, zero for the library default
+ *  @return - cost to pass to hash()
+ */
+unsigned long calibrate(const std::string& prefix,
+                        std::chrono::microseconds target);
+
+} // namespace password
+} // namespace user
+} // namespace phosphor
@@ -0,0 +1,184 @@
+#include "ldap_cache_warmer.hpp"
+
+#include <grp.h>
+#include <pwd.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <exception>
+#include <utility>
+#include <vector>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace
+{
+
+// Plenty for a few hundred group members, grown if it isn't
+constexpr size_t initialBufferSize = 4096;
+constexpr size_t maxBufferSize = 256 * 1024;
+
+} // namespace
+
+bool lookupGroup(const std::string& name)
+{
+    std::vector<char> buffer(initialBufferSize);
+    group grp{};
+    group* result = nullptr;
+    int r = 0;
+    while ((r = getgrnam_r(name.c_str(), &grp, buffer.data(), buffer.size(),
+                           &result)) == ERANGE &&
+           buffer.size() < maxBufferSize)
+    {
+        buffer.resize(buffer.size() * 2);
+    }
+    return r == 0 && result != nullptr;
+}
+
+bool lookupUser(const std::string& name)
+{
+    std::vector<char> buffer(initialBufferSize);
+    passwd pwd{};
+    passwd* result = nullptr;
+    int r = 0;
+    while ((r = getpwnam_r(name.c_str(), &pwd, buffer.data(), buffer.size(),
+                           &result)) == ERANGE &&
+           buffer.size() < maxBufferSize)
+    {
+        buffer.resize(buffer.size() * 2);
+    }
+    if (r != 0 || result == nullptr)
+    {
+        return false;
+    }
+
+    // The initgroups lookup pam does for every login
+    std::vector<gid_t> groups(32);
+    int count = static_cast<int>(groups.size());
+    if (getgrouplist(name.c_str(), pwd.pw_gid, groups.data(), &count) < 0)
+    {
+        groups.resize(count);
+        getgrouplist(name.c_str(), pwd.pw_gid, groups.data(), &count);
+    }
+    return true;
+}
+
+CacheWarmer::CacheWarmer(size_t concurrency, Lookup groupLookup,
+                         Lookup userLookup) :
+    groupLookup(std::move(groupLookup)), userLookup(std::move(userLookup))
+{
+    for (size_t i = 0; i < std::max<size_t>(concurrency, 1); ++i)
+    {
+        workers.emplace_back(&CacheWarmer::run, this);
+    }
+}
+
+CacheWarmer::~CacheWarmer()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    wake.notify_all();
+    // Waits for the lookups in progress, bounded by nslcd's timelimit
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void CacheWarmer::warm(const std::vector<std::string>& groups,
+                       const std::vector<std::string>& users)
+{
+    {
+        std::lock_guard lock(mutex);
+        if (!queue.empty())
+        {
+            ++counters.cancelled;
+            queue.clear();
+        }
+        for (const auto& name : groups)
+        {
+            queue.push_back({true, name});
+        }
+        for (const auto& name : users)
+        {
+            queue.push_back({false, name});
+        }
+        if (queue.empty())
+        {
+            return;
+        }
+        ++counters.runs;
+        started = std::chrono::steady_clock::now();
+    }
+    wake.notify_all();
+}
+
+bool CacheWarmer::waitIdle(std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(mutex);
+    return idle.wait_for(lock, timeout,
+                         [this] { return queue.empty() && busy == 0; });
+}
+
+WarmUpStats CacheWarmer::stats() const
+{
+    std::lock_guard lock(mutex);
+    return counters;
+}
+
+void CacheWarmer::run()
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping)
+        {
+            break;
+        }
+
+        auto item = std::move(queue.front());
+        queue.pop_front();
+        ++busy;
+        lock.unlock();
+        bool found = false;
+        try
+        {
+            found = item.group ? groupLookup(item.name)
+                               : userLookup(item.name);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Cache warm-up lookup of {NAME} failed: {ERR}", "NAME",
+                       item.name, "ERR", e);
+        }
+        lock.lock();
+        --busy;
+
+        ++counters.lookups;
+        if (!found)
+        {
+            ++counters.misses;
+            lg2::debug("Cache warm-up: {NAME} not found", "NAME", item.name);
+        }
+        if (queue.empty() && busy == 0)
+        {
+            counters.lastDuration =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started);
+            idle.notify_all();
+        }
+    }
+}
+
+} // namespace ldap
+} // namespace phosphor
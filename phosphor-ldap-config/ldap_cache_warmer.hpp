@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+/** @brief Look up a group by name, caching it in nscd on the way
+ *  @returns true if the group exists
+ */
+bool lookupGroup(const std::string& name);
+
+/** @brief Look up a user by name and the groups it is in, caching both in
+ *         nscd on the way, as a login does
+ *  @returns true if the user exists
+ */
+bool lookupUser(const std::string& name);
+
+struct WarmUpStats
+{
+    uint64_t runs = 0;
+    /** @brief runs cut short by a newer one */
+    uint64_t cancelled = 0;
+    uint64_t lookups = 0;
+    /** @brief names that didn't resolve */
+    uint64_t misses = 0;
+    /** @brief time the last completed run took */
+    std::chrono::microseconds lastDuration{0};
+};
+
+/** @class CacheWarmer
+ *  @brief Resolves the names logins will need right after nslcd or nscd
+ *         restarted, on a few background threads, so the first login finds
+ *         them cached.
+ */
+class CacheWarmer
+{
+  public:
+    using Lookup = std::function<bool(const std::string&)>;
+
+    CacheWarmer() = delete;
+    CacheWarmer(const CacheWarmer&) = delete;
+    CacheWarmer& operator=(const CacheWarmer&) = delete;
+    CacheWarmer(CacheWarmer&&) = delete;
+    CacheWarmer& operator=(CacheWarmer&&) = delete;
+
+    /** @brief Start the lookup threads, idle until warm() is called.
+     *  @param[in] concurrency - most lookups at a time, i.e. threads
+     *  @param[in] groupLookup - resolves a group name
+     *  @param[in] userLookup - resolves a user name
+     */
+    explicit CacheWarmer(size_t concurrency, Lookup groupLookup = lookupGroup,
+                         Lookup userLookup = lookupUser);
+    ~CacheWarmer();
+
+    /** @brief Resolve the given names, groups first
+     *  @details Names still queued from an earlier call are dropped, they
+     *  were looked up against a config that is gone.
+     *  @param[in] groups - group names
+     *  @param[in] users - user names
+     */
+    void warm(const std::vector<std::string>& groups,
+              const std::vector<std::string>& users);
+
+    /** @brief Wait until every queued name was looked up
+     *  @param[in] timeout - longest time to wait
+     *  @returns true if idle, false on timeout
+     */
+    bool waitIdle(std::chrono::milliseconds timeout);
+
+    /** @brief the statistics so far */
+    WarmUpStats stats() const;
+
+  private:
+    struct Item
+    {
+        bool group;
+        std::string name;
+    };
+
+    void run();
+
+    const Lookup groupLookup;
+    const Lookup userLookup;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    bool stopping = false;
+    std::deque<Item> queue;
+    /** @brief lookups in progress */
+    size_t busy = 0;
+    std::chrono::steady_clock::time_point started;
+
+    WarmUpStats counters;
+
+    std::vector<std::thread> workers;
+};
+
+} // namespace ldap
+} // namespace phosphor
@@ -1,9 +1,17 @@
 #include "ldap_config.hpp"
 
+#include "file.hpp"
 #include "ldap_config_mgr.hpp"
+#include "ldap_mapper_journal.hpp"
 #include "ldap_mapper_serialize.hpp"
 #include "utils.hpp"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <systemd/sd-bus.h>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
 #include <cereal/archives/binary.hpp>
 #include <cereal/types/string.hpp>
 #include <cereal/types/vector.hpp>
@@ -14,9 +22,23 @@
 #include <xyz/openbmc_project/Common/error.hpp>
 #include <xyz/openbmc_project/User/Common/error.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <map>
 #include <sstream>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <unordered_set>
+#include <variant>
 
 // Register class version
 // From cereal documentation;
@@ -29,13 +51,19 @@ namespace ldap
 {
 
 constexpr auto nslcdService = "nslcd.service";
-constexpr auto ldapScheme = "ldap";
-constexpr auto ldapsScheme = "ldaps";
-constexpr auto certObjPath = "/xyz/openbmc_project/certs/client/ldap/1";
-constexpr auto certRootPath = "/xyz/openbmc_project/certs/client/ldap";
-constexpr auto authObjPath = "/xyz/openbmc_project/certs/authority/truststore";
-constexpr auto certIface = "xyz.openbmc_project.Certs.Certificate";
-constexpr auto certProperty = "CertificateString";
+// Privileges from the highest to the lowest
+constexpr std::array<std::string_view, 3> privilegeOrder = {
+    "priv-admin", "priv-operator", "priv-user"};
+// nslcd's passwd and group filters unless the config overrides them
+constexpr auto adPasswdFilter =
+    "(&(objectClass=user)(objectClass=person)(!(objectClass=computer)))";
+constexpr auto adGroupFilter =
+    "(|(objectclass=group)(objectclass=groupofnames) "
+    "(objectclass=groupofuniquenames))";
+constexpr auto openLdapPasswdFilter = "(objectclass=posixAccount)";
+constexpr auto openLdapGroupFilter = "(objectclass=posixGroup)";
+// AD's objectSid is mapped to uid and gid numbers relative to this
+constexpr auto adDomainSid = "S-1-5-21-3623811015-3361044348-30300820";
 
 using namespace phosphor::logging;
 using namespace sdbusplus::xyz::openbmc_project::Common::Error;
@@ -51,6 +79,58 @@ using Key = std::string;
 using Val = std::string;
 using ConfigInfo = std::map<Key, Val>;
 
+// Framing of the persisted config: magic, format version, size and CRC32
+// of the cereal archive that follows.
+constexpr uint32_t persistMagic = 0x46434c50;
+constexpr uint32_t persistFormatVersion = 1;
+constexpr size_t persistHeaderSize = 4 * sizeof(uint32_t);
+
+/** @brief Replace a file atomically and durably.
+ *  @details A temporary file next to it is written, synced and renamed over
+ *  it, so a crash leaves either the old or the new content.
+ *  @throws std::system_error on failure
+ */
+static void replaceFile(const std::string& path, std::string_view content,
+                        fs::perms permission)
+{
+    std::string tmpFile = path + ".XXXXXX";
+    int fd = mkstemp(tmpFile.data());
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), tmpFile);
+    }
+    {
+        phosphor::user::File file(fd, tmpFile, "w", true);
+        if (file() == nullptr)
+        {
+            close(fd);
+            throw std::system_error(errno, std::generic_category(), tmpFile);
+        }
+        // Restrict the file before the content goes in
+        if (fchmod(fd, static_cast<mode_t>(permission)) != 0 ||
+            fwrite(content.data(), 1, content.size(), file()) !=
+                content.size() ||
+            fflush(file()) != 0 || fsync(fd) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), tmpFile);
+        }
+        fs::rename(tmpFile, path);
+    }
+
+    auto dir = fs::path(path).parent_path();
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0 || fsync(dirFd) != 0)
+    {
+        int error = errno;
+        if (dirFd >= 0)
+        {
+            close(dirFd);
+        }
+        throw std::system_error(error, std::generic_category(), dir);
+    }
+    close(dirFd);
+}
+
 Config::Config(sdbusplus::bus_t& bus, const char* path, const char* filePath,
                const char* caCertFile, const char* certFile, bool secureLDAP,
                std::string ldapServerURI, std::string ldapBindDN,
@@ -63,21 +143,7 @@ Config::Config(sdbusplus::bus_t& bus, const char* path, const char* filePath,
     secureLDAP(secureLDAP), ldapBindPassword(std::move(ldapBindDNPassword)),
     tlsCacertFile(caCertFile), tlsCertFile(certFile), configFilePath(filePath),
     objectPath(path), bus(bus), parent(parent),
-    certificateInstalledSignal(
-        bus, sdbusplus::bus::match::rules::interfacesAdded(certRootPath),
-        std::bind(std::mem_fn(&Config::certificateInstalled), this,
-                  std::placeholders::_1)),
-
-    cacertificateInstalledSignal(
-        bus, sdbusplus::bus::match::rules::interfacesAdded(authObjPath),
-        std::bind(std::mem_fn(&Config::certificateInstalled), this,
-                  std::placeholders::_1)),
-
-    certificateChangedSignal(
-        bus,
-        sdbusplus::bus::match::rules::propertiesChanged(certObjPath, certIface),
-        std::bind(std::mem_fn(&Config::certificateChanged), this,
-                  std::placeholders::_1))
+    mapperJournal(parent.dbusPersistentPath + path + '/' + journal::fileName)
 {
     ConfigIface::ldapServerURI(ldapServerURI);
     ConfigIface::ldapBindDN(ldapBindDN);
@@ -114,19 +180,7 @@ Config::Config(sdbusplus::bus_t& bus, const char* path, const char* filePath,
     Ifaces(bus, path, Ifaces::action::defer_emit),
     secureLDAP(false), tlsCacertFile(caCertFile), tlsCertFile(certFile),
     configFilePath(filePath), objectPath(path), bus(bus), parent(parent),
-    certificateInstalledSignal(
-        bus, sdbusplus::bus::match::rules::interfacesAdded(certRootPath),
-        std::bind(std::mem_fn(&Config::certificateInstalled), this,
-                  std::placeholders::_1)),
-    cacertificateInstalledSignal(
-        bus, sdbusplus::bus::match::rules::interfacesAdded(authObjPath),
-        std::bind(std::mem_fn(&Config::certificateInstalled), this,
-                  std::placeholders::_1)),
-    certificateChangedSignal(
-        bus,
-        sdbusplus::bus::match::rules::propertiesChanged(certObjPath, certIface),
-        std::bind(std::mem_fn(&Config::certificateChanged), this,
-                  std::placeholders::_1))
+    mapperJournal(parent.dbusPersistentPath + path + '/' + journal::fileName)
 {
     ConfigIface::ldapType(ldapType);
 
@@ -139,71 +193,44 @@ Config::Config(sdbusplus::bus_t& bus, const char* path, const char* filePath,
     configPersistPath += "/config";
 }
 
-void Config::certificateInstalled(sdbusplus::message_t& /*msg*/)
+bool Config::writeConfig()
 {
-    try
+    std::stringstream confData;
+    auto isPwdTobeWritten = false;
+    std::string userNameAttr;
+
+    confData << "uid root\n";
+    confData << "gid root\n\n";
+    confData << "ldap_version 3\n\n";
+    confData << "timelimit " << nslcdTuning.timelimit << "\n";
+    confData << "bind_timelimit " << nslcdTuning.bindTimelimit << "\n";
+    // Zero is nslcd's default for these, leave them out
+    if (nslcdTuning.idleTimelimit > 0)
     {
-        if (enabled())
-        {
-            writeConfig();
-        }
-        parent.startOrStopService(nslcdService, enabled());
+        confData << "idle_timelimit " << nslcdTuning.idleTimelimit << "\n";
     }
-    catch (const InternalFailure& e)
+    if (nslcdTuning.reconnectSleeptime > 0)
     {
-        throw;
+        confData << "reconnect_sleeptime " << nslcdTuning.reconnectSleeptime
+                 << "\n";
     }
-    catch (const std::exception& e)
+    if (nslcdTuning.reconnectRetrytime > 0)
     {
-        lg2::error("Exception: {ERR}", "ERR", e);
-        elog<InternalFailure>();
+        confData << "reconnect_retrytime " << nslcdTuning.reconnectRetrytime
+                 << "\n";
     }
-}
-
-void Config::certificateChanged(sdbusplus::message_t& msg)
-{
-    std::string objectName;
-    std::map<std::string, std::variant<std::string>> msgData;
-    msg.read(objectName, msgData);
-    auto valPropMap = msgData.find(certProperty);
+    if (nslcdTuning.threads > 0)
     {
-        if (valPropMap != msgData.end())
-        {
-            try
-            {
-                if (enabled())
-                {
-                    writeConfig();
-                }
-                parent.startOrStopService(nslcdService, enabled());
-            }
-            catch (const InternalFailure& e)
-            {
-                throw;
-            }
-            catch (const std::exception& e)
-            {
-                lg2::error("Exception: {ERR}", "ERR", e);
-                elog<InternalFailure>();
-            }
-        }
+        confData << "threads " << nslcdTuning.threads << "\n";
     }
-}
-
-void Config::writeConfig()
-{
-    std::stringstream confData;
-    auto isPwdTobeWritten = false;
-    std::string userNameAttr;
-
-    confData << "uid root\n";
-    confData << "gid root\n\n";
-    confData << "ldap_version 3\n\n";
-    confData << "timelimit 30\n";
-    confData << "bind_timelimit 30\n";
-    confData << "pagesize 1000\n";
+    confData << "pagesize " << nslcdTuning.pagesize << "\n";
     confData << "referrals off\n\n";
-    confData << "uri " << ldapServerURI() << "\n\n";
+    // nslcd tries the servers in the order of the uri lines
+    for (const auto& uri : serverURIs())
+    {
+        confData << "uri " << uri << "\n";
+    }
+    confData << "\n";
     confData << "base " << ldapBaseDN() << "\n\n";
     confData << "binddn " << ldapBindDN() << "\n";
     if (!ldapBindPassword.empty())
@@ -224,8 +251,12 @@ void Config::writeConfig()
             confData << "scope base\n\n";
             break;
     }
-    confData << "base passwd " << ldapBaseDN() << "\n";
-    confData << "base shadow " << ldapBaseDN() << "\n\n";
+    auto passwdBase = nss.passwdBase.empty() ? ldapBaseDN() : nss.passwdBase;
+    confData << "base passwd " << passwdBase << "\n";
+    confData << "base shadow " << passwdBase << "\n";
+    confData << "base group "
+             << (nss.groupBase.empty() ? ldapBaseDN() : nss.groupBase)
+             << "\n\n";
     if (secureLDAP == true)
     {
         confData << "ssl on\n";
@@ -259,22 +290,25 @@ void Config::writeConfig()
         {
             ConfigIface::groupNameAttribute("primaryGroupID");
         }
-        confData << "filter passwd (&(objectClass=user)(objectClass=person)"
-                    "(!(objectClass=computer)))\n";
-        confData
-            << "filter group (|(objectclass=group)(objectclass=groupofnames) "
-               "(objectclass=groupofuniquenames))\n";
+        confData << "filter passwd "
+                 << (nss.passwdFilter.empty() ? adPasswdFilter
+                                              : nss.passwdFilter)
+                 << "\n";
+        confData << "filter group "
+                 << (nss.groupFilter.empty() ? adGroupFilter
+                                             : nss.groupFilter)
+                 << "\n";
         confData << "map passwd uid              "
                  << ConfigIface::userNameAttribute() << "\n";
-        confData << "map passwd uidNumber        "
-                    "objectSid:S-1-5-21-3623811015-3361044348-30300820\n";
+        confData << "map passwd uidNumber        objectSid:" << adDomainSid
+                 << "\n";
         confData << "map passwd gidNumber        "
                  << ConfigIface::groupNameAttribute() << "\n";
         confData << "map passwd homeDirectory    \"/home/$sAMAccountName\"\n";
         confData << "map passwd gecos            displayName\n";
         confData << "map passwd loginShell       \"/bin/sh\"\n";
-        confData << "map group gidNumber         "
-                    "objectSid:S-1-5-21-3623811015-3361044348-30300820\n";
+        confData << "map group gidNumber         objectSid:" << adDomainSid
+                 << "\n";
         confData << "map group cn                "
                  << ConfigIface::userNameAttribute() << "\n";
         confData << "nss_initgroups_ignoreusers ALLLOCAL\n";
@@ -289,9 +323,15 @@ void Config::writeConfig()
         {
             ConfigIface::groupNameAttribute("gidNumber");
         }
-        confData << "filter passwd (objectclass=*)\n";
+        confData << "filter passwd "
+                 << (nss.passwdFilter.empty() ? openLdapPasswdFilter
+                                              : nss.passwdFilter)
+                 << "\n";
         confData << "map passwd gecos displayName\n";
-        confData << "filter group (objectclass=posixGroup)\n";
+        confData << "filter group "
+                 << (nss.groupFilter.empty() ? openLdapGroupFilter
+                                             : nss.groupFilter)
+                 << "\n";
         confData << "map passwd uid              "
                  << ConfigIface::userNameAttribute() << "\n";
         confData << "map passwd gidNumber        "
@@ -299,33 +339,53 @@ void Config::writeConfig()
         confData << "map passwd loginShell       \"/bin/sh\"\n";
         confData << "nss_initgroups_ignoreusers ALLLOCAL\n";
     }
+    // Lookups nslcd answers without asking the server
+    if (nss.minUid > 0)
+    {
+        confData << "nss_min_uid " << nss.minUid << "\n";
+    }
+    if (nss.skipMembers)
+    {
+        confData << "nss_getgrent_skipmembers yes\n";
+    }
+    if (nss.disableEnumeration)
+    {
+        confData << "nss_disable_enumeration yes\n";
+    }
+    // remove the read permission from others if password is being written.
+    // nslcd forces this behaviour.
+    auto permission = fs::perms::owner_read | fs::perms::owner_write |
+                      fs::perms::group_read;
+    if (!isPwdTobeWritten)
+    {
+        permission |= fs::perms::others_read;
+    }
+
+    auto content = confData.str();
     try
     {
-        std::fstream stream(configFilePath.c_str(), std::fstream::out);
-        // remove the read permission from others if password is being written.
-        // nslcd forces this behaviour.
-        auto permission = fs::perms::owner_read | fs::perms::owner_write |
-                          fs::perms::group_read;
-        if (isPwdTobeWritten)
-        {
-            fs::permissions(configFilePath, permission);
-        }
-        else
+        // Every rewrite is followed by an nslcd restart, which drops its
+        // connections and caches; skip both if nothing would change.
+        std::error_code ec;
+        if (fs::status(configFilePath, ec).permissions() == permission)
         {
-            fs::permissions(configFilePath,
-                            permission | fs::perms::others_read);
+            std::ifstream current(configFilePath, std::ios::binary);
+            std::stringstream onDisk;
+            onDisk << current.rdbuf();
+            if (current && onDisk.str() == content)
+            {
+                return false;
+            }
         }
 
-        stream << confData.str();
-        stream.flush();
-        stream.close();
+        replaceFile(configFilePath, content, permission);
     }
     catch (const std::exception& e)
     {
         lg2::error("Exception: {ERR}", "ERR", e);
         elog<InternalFailure>();
     }
-    return;
+    return true;
 }
 
 std::string Config::ldapBindDNPassword(std::string value)
@@ -338,8 +398,7 @@ std::string Config::ldapBindDNPassword(std::string value)
     {
         if (enabled())
         {
-            writeConfig();
-            parent.startOrStopService(nslcdService, enabled());
+            parent.requestConfigWrite();
         }
         serialize();
         // Send event.
@@ -370,32 +429,25 @@ std::string Config::ldapServerURI(std::string value)
         {
             return value;
         }
-        if (isValidLDAPURI(value, ldapsScheme))
-        {
-            secureLDAP = true;
-        }
-        else if (isValidLDAPURI(value, ldapScheme))
-        {
-            secureLDAP = false;
-        }
-        else
+        auto secure = validateLDAPURIs(value);
+        if (!secure)
         {
             lg2::error("Bad LDAP Server URI {URI}", "URI", value);
             elog<InvalidArgument>(Argument::ARGUMENT_NAME("ldapServerURI"),
                                   Argument::ARGUMENT_VALUE(value.c_str()));
         }
 
-        if (secureLDAP && !fs::exists(tlsCacertFile.c_str()))
+        if (*secure && !fs::exists(tlsCacertFile.c_str()))
         {
             lg2::error("LDAP server CA certificate not found at {PATH}", "PATH",
                        tlsCacertFile);
             elog<NoCACertificate>();
         }
+        secureLDAP = *secure;
         val = ConfigIface::ldapServerURI(value);
         if (enabled())
         {
-            writeConfig();
-            parent.startOrStopService(nslcdService, enabled());
+            parent.requestConfigWrite();
         }
         // save the object.
         serialize();
@@ -447,8 +499,7 @@ std::string Config::ldapBindDN(std::string value)
         val = ConfigIface::ldapBindDN(value);
         if (enabled())
         {
-            writeConfig();
-            parent.startOrStopService(nslcdService, enabled());
+            parent.requestConfigWrite();
         }
         // save the object.
         serialize();
@@ -496,8 +547,7 @@ std::string Config::ldapBaseDN(std::string value)
         val = ConfigIface::ldapBaseDN(value);
         if (enabled())
         {
-            writeConfig();
-            parent.startOrStopService(nslcdService, enabled());
+            parent.requestConfigWrite();
         }
         // save the object.
         serialize();
@@ -524,6 +574,192 @@ std::string Config::ldapBaseDN(std::string value)
     return val;
 }
 
+void Config::updateConfig(
+    const std::map<std::string, ConfigIface::PropertiesVariant>& properties)
+{
+    auto uri = ldapServerURI();
+    auto bindDN = ldapBindDN();
+    auto baseDN = ldapBaseDN();
+    auto scope = ldapSearchScope();
+    auto userNameAttr = userNameAttribute();
+    auto groupNameAttr = groupNameAttribute();
+    auto bindPassword = ldapBindPassword;
+    auto secure = secureLDAP;
+
+    auto read = [](const std::string& name,
+                   const ConfigIface::PropertiesVariant& value, auto& out) {
+        using Value = std::decay_t<decltype(out)>;
+        const auto* typed = std::get_if<Value>(&value);
+        if (typed == nullptr)
+        {
+            lg2::error("Wrong type for LDAP property {NAME}", "NAME", name);
+            elog<InvalidArgument>(Argument::ARGUMENT_NAME(name.c_str()),
+                                  Argument::ARGUMENT_VALUE("wrong type"));
+        }
+        out = *typed;
+    };
+
+    for (const auto& [name, value] : properties)
+    {
+        if (name == "LDAPServerURI")
+        {
+            read(name, value, uri);
+        }
+        else if (name == "LDAPBindDN")
+        {
+            read(name, value, bindDN);
+        }
+        else if (name == "LDAPBaseDN")
+        {
+            read(name, value, baseDN);
+        }
+        else if (name == "LDAPSearchScope")
+        {
+            read(name, value, scope);
+        }
+        else if (name == "UserNameAttribute")
+        {
+            read(name, value, userNameAttr);
+        }
+        else if (name == "GroupNameAttribute")
+        {
+            read(name, value, groupNameAttr);
+        }
+        else if (name == "LDAPBindDNPassword")
+        {
+            read(name, value, bindPassword);
+        }
+        else if (name == "LDAPType")
+        {
+            elog<NotAllowed>(NotAllowedArgument::REASON("ReadOnly Property"));
+        }
+        else
+        {
+            lg2::error("Unknown LDAP property {NAME}", "NAME", name);
+            elog<InvalidArgument>(Argument::ARGUMENT_NAME(name.c_str()),
+                                  Argument::ARGUMENT_VALUE("unknown"));
+        }
+    }
+
+    if (uri != ldapServerURI())
+    {
+        auto valid = validateLDAPURIs(uri);
+        if (!valid)
+        {
+            lg2::error("Bad LDAP Server URI {URI}", "URI", uri);
+            elog<InvalidArgument>(Argument::ARGUMENT_NAME("ldapServerURI"),
+                                  Argument::ARGUMENT_VALUE(uri.c_str()));
+        }
+        secure = *valid;
+        if (secure && !fs::exists(tlsCacertFile.c_str()))
+        {
+            lg2::error("LDAP server CA certificate not found at {PATH}", "PATH",
+                       tlsCacertFile);
+            elog<NoCACertificate>();
+        }
+    }
+    if (bindDN != ldapBindDN() && bindDN.empty())
+    {
+        lg2::error("'{BINDDN}' is not a valid LDAP BindDN", "BINDDN", bindDN);
+        elog<InvalidArgument>(Argument::ARGUMENT_NAME("ldapBindDN"),
+                              Argument::ARGUMENT_VALUE(bindDN.c_str()));
+    }
+    if (baseDN != ldapBaseDN() && baseDN.empty())
+    {
+        lg2::error("'{BASEDN}' is not a valid LDAP BaseDN", "BASEDN", baseDN);
+        elog<InvalidArgument>(Argument::ARGUMENT_NAME("ldapBaseDN"),
+                              Argument::ARGUMENT_VALUE(baseDN.c_str()));
+    }
+
+    // Everything is valid, apply without a signal per property
+    std::vector<std::pair<std::string, std::string>> changed;
+    if (uri != ldapServerURI())
+    {
+        ConfigIface::ldapServerURI(uri, true);
+        changed.emplace_back("LDAPServerURI", uri);
+    }
+    if (bindDN != ldapBindDN())
+    {
+        ConfigIface::ldapBindDN(bindDN, true);
+        changed.emplace_back("LDAPBindDN", bindDN);
+    }
+    if (baseDN != ldapBaseDN())
+    {
+        ConfigIface::ldapBaseDN(baseDN, true);
+        changed.emplace_back("LDAPBaseDN", baseDN);
+    }
+    if (scope != ldapSearchScope())
+    {
+        ConfigIface::ldapSearchScope(scope, true);
+        changed.emplace_back("LDAPSearchScope", "");
+    }
+    if (userNameAttr != userNameAttribute())
+    {
+        ConfigIface::userNameAttribute(userNameAttr, true);
+        changed.emplace_back("UserNameAttribute", userNameAttr);
+    }
+    if (groupNameAttr != groupNameAttribute())
+    {
+        ConfigIface::groupNameAttribute(groupNameAttr, true);
+        changed.emplace_back("GroupNameAttribute", groupNameAttr);
+    }
+    secureLDAP = secure;
+    bool passwordChanged = bindPassword != ldapBindPassword;
+    ldapBindPassword = std::move(bindPassword);
+
+    if (changed.empty() && !passwordChanged)
+    {
+        return;
+    }
+
+    try
+    {
+        if (enabled())
+        {
+            parent.requestConfigWrite();
+        }
+        // save the object.
+        serialize();
+
+        if (!changed.empty())
+        {
+            std::vector<char*> names;
+            for (auto& [name, value] : changed)
+            {
+                names.push_back(name.data());
+            }
+            names.push_back(nullptr);
+            sd_bus_emit_properties_changed_strv(
+                bus.get(), objectPath.c_str(), ConfigIface::interface,
+                names.data());
+        }
+
+        // Same events as the setters; the search scope setter sends none.
+        // The password is left out, it doesn't belong in the log.
+        for (const auto& [name, value] : changed)
+        {
+            if (name == "LDAPSearchScope")
+            {
+                continue;
+            }
+            std::vector<std::string> messageArgs = {name, value};
+            sendEvent(MESSAGE_TYPE::PROPERTY_VALUE_MODIFIED,
+                      sdbusplus::xyz::openbmc_project::Logging::server::
+                          Entry::Level::Informational,
+                      messageArgs, objectPath);
+        }
+    }
+    catch (const InternalFailure& e)
+    {
+        throw;
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Exception: {ERR}", "ERR", e);
+        elog<InternalFailure>();
+    }
+}
+
 ConfigIface::SearchScope Config::ldapSearchScope(ConfigIface::SearchScope value)
 {
     ConfigIface::SearchScope val;
@@ -537,9 +773,7 @@ ConfigIface::SearchScope Config::ldapSearchScope(ConfigIface::SearchScope value)
         val = ConfigIface::ldapSearchScope(value);
         if (enabled())
         {
-            writeConfig();
-
-            parent.startOrStopService(nslcdService, enabled());
+            parent.requestConfigWrite();
         }
         // save the object.
         serialize();
@@ -583,9 +817,12 @@ bool Config::enableService(bool value)
         isEnable = EnableIface::enabled(value);
         if (isEnable)
         {
-            writeConfig();
+            parent.requestConfigWrite(true);
+        }
+        else
+        {
+            parent.startOrStopService(nslcdService, false);
         }
-        parent.startOrStopService(nslcdService, value);
         serialize();
         std::vector<std::string> messageArgs = {"Enabled",
                                                 std::to_string(value)};
@@ -620,9 +857,7 @@ std::string Config::userNameAttribute(std::string value)
         val = ConfigIface::userNameAttribute(value);
         if (enabled())
         {
-            writeConfig();
-
-            parent.startOrStopService(nslcdService, enabled());
+            parent.requestConfigWrite();
         }
         // save the object.
         serialize();
@@ -658,9 +893,7 @@ std::string Config::groupNameAttribute(std::string value)
         val = ConfigIface::groupNameAttribute(value);
         if (enabled())
         {
-            writeConfig();
-
-            parent.startOrStopService(nslcdService, enabled());
+            parent.requestConfigWrite();
         }
         // save the object.
         serialize();
@@ -684,6 +917,235 @@ std::string Config::groupNameAttribute(std::string value)
     return val;
 }
 
+const NslcdTuning& Config::tuning() const
+{
+    return nslcdTuning;
+}
+
+void Config::tuning(const NslcdTuning& value)
+{
+    if (value == nslcdTuning)
+    {
+        return;
+    }
+
+    auto check = [](const char* name, uint32_t setting, uint32_t min,
+                    uint32_t max) {
+        if (setting < min || setting > max)
+        {
+            lg2::error("LDAP setting {NAME} {VALUE} is out of range "
+                       "{MIN}..{MAX}",
+                       "NAME", name, "VALUE", setting, "MIN", min, "MAX", max);
+            elog<InvalidArgument>(
+                Argument::ARGUMENT_NAME(name),
+                Argument::ARGUMENT_VALUE(std::to_string(setting).c_str()));
+        }
+    };
+    // nslcd treats a zero limit as none, which is what stalls logins
+    check("Timelimit", value.timelimit, 1, 300);
+    check("BindTimelimit", value.bindTimelimit, 1, 300);
+    check("IdleTimelimit", value.idleTimelimit, 0, 3600);
+    check("ReconnectSleeptime", value.reconnectSleeptime, 0, 60);
+    check("ReconnectRetrytime", value.reconnectRetrytime,
+          value.reconnectSleeptime, 3600);
+    check("Threads", value.threads, 0, 16);
+    check("Pagesize", value.pagesize, 0, 100000);
+
+    nslcdTuning = value;
+    if (enabled())
+    {
+        parent.requestConfigWrite();
+    }
+    serialize();
+}
+
+const NssShaping& Config::nssShaping() const
+{
+    return nss;
+}
+
+void Config::nssShaping(const NssShaping& value)
+{
+    if (value == nss)
+    {
+        return;
+    }
+
+    auto reject = [](const char* name, const std::string& setting) {
+        lg2::error("'{VALUE}' is not a valid LDAP {NAME}", "VALUE", setting,
+                   "NAME", name);
+        elog<InvalidArgument>(Argument::ARGUMENT_NAME(name),
+                              Argument::ARGUMENT_VALUE(setting.c_str()));
+    };
+    if (!value.passwdBase.empty() && !isValidLDAPDN(value.passwdBase))
+    {
+        reject("PasswdBase", value.passwdBase);
+    }
+    if (!value.groupBase.empty() && !isValidLDAPDN(value.groupBase))
+    {
+        reject("GroupBase", value.groupBase);
+    }
+    if (!value.passwdFilter.empty() && !isValidLDAPFilter(value.passwdFilter))
+    {
+        reject("PasswdFilter", value.passwdFilter);
+    }
+    if (!value.groupFilter.empty() && !isValidLDAPFilter(value.groupFilter))
+    {
+        reject("GroupFilter", value.groupFilter);
+    }
+
+    nss = value;
+    if (enabled())
+    {
+        parent.requestConfigWrite();
+    }
+    serialize();
+}
+
+const NscdTtl& Config::nscdTtl() const
+{
+    return cacheTtl;
+}
+
+void Config::nscdTtl(const NscdTtl& value)
+{
+    if (value == cacheTtl)
+    {
+        return;
+    }
+
+    auto check = [](const char* name, uint32_t ttl, uint32_t max) {
+        if (ttl > max)
+        {
+            lg2::error("nscd TTL {NAME} {VALUE} is above {MAX}", "NAME", name,
+                       "VALUE", ttl, "MAX", max);
+            elog<InvalidArgument>(
+                Argument::ARGUMENT_NAME(name),
+                Argument::ARGUMENT_VALUE(std::to_string(ttl).c_str()));
+        }
+    };
+    // A day at most, privilege changes in LDAP must show up eventually
+    check("PasswdPositiveTTL", value.passwdPositive, 86400);
+    check("PasswdNegativeTTL", value.passwdNegative, 3600);
+    check("GroupPositiveTTL", value.groupPositive, 86400);
+    check("GroupNegativeTTL", value.groupNegative, 3600);
+
+    cacheTtl = value;
+    if (enabled())
+    {
+        parent.requestConfigWrite();
+    }
+    serialize();
+}
+
+const std::vector<std::string>& Config::warmUpUsers() const
+{
+    return warmUsers;
+}
+
+void Config::warmUpUsers(std::vector<std::string> users)
+{
+    if (users == warmUsers)
+    {
+        return;
+    }
+    if (users.size() > maxWarmUpUsers)
+    {
+        lg2::error("{COUNT} warm-up users, at most {MAX} are allowed", "COUNT",
+                   users.size(), "MAX", maxWarmUpUsers);
+        elog<InvalidArgument>(
+            Argument::ARGUMENT_NAME("WarmUpUsers"),
+            Argument::ARGUMENT_VALUE(std::to_string(users.size()).c_str()));
+    }
+    for (const auto& user : users)
+    {
+        // Same characters useradd allows, which covers LDAP uids in practice
+        if (user.empty() || user.size() > 32 ||
+            user.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+                                   "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                   "0123456789._-@") != std::string::npos)
+        {
+            lg2::error("'{USER}' is not a valid warm-up user", "USER", user);
+            elog<InvalidArgument>(Argument::ARGUMENT_NAME("WarmUpUsers"),
+                                  Argument::ARGUMENT_VALUE(user.c_str()));
+        }
+    }
+    warmUsers = std::move(users);
+    serialize();
+}
+
+bool Config::writeNscdConfig()
+{
+    auto path = fs::path(configFilePath).parent_path() / nscdConfFile;
+    std::error_code ec;
+    auto permission = fs::status(path, ec).permissions();
+    if (ec)
+    {
+        return false;
+    }
+
+    const std::array<std::tuple<const char*, const char*, uint32_t>, 4>
+        settings = {{
+            {"positive-time-to-live", "passwd", cacheTtl.passwdPositive},
+            {"negative-time-to-live", "passwd", cacheTtl.passwdNegative},
+            {"positive-time-to-live", "group", cacheTtl.groupPositive},
+            {"negative-time-to-live", "group", cacheTtl.groupNegative},
+        }};
+    auto render = [](const auto& setting) {
+        const auto& [option, table, ttl] = setting;
+        return std::string("\t") + option + "\t" + table + "\t\t" +
+               std::to_string(ttl);
+    };
+
+    std::string current;
+    {
+        std::ifstream is(path, std::ios::binary);
+        current.assign(std::istreambuf_iterator<char>(is), {});
+    }
+    std::istringstream lines(current);
+    std::string content;
+    std::array<bool, settings.size()> seen{};
+    for (std::string line; std::getline(lines, line);)
+    {
+        std::istringstream words(line);
+        std::string option;
+        std::string table;
+        words >> option >> table;
+        for (size_t i = 0; i < settings.size(); ++i)
+        {
+            if (option == std::get<0>(settings[i]) &&
+                table == std::get<1>(settings[i]))
+            {
+                line = render(settings[i]);
+                seen[i] = true;
+            }
+        }
+        content += line + "\n";
+    }
+    for (size_t i = 0; i < settings.size(); ++i)
+    {
+        if (!seen[i])
+        {
+            content += render(settings[i]) + "\n";
+        }
+    }
+
+    if (content == current)
+    {
+        return false;
+    }
+    try
+    {
+        replaceFile(path.string(), content, permission);
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Exception: {ERR}", "ERR", e);
+        elog<InternalFailure>();
+    }
+    return true;
+}
+
 template <class Archive>
 void Config::save(Archive& archive, const std::uint32_t /*version*/) const
 {
@@ -695,10 +1157,19 @@ void Config::save(Archive& archive, const std::uint32_t /*version*/) const
     archive(ldapBindPassword);
     archive(userNameAttribute());
     archive(groupNameAttribute());
+    archive(nslcdTuning.timelimit, nslcdTuning.bindTimelimit,
+            nslcdTuning.idleTimelimit, nslcdTuning.reconnectSleeptime,
+            nslcdTuning.reconnectRetrytime, nslcdTuning.threads,
+            nslcdTuning.pagesize);
+    archive(nss.minUid, nss.skipMembers, nss.disableEnumeration,
+            nss.passwdBase, nss.groupBase, nss.passwdFilter, nss.groupFilter);
+    archive(cacheTtl.passwdPositive, cacheTtl.passwdNegative,
+            cacheTtl.groupPositive, cacheTtl.groupNegative);
+    archive(warmUsers);
 }
 
 template <class Archive>
-void Config::load(Archive& archive, const std::uint32_t /*version*/)
+void Config::load(Archive& archive, const std::uint32_t version)
 {
     bool bVal = false;
     archive(bVal);
@@ -726,58 +1197,124 @@ void Config::load(Archive& archive, const std::uint32_t /*version*/)
 
     archive(str);
     ConfigIface::groupNameAttribute(str);
+
+    // Older versions had these settings hard-coded, keep what they rendered
+    nslcdTuning = version >= 2 ? NslcdTuning{} : legacyNslcdTuning();
+    if (version >= 2)
+    {
+        archive(nslcdTuning.timelimit, nslcdTuning.bindTimelimit,
+                nslcdTuning.idleTimelimit, nslcdTuning.reconnectSleeptime,
+                nslcdTuning.reconnectRetrytime, nslcdTuning.threads,
+                nslcdTuning.pagesize);
+    }
+    nss = version >= 3 ? NssShaping{} : legacyNssShaping(ldapType());
+    if (version >= 3)
+    {
+        archive(nss.minUid, nss.skipMembers, nss.disableEnumeration,
+                nss.passwdBase, nss.groupBase, nss.passwdFilter,
+                nss.groupFilter);
+    }
+    cacheTtl = NscdTtl{};
+    if (version >= 4)
+    {
+        archive(cacheTtl.passwdPositive, cacheTtl.passwdNegative,
+                cacheTtl.groupPositive, cacheTtl.groupNegative);
+    }
+    warmUsers.clear();
+    if (version >= 5)
+    {
+        archive(warmUsers);
+    }
 }
 
 void Config::serialize()
 {
-    if (!fs::exists(configPersistPath.c_str()))
-    {
-        std::ofstream os(configPersistPath.string(),
-                         std::ios::binary | std::ios::out);
-        auto permission = fs::perms::owner_read | fs::perms::owner_write |
-                          fs::perms::group_read;
-        fs::permissions(configPersistPath, permission);
-        cereal::BinaryOutputArchive oarchive(os);
-        oarchive(*this);
-    }
-    else
+    persistDirty = true;
+    parent.requestPersist(*this);
+}
+
+void Config::persist()
+{
+    std::ostringstream os;
     {
-        std::ofstream os(configPersistPath.string(),
-                         std::ios::binary | std::ios::out);
         cereal::BinaryOutputArchive oarchive(os);
         oarchive(*this);
     }
-    return;
+    auto payload = os.str();
+
+    boost::crc_32_type crc;
+    crc.process_bytes(payload.data(), payload.size());
+    const uint32_t header[] = {persistMagic, persistFormatVersion,
+                               static_cast<uint32_t>(payload.size()),
+                               crc.checksum()};
+    std::string content(reinterpret_cast<const char*>(header),
+                        sizeof(header));
+    content += payload;
+
+    replaceFile(configPersistPath.string(), content,
+                fs::perms::owner_read | fs::perms::owner_write |
+                    fs::perms::group_read);
+    persistDirty = false;
 }
 
 bool Config::deserialize()
 {
     try
     {
-        if (fs::exists(configPersistPath))
+        if (!fs::exists(configPersistPath))
         {
-            std::ifstream is(configPersistPath.c_str(),
-                             std::ios::in | std::ios::binary);
-            cereal::BinaryInputArchive iarchive(is);
-            iarchive(*this);
+            return false;
+        }
 
-            if (isValidLDAPURI(ldapServerURI(), ldapScheme))
-            {
-                secureLDAP = false;
-            }
-            else if (isValidLDAPURI(ldapServerURI(), ldapsScheme))
+        std::ifstream is(configPersistPath.c_str(),
+                         std::ios::in | std::ios::binary);
+        std::string content(std::istreambuf_iterator<char>(is), {});
+
+        uint32_t header[4] = {};
+        bool framed = content.size() >= persistHeaderSize;
+        if (framed)
+        {
+            std::memcpy(header, content.data(), persistHeaderSize);
+            framed = header[0] == persistMagic;
+        }
+
+        std::string_view payload(content);
+        if (framed)
+        {
+            payload.remove_prefix(persistHeaderSize);
+            boost::crc_32_type crc;
+            crc.process_bytes(payload.data(), payload.size());
+            if (header[1] != persistFormatVersion ||
+                header[2] != payload.size() || header[3] != crc.checksum())
             {
-                secureLDAP = true;
+                lg2::error("Persisted LDAP config {FILE} is corrupt", "FILE",
+                           configPersistPath);
+                setAsideCorrupt();
+                return false;
             }
-            return true;
         }
-        return false;
+
+        std::istringstream archive{std::string(payload)};
+        cereal::BinaryInputArchive iarchive(archive);
+        iarchive(*this);
+
+        // No DNS here, restore must not wait for the resolver
+        if (auto secure = validateLDAPURIs(ldapServerURI(), false))
+        {
+            secureLDAP = *secure;
+        }
+
+        if (!framed)
+        {
+            // Written before the header was added, rewrite it with one.
+            serialize();
+        }
+        return true;
     }
     catch (const cereal::Exception& e)
     {
         lg2::error("Exception: {ERR}", "ERR", e);
-        std::error_code ec;
-        fs::remove(configPersistPath, ec);
+        setAsideCorrupt();
         return false;
     }
     catch (const fs::filesystem_error& e)
@@ -786,6 +1323,19 @@ bool Config::deserialize()
     }
 }
 
+void Config::setAsideCorrupt()
+{
+    // Keep the file for inspection, the config comes up unconfigured.
+    auto corruptPath = configPersistPath;
+    corruptPath += ".corrupt";
+    std::error_code ec;
+    fs::rename(configPersistPath, corruptPath, ec);
+    if (ec)
+    {
+        fs::remove(configPersistPath, ec);
+    }
+}
+
 ObjectPath Config::create(std::string groupName, std::string privilege)
 {
     checkPrivilegeMapper(groupName);
@@ -798,34 +1348,188 @@ ObjectPath Config::create(std::string groupName, std::string privilege)
     mapperObjectPath /= "role_map";
     mapperObjectPath /= std::to_string(entryId);
 
-    fs::path persistPath = parent.dbusPersistentPath;
-    persistPath += mapperObjectPath;
-
     // Create mapping for LDAP privilege mapper entry
     auto entry = std::make_unique<LDAPMapperEntry>(
-        bus, mapperObjectPath.string().c_str(), persistPath.string().c_str(),
-        groupName, privilege, *this);
+        bus, mapperObjectPath.string().c_str(), groupName, privilege, *this);
 
-    phosphor::ldap::serialize(*entry, std::move(persistPath));
+    persistPrivilegeMapper(entryId, groupName, privilege);
 
+    groupIndex.emplace(std::move(groupName), entryId);
     PrivilegeMapperList.emplace(entryId, std::move(entry));
     return mapperObjectPath.string();
 }
 
-void Config::deletePrivilegeMapper(Id id)
+std::vector<ObjectPath> Config::createMany(RoleMappings mappings)
 {
-    fs::path mapperObjectPath = objectPath;
-    mapperObjectPath /= "role_map";
-    mapperObjectPath /= std::to_string(id);
+    checkRoleMappings(mappings);
+    for (const auto& [groupName, privilege] : mappings)
+    {
+        checkPrivilegeMapper(groupName);
+    }
+
+    Mappings next;
+    for (const auto& [id, entry] : PrivilegeMapperList)
+    {
+        next.emplace(id, Mapping{entry->groupName(), entry->privilege()});
+    }
+    Id nextId = entryId;
+    for (auto& [groupName, privilege] : mappings)
+    {
+        next.emplace(++nextId,
+                     Mapping{std::move(groupName), std::move(privilege)});
+    }
+
+    // New ids follow the order of 'mappings'
+    std::vector<ObjectPath> paths;
+    paths.reserve(mappings.size());
+    for (auto& [id, path] : applyRoleMappings(next))
+    {
+        paths.emplace_back(std::move(path));
+    }
+    return paths;
+}
+
+void Config::replaceRoleMappings(RoleMappings mappings)
+{
+    checkRoleMappings(mappings);
+
+    // Groups mapped already keep their entry
+    Mappings next;
+    Id nextId = entryId;
+    for (auto& [groupName, privilege] : mappings)
+    {
+        auto it = groupIndex.find(groupName);
+        next.emplace(it != groupIndex.end() ? it->second : ++nextId,
+                     Mapping{std::move(groupName), std::move(privilege)});
+    }
+    applyRoleMappings(next);
+}
+
+void Config::checkRoleMappings(const RoleMappings& mappings)
+{
+    std::unordered_set<std::string_view> groups;
+    for (const auto& [groupName, privilege] : mappings)
+    {
+        if (groupName.empty())
+        {
+            lg2::error("Group name is empty");
+            elog<InvalidArgument>(Argument::ARGUMENT_NAME("Group name"),
+                                  Argument::ARGUMENT_VALUE("Null"));
+        }
+        checkPrivilegeLevel(privilege);
+        if (!groups.insert(groupName).second)
+        {
+            lg2::error("Group name '{GROUPNAME}' is listed twice", "GROUPNAME",
+                       groupName);
+            elog<PrivilegeMappingExists>();
+        }
+    }
+}
 
-    fs::path persistPath = parent.dbusPersistentPath;
-    persistPath += std::move(mapperObjectPath);
+std::map<Id, ObjectPath> Config::applyRoleMappings(const Mappings& next)
+{
+    // One write for the whole set, nothing changes if it fails
+    try
+    {
+        mapperJournal.replace(next);
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to persist the role mappings: {ERR}", "ERR", e);
+        elog<InternalFailure>();
+    }
 
+    for (auto it = PrivilegeMapperList.begin();
+         it != PrivilegeMapperList.end();)
+    {
+        if (next.contains(it->first))
+        {
+            ++it;
+            continue;
+        }
+        groupIndex.erase(it->second->groupName());
+        it = PrivilegeMapperList.erase(it);
+    }
+
+    std::map<Id, ObjectPath> created;
+    for (const auto& [id, mapping] : next)
+    {
+        auto existing = PrivilegeMapperList.find(id);
+        if (existing != PrivilegeMapperList.end())
+        {
+            // Signals PropertiesChanged only if the privilege differs
+            existing->second->privilege(mapping.privilege, false);
+            continue;
+        }
+
+        auto entryPath = objectPath + '/' + "role_map" + '/' +
+                         std::to_string(id);
+        auto entry = std::make_unique<LDAPMapperEntry>(bus, entryPath.c_str(),
+                                                       *this);
+        entry->privilege(mapping.privilege, true);
+        entry->groupName(mapping.groupName, true);
+        groupIndex.emplace(mapping.groupName, id);
+        PrivilegeMapperList.emplace(id, std::move(entry));
+        created.emplace(id, entryPath);
+        entryId = std::max(entryId, id);
+    }
+
+    // Announce the new entries once all of them are in place
+    for (const auto& [id, path] : created)
+    {
+        PrivilegeMapperList[id]->emit_object_added();
+    }
+    return created;
+}
+
+void Config::deletePrivilegeMapper(Id id)
+{
     // Delete the persistent representation of the privilege mapper.
-    fs::remove(std::move(persistPath));
+    try
+    {
+        mapperJournal.erase(id);
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to delete role mapping {ID}: {ERR}", "ID", id,
+                   "ERR", e);
+        elog<InternalFailure>();
+    }
+
+    auto entry = PrivilegeMapperList.find(id);
+    if (entry != PrivilegeMapperList.end())
+    {
+        groupIndex.erase(entry->second->groupName());
+        PrivilegeMapperList.erase(entry);
+    }
+}
 
-    PrivilegeMapperList.erase(id);
+void Config::renamePrivilegeMapper(Id id, const std::string& oldName,
+                                   const std::string& newName)
+{
+    auto it = groupIndex.find(oldName);
+    if (it != groupIndex.end() && it->second == id)
+    {
+        groupIndex.erase(it);
+        groupIndex.emplace(newName, id);
+    }
+}
+
+void Config::persistPrivilegeMapper(Id id, const std::string& groupName,
+                                    const std::string& privilege)
+{
+    try
+    {
+        mapperJournal.put(id, {groupName, privilege});
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to persist role mapping {ID}: {ERR}", "ID", id,
+                   "ERR", e);
+        elog<InternalFailure>();
+    }
 }
+
 void Config::checkPrivilegeMapper(const std::string& groupName)
 {
     if (groupName.empty())
@@ -835,15 +1539,57 @@ void Config::checkPrivilegeMapper(const std::string& groupName)
                               Argument::ARGUMENT_VALUE("Null"));
     }
 
-    for (const auto& val : PrivilegeMapperList)
+    if (groupIndex.contains(groupName))
+    {
+        lg2::error("Group name '{GROUPNAME}' already exists", "GROUPNAME",
+                   groupName);
+        elog<PrivilegeMappingExists>();
+    }
+}
+
+std::string
+    Config::resolvePrivilege(const std::vector<std::string>& groups) const
+{
+    auto best = privilegeOrder.end();
+    for (const auto& group : groups)
     {
-        if (val.second.get()->groupName() == groupName)
+        auto it = groupIndex.find(group);
+        if (it == groupIndex.end())
         {
-            lg2::error("Group name '{GROUPNAME}' already exists", "GROUPNAME",
-                       groupName);
-            elog<PrivilegeMappingExists>();
+            continue;
+        }
+        auto entry = PrivilegeMapperList.find(it->second);
+        if (entry == PrivilegeMapperList.end())
+        {
+            continue;
+        }
+        best = std::min(best, std::find(privilegeOrder.begin(), best,
+                                        entry->second->privilege()));
+        if (best == privilegeOrder.begin())
+        {
+            break;
         }
     }
+    return best == privilegeOrder.end() ? std::string{} : std::string(*best);
+}
+
+RoleMappings Config::privilegeMappings() const
+{
+    // Follow the order of the entries' object paths, which is the order a
+    // GetManagedObjects client sees them in and thus picks the first match.
+    std::map<std::string, const LDAPMapperEntry*> byPath;
+    for (const auto& [id, entry] : PrivilegeMapperList)
+    {
+        byPath.emplace(std::to_string(id), entry.get());
+    }
+
+    RoleMappings mappings;
+    mappings.reserve(byPath.size());
+    for (const auto& [path, entry] : byPath)
+    {
+        mappings.emplace_back(entry->groupName(), entry->privilege());
+    }
+    return mappings;
 }
 
 void Config::checkPrivilegeLevel(const std::string& privilege)
@@ -863,37 +1609,191 @@ void Config::checkPrivilegeLevel(const std::string& privilege)
     }
 }
 
-void Config::restoreRoleMapping()
+std::vector<std::string> Config::serverURIs() const
 {
-    namespace fs = std::filesystem;
-    fs::path dir = parent.dbusPersistentPath;
-    dir += objectPath;
-    dir /= "role_map";
+    auto configured = splitLDAPURIs(ldapServerURI());
+    if (serverOrder.size() != configured.size() ||
+        !std::is_permutation(serverOrder.begin(), serverOrder.end(),
+                             configured.begin()))
+    {
+        // Never set, or set for a server list changed since
+        return configured;
+    }
+    return serverOrder;
+}
 
-    if (!fs::exists(dir) || fs::is_empty(dir))
+bool Config::orderServers(const std::vector<std::string>& order)
+{
+    auto current = serverURIs();
+    if (order == current || order.size() != current.size() ||
+        !std::is_permutation(order.begin(), order.end(), current.begin()))
     {
-        return;
+        return false;
     }
+    serverOrder = order;
+    return true;
+}
+
+ProbeTarget Config::probeTarget() const
+{
+    ProbeTarget target;
+    auto uris = serverURIs();
+    target.uri = uris.empty() ? ldapServerURI() : uris.front();
+    target.bindDN = ldapBindDN();
+    target.bindPassword = ldapBindPassword;
+    target.baseDN = ldapBaseDN();
+    target.caCert = tlsCacertFile;
+    return target;
+}
 
-    for (auto& file : fs::directory_iterator(dir))
+std::vector<ProbeTarget> Config::probeTargets() const
+{
+    std::vector<ProbeTarget> targets;
+    auto target = probeTarget();
+    for (auto& uri : splitLDAPURIs(ldapServerURI()))
     {
-        std::string id = file.path().filename().c_str();
-        size_t idNum = std::stol(id);
+        target.uri = std::move(uri);
+        targets.push_back(target);
+    }
+    return targets;
+}
+
+GroupSearch Config::groupSearch() const
+{
+    GroupSearch search;
+    for (const auto& uri : serverURIs())
+    {
+        search.uris += (search.uris.empty() ? "" : " ") + uri;
+    }
+    search.bindDN = ldapBindDN();
+    search.bindPassword = ldapBindPassword;
+    search.caCert = tlsCacertFile;
+    search.timeout = std::chrono::seconds(nslcdTuning.timelimit);
+    switch (ldapSearchScope())
+    {
+        case ConfigIface::SearchScope::sub:
+            search.scope = GroupSearch::Scope::Sub;
+            break;
+        case ConfigIface::SearchScope::one:
+            search.scope = GroupSearch::Scope::One;
+            break;
+        case ConfigIface::SearchScope::base:
+            search.scope = GroupSearch::Scope::Base;
+            break;
+    }
+    search.userBase = nss.passwdBase.empty() ? ldapBaseDN() : nss.passwdBase;
+    search.groupBase = nss.groupBase.empty() ? ldapBaseDN() : nss.groupBase;
 
-        auto entryPath = objectPath + '/' + "role_map" + '/' + id;
-        auto persistPath = parent.dbusPersistentPath + entryPath;
-        auto entry = std::make_unique<LDAPMapperEntry>(
-            bus, entryPath.c_str(), persistPath.c_str(), *this);
-        if (phosphor::ldap::deserialize(file.path(), *entry))
+    // The names nslcd reports, see the maps in writeConfig()
+    search.activeDirectory = ldapType() == ConfigIface::Type::ActiveDirectory;
+    search.userNameAttribute = ConfigIface::userNameAttribute();
+    if (search.activeDirectory)
+    {
+        if (search.userNameAttribute.empty())
         {
-            entry->Interfaces::emit_object_added();
-            PrivilegeMapperList.emplace(idNum, std::move(entry));
-            if (idNum > entryId)
+            search.userNameAttribute = "sAMAccountName";
+        }
+        search.domainSid = adDomainSid;
+        search.userFilter = nss.passwdFilter.empty() ? adPasswdFilter
+                                                     : nss.passwdFilter;
+        search.groupFilter = nss.groupFilter.empty() ? adGroupFilter
+                                                     : nss.groupFilter;
+        search.groupNameAttribute = search.userNameAttribute;
+    }
+    else
+    {
+        if (search.userNameAttribute.empty())
+        {
+            search.userNameAttribute = "cn";
+        }
+        search.userFilter = nss.passwdFilter.empty() ? openLdapPasswdFilter
+                                                     : nss.passwdFilter;
+        search.groupFilter = nss.groupFilter.empty() ? openLdapGroupFilter
+                                                     : nss.groupFilter;
+        search.groupNameAttribute = "cn";
+    }
+    return search;
+}
+
+ProbeResult Config::testConnection() const
+{
+    return probe(probeTarget());
+}
+
+void Config::restoreRoleMapping()
+{
+    Mappings mappings;
+    try
+    {
+        mappings = mapperJournal.load();
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to read the role mappings: {ERR}", "ERR", e);
+    }
+
+    // Mappings used to be persisted one file per entry, move them into the
+    // journal. The journal is written before the files are removed, so
+    // entries found in both were migrated already and the journal wins.
+    fs::path legacyDir = parent.dbusPersistentPath;
+    legacyDir += objectPath;
+    legacyDir /= "role_map";
+    if (fs::exists(legacyDir))
+    {
+        for (auto& file : fs::directory_iterator(legacyDir))
+        {
+            std::string id = file.path().filename().c_str();
+            Id idNum = 0;
+            try
             {
-                entryId = idNum;
+                idNum = std::stol(id);
             }
+            catch (const std::logic_error& e)
+            {
+                lg2::error("Ignoring role mapping file {FILE}", "FILE",
+                           file.path());
+                continue;
+            }
+            if (mappings.contains(idNum))
+            {
+                continue;
+            }
+
+            auto entryPath = objectPath + '/' + "role_map" + '/' + id;
+            LDAPMapperEntry entry(bus, entryPath.c_str(), *this);
+            if (phosphor::ldap::deserialize(file.path(), entry))
+            {
+                mappings.emplace(idNum,
+                                 Mapping{entry.groupName(), entry.privilege()});
+            }
+        }
+
+        try
+        {
+            mapperJournal.replace(mappings);
+            fs::remove_all(legacyDir);
+            lg2::info("Migrated {COUNT} role mappings to {FILE}", "COUNT",
+                      mappings.size(), "FILE", journal::fileName);
+        }
+        catch (const std::exception& e)
+        {
+            // Keep the files, the migration is retried on the next start.
+            lg2::error("Failed to migrate the role mappings: {ERR}", "ERR",
+                       e);
         }
     }
+
+    for (const auto& [id, mapping] : mappings)
+    {
+        auto entryPath = objectPath + '/' + "role_map" + '/' +
+                         std::to_string(id);
+        PrivilegeMapperList.emplace(
+            id, std::make_unique<LDAPMapperEntry>(bus, entryPath.c_str(),
+                                                  mapping.groupName,
+                                                  mapping.privilege, *this));
+        groupIndex.emplace(mapping.groupName, id);
+        entryId = std::max(entryId, id);
+    }
 }
 
 } // namespace ldap
@@ -2,7 +2,10 @@
 
 #include "config.h"
 
+#include "ldap_group_resolver.hpp"
 #include "ldap_mapper_entry.hpp"
+#include "ldap_mapper_journal.hpp"
+#include "ldap_probe.hpp"
 
 #include <sdbusplus/bus.hpp>
 #include <sdbusplus/server/object.hpp>
@@ -11,9 +14,14 @@
 #include <xyz/openbmc_project/User/Ldap/Create/server.hpp>
 #include <xyz/openbmc_project/User/PrivilegeMapper/server.hpp>
 
+#include <cstdint>
 #include <filesystem>
+#include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace phosphor
 {
@@ -31,12 +39,130 @@ using MapperIface =
 using Ifaces =
     sdbusplus::server::object_t<ConfigIface, EnableIface, MapperIface>;
 using ObjectPath = sdbusplus::message::object_path;
+/** @brief LDAP group names and the privileges mapped to them */
+using RoleMappings = std::vector<std::pair<std::string, std::string>>;
 
 namespace sdbusRule = sdbusplus::bus::match::rules;
 
 class ConfigMgr;
 class MockConfigMgr;
 
+/** @struct NslcdTuning
+ *  @brief nslcd connection and timeout settings, in seconds unless noted.
+ *  @details The defaults keep a login from stalling long on an LDAP outage
+ *  and the connection pool small, as befits a BMC. They apply to new
+ *  configs only, configs persisted before the settings existed keep
+ *  legacyNslcdTuning() until they are changed explicitly.
+ */
+struct NslcdTuning
+{
+    /** @brief longest wait for a search result */
+    uint32_t timelimit = 10;
+    /** @brief longest wait for a connection and bind */
+    uint32_t bindTimelimit = 5;
+    /** @brief idle time after which a connection is closed, 0 never */
+    uint32_t idleTimelimit = 60;
+    /** @brief wait before the first retry after a failed connection, 0 for
+     *         nslcd's default */
+    uint32_t reconnectSleeptime = 1;
+    /** @brief longest wait between retries while the server is down, 0 for
+     *         nslcd's default */
+    uint32_t reconnectRetrytime = 10;
+    /** @brief number of nslcd threads, i.e. concurrent lookups, 0 for
+     *         nslcd's default */
+    uint32_t threads = 2;
+    /** @brief entries per result page, 0 disables paged results */
+    uint32_t pagesize = 1000;
+
+    bool operator==(const NslcdTuning&) const = default;
+};
+
+/** @brief nslcd settings of configs persisted before they could be set:
+ *         the limits nslcd.conf had hard-coded back then
+ *  @details The settings it didn't render are left at nslcd's defaults.
+ */
+inline NslcdTuning legacyNslcdTuning()
+{
+    NslcdTuning tuning;
+    tuning.timelimit = 30;
+    tuning.bindTimelimit = 30;
+    tuning.idleTimelimit = 0;
+    tuning.reconnectSleeptime = 0;
+    tuning.reconnectRetrytime = 0;
+    tuning.threads = 0;
+    return tuning;
+}
+
+/** @struct NssShaping
+ *  @brief Which NSS lookups nslcd passes on to the LDAP server, and where
+ *         it searches for them.
+ *  @details By default local system accounts are never looked up in LDAP
+ *  and enumerating users or groups, as the user manager does to list the
+ *  local groups, stays local. These defaults apply to new configs only,
+ *  configs persisted before the settings existed keep legacyNssShaping()
+ *  until they are changed explicitly.
+ */
+struct NssShaping
+{
+    /** @brief lowest UID nslcd looks up, 0 for all */
+    uint32_t minUid = 1000;
+    /** @brief leave group members out of group lookups
+     *  @details Cheaper for large groups, but the user manager then can't
+     *  tell the LDAP groups of a user from the group entries.
+     */
+    bool skipMembers = false;
+    /** @brief answer getpwent() and getgrent() from local files only */
+    bool disableEnumeration = true;
+    /** @brief search base of users, empty for the config's base DN */
+    std::string passwdBase;
+    /** @brief search base of groups, empty for the config's base DN */
+    std::string groupBase;
+    /** @brief filter for users, empty for the default of the server type */
+    std::string passwdFilter;
+    /** @brief filter for groups, empty for the default of the server type */
+    std::string groupFilter;
+
+    bool operator==(const NssShaping&) const = default;
+};
+
+/** @brief NSS lookup settings of configs persisted before they could be
+ *         set: every lookup goes to LDAP, as nslcd did back then
+ *  @details Stricter defaults would hide LDAP accounts with a low UID on
+ *  upgrade, such as the Active Directory built-in ones mapped from their
+ *  RID (Administrator is 500). OpenLDAP users were not required to be
+ *  posixAccount entries either.
+ *  @param[in] type - the server type of the config
+ */
+inline NssShaping legacyNssShaping(ConfigIface::Type type)
+{
+    NssShaping shaping;
+    shaping.minUid = 0;
+    shaping.disableEnumeration = false;
+    if (type == ConfigIface::Type::OpenLdap)
+    {
+        shaping.passwdFilter = "(objectclass=*)";
+    }
+    return shaping;
+}
+
+/** @brief Most users a config warms the caches with */
+constexpr size_t maxWarmUpUsers = 64;
+
+/** @struct NscdTtl
+ *  @brief How long nscd caches LDAP answers, in seconds.
+ *  @details nscd keeps initgroups results in its group table, so the group
+ *  TTLs cover them too. The defaults are nscd's own.
+ */
+struct NscdTtl
+{
+    uint32_t passwdPositive = 600;
+    uint32_t passwdNegative = 20;
+    uint32_t groupPositive = 3600;
+    uint32_t groupNegative = 60;
+
+    bool operator==(const NscdTtl&) const = default;
+};
+
 /** @class Config
  *  @brief Configuration for LDAP.
  *  @details concrete implementation of xyz.openbmc_project.User.Ldap.Config
@@ -162,6 +288,65 @@ class Config : public Ifaces
      */
     std::string ldapBindDNPassword(std::string value) override;
 
+    /** @brief Update several properties at once.
+     *  @details All values are validated before any is applied. The changes
+     *  then cost a single nslcd.conf render, persist and restart, and go
+     *  out in one PropertiesChanged signal, so nslcd never sees a mix of
+     *  old and new values.
+     *  @param[in] properties - D-Bus property names and their new values,
+     *             LDAPBindDNPassword included.
+     */
+    void updateConfig(
+        const std::map<std::string, ConfigIface::PropertiesVariant>&
+            properties);
+
+    /** @brief nslcd connection and timeout settings of this config */
+    const NslcdTuning& tuning() const;
+
+    /** @brief Update the nslcd connection and timeout settings.
+     *  @details All settings are validated before any is applied, a value
+     *  out of range throws InvalidArgument naming it.
+     *  @param[in] value - the new settings
+     */
+    void tuning(const NslcdTuning& value);
+
+    /** @brief NSS lookup settings of this config */
+    const NssShaping& nssShaping() const;
+
+    /** @brief Update the NSS lookup settings.
+     *  @details All settings are validated before any is applied, an
+     *  invalid DN or filter throws InvalidArgument naming it.
+     *  @param[in] value - the new settings
+     */
+    void nssShaping(const NssShaping& value);
+
+    /** @brief nscd cache TTLs of this config */
+    const NscdTtl& nscdTtl() const;
+
+    /** @brief Update the nscd cache TTLs.
+     *  @details All TTLs are validated before any is applied, a value out
+     *  of range throws InvalidArgument naming it.
+     *  @param[in] value - the new TTLs
+     */
+    void nscdTtl(const NscdTtl& value);
+
+    /** @brief Set the TTLs of this config in nscd.conf, next to nslcd.conf
+     *  @details Other nscd settings are kept. Nothing is written if nscd
+     *  isn't installed or the TTLs are set already.
+     *  @return true if the file changed and nscd needs a restart.
+     */
+    bool writeNscdConfig();
+
+    /** @brief Users looked up to warm the caches after nslcd restarted */
+    const std::vector<std::string>& warmUpUsers() const;
+
+    /** @brief Update the users to warm the caches with.
+     *  @details Typically the recently active ones, at most
+     *  maxWarmUpUsers. An invalid user name throws InvalidArgument.
+     *  @param[in] users - user names
+     */
+    void warmUpUsers(std::vector<std::string> users);
+
     /** @brief Function required by Cereal to perform deserialization.
      *  @tparam Archive - Cereal archive type (binary in our case).
      *  @param[in] archive - reference to Cereal archive.
@@ -182,9 +367,24 @@ class Config : public Ifaces
 
     /** @brief Serialize and persist this object at the persist
      *         location.
+     *  @details The write is left to ConfigMgr, which delays it a little
+     *  so that several changes in a row are written once.
      */
     void serialize();
 
+    /** @brief Write this object to the persist location now.
+     *  @details The file is replaced atomically and synced, it carries a
+     *  CRC checked by deserialize().
+     *  @throws std::system_error if the file can't be written
+     */
+    void persist();
+
+    /** @brief true if serialize() was called since the last write */
+    bool persistPending() const
+    {
+        return persistDirty;
+    }
+
     /** @brief Deserialize LDAP config data from the persistent location
      *         into this object
      *  @return bool - true if the deserialization was successful, false
@@ -209,6 +409,29 @@ class Config : public Ifaces
      */
     ObjectPath create(std::string groupName, std::string privilege) override;
 
+    /** @brief Creates mappings for several groups at once
+     *  @details All mappings are validated before any is created. They are
+     *  persisted with a single journal write and their objects announced
+     *  once all of them exist.
+     *
+     *  @param[in] mappings - group names and their privileges, none of the
+     *                        groups may be mapped already
+     *
+     *  @return the D-Bus object paths of the created entries, in the order
+     *          of 'mappings'
+     */
+    std::vector<ObjectPath> createMany(RoleMappings mappings);
+
+    /** @brief Replace all privilege mappings of this config
+     *  @details All mappings are validated before any change. Entries of
+     *  groups still listed keep their object, with the privilege updated if
+     *  it differs, the others are deleted and the new groups get entries.
+     *  The result is persisted with a single journal write.
+     *
+     *  @param[in] mappings - group names and their privileges
+     */
+    void replaceRoleMappings(RoleMappings mappings);
+
     /** @brief Delete privilege mapping for LDAP group
      *
      *  This method deletes the privilege mapping
@@ -217,6 +440,15 @@ class Config : public Ifaces
      */
     void deletePrivilegeMapper(Id id);
 
+    /** @brief Persist the state of a privilege mapper entry
+     *
+     *  @param[in] id - id of the privilege mapper entry
+     *  @param[in] groupName - LDAP group name
+     *  @param[in] privilege - the privilege for the group
+     */
+    void persistPrivilegeMapper(Id id, const std::string& groupName,
+                                const std::string& privilege);
+
     /** @brief Check if LDAP group privilege mapping requested is valid
      *
      *  Check if the privilege mapping already exists for the LDAP group name
@@ -228,6 +460,24 @@ class Config : public Ifaces
      */
     void checkPrivilegeMapper(const std::string& groupName);
 
+    /** @brief Update the group name index after an entry got renamed
+     *
+     *  @param[in] id - id of the privilege mapper entry
+     *  @param[in] oldName - previous LDAP group name
+     *  @param[in] newName - new LDAP group name
+     */
+    void renamePrivilegeMapper(Id id, const std::string& oldName,
+                               const std::string& newName);
+
+    /** @brief Resolve the privilege for a set of LDAP groups
+     *
+     *  @param[in] groups - LDAP groups of the user
+     *
+     *  @return the highest privilege mapped to any of the groups, empty if
+     *          none of them has a mapping
+     */
+    std::string resolvePrivilege(const std::vector<std::string>& groups) const;
+
     /** @brief Check if the privilege level is a valid one
      *
      *  @param[in] privilege - Privilege level
@@ -236,13 +486,91 @@ class Config : public Ifaces
      */
     void checkPrivilegeLevel(const std::string& privilege);
 
+    /** @brief List the privilege mappings of this config
+     *
+     *  @return group name and privilege of every mapper entry, in the order
+     *          of their D-Bus object paths
+     */
+    RoleMappings privilegeMappings() const;
+
+    /** @brief number of privilege mapper entries of this config */
+    size_t privilegeMapperCount() const
+    {
+        return PrivilegeMapperList.size();
+    }
+
     /** @brief Construct LDAP mapper entry D-Bus objects from their persisted
      *         representations.
+     *  @details Mappings still persisted one file per entry are moved into
+     *  the journal first.
      */
     void restoreRoleMapping();
 
+    /** @brief The servers in the order nslcd is told to try them
+     *  @details The configured order, unless orderServers() set another.
+     */
+    std::vector<std::string> serverURIs() const;
+
+    /** @brief Set the order of the servers, e.g. by measured latency
+     *  @details The order is not persisted and is dropped when the server
+     *  list changes. The caller requests the config write.
+     *  @param[in] order - the configured URIs, in the new order
+     *  @return true if the order changed
+     */
+    bool orderServers(const std::vector<std::string>& order);
+
+    /** @brief Server and credentials of this config, for probing
+     *  @details The server tried first.
+     */
+    ProbeTarget probeTarget() const;
+
+    /** @brief Every server of this config, in the configured order */
+    std::vector<ProbeTarget> probeTargets() const;
+
+    /** @brief How to look up the groups of a user in this config's
+     *         directory directly, with the names nslcd would report
+     */
+    GroupSearch groupSearch() const;
+
+    /** @brief Probe the LDAP server of this config now
+     *  @details Blocks until the probe is done, each step is bounded by
+     *  probeTimeout.
+     *  @return the outcome and the latency of every step
+     */
+    ProbeResult testConnection() const;
+
+    /** @brief Render the nslcd config file from this config.
+     *  @details The file is only replaced, atomically, if the rendered
+     *  content differs from what is on disk.
+     *  @return true if the file changed and nslcd needs a restart.
+     */
+    virtual bool writeConfig();
+
   private:
+    /** @brief Move an unreadable persist file out of the way */
+    void setAsideCorrupt();
+
+    /** @brief Check group names and privileges of mappings to apply
+     *  @details Throws like checkPrivilegeMapper() and checkPrivilegeLevel(),
+     *  and PrivilegeMappingExists for a group listed twice.
+     */
+    void checkRoleMappings(const RoleMappings& mappings);
+
+    /** @brief Persist the given privilege mappings, then make the mapper
+     *         entries match them
+     *  @param[in] next - all mappings by id, new ones above entryId
+     *  @return the object paths of the new entries, by id
+     */
+    std::map<Id, ObjectPath> applyRoleMappings(const Mappings& next);
+
     bool secureLDAP;
+    /** @brief servers in the order set by orderServers(), empty for the
+     *  configured order */
+    std::vector<std::string> serverOrder;
+    NslcdTuning nslcdTuning;
+    NssShaping nss;
+    NscdTtl cacheTtl;
+    std::vector<std::string> warmUsers;
     std::string ldapBindPassword{};
     std::string tlsCacertFile{};
     std::string tlsCertFile{};
@@ -250,13 +578,12 @@ class Config : public Ifaces
     std::string objectPath{};
     std::filesystem::path configPersistPath{};
 
+    /** @brief changes not persisted yet */
+    bool persistDirty = false;
+
     /** @brief Persistent sdbusplus D-Bus bus connection. */
     sdbusplus::bus_t& bus;
 
-    /** @brief Create a new LDAP config file.
-     */
-    virtual void writeConfig();
-
     /** @brief reference to config manager object */
     ConfigMgr& parent;
 
@@ -266,6 +593,12 @@ class Config : public Ifaces
     /** @brief container to hold privilege mapper objects */
     std::map<Id, std::unique_ptr<LDAPMapperEntry>> PrivilegeMapperList;
 
+    /** @brief privilege mapper entries by LDAP group name */
+    std::unordered_map<std::string, Id> groupIndex;
+
+    /** @brief persistent store of the privilege mapper entries */
+    MapperJournal mapperJournal;
+
     /** @brief available privileges container */
     std::set<std::string> privMgr = {
         "priv-admin",
@@ -273,20 +606,6 @@ class Config : public Ifaces
         "priv-user",
     };
 
-    /** @brief React to InterfaceAdded signal
-     *  @param[in] msg - sdbusplus message
-     */
-    void certificateInstalled(sdbusplus::message_t& msg);
-    sdbusplus::bus::match_t certificateInstalledSignal;
-
-    sdbusplus::bus::match_t cacertificateInstalledSignal;
-
-    /** @brief React to certificate changed signal
-     *  @param[in] msg - sdbusplus message
-     */
-    void certificateChanged(sdbusplus::message_t& msg);
-    sdbusplus::bus::match_t certificateChangedSignal;
-
     friend class MockConfigMgr;
 };
 
@@ -3,14 +3,21 @@
 #include "ldap_config.hpp"
 #include "utils.hpp"
 
+#include <boost/process/child.hpp>
+#include <boost/process/io.hpp>
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
 #include <phosphor-logging/lg2.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
+#include <algorithm>
+#include <cerrno>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <string_view>
+#include <tuple>
+#include <utility>
 
 namespace phosphor
 {
@@ -23,8 +30,8 @@ constexpr auto systemdInterface = "org.freedesktop.systemd1.Manager";
 
 constexpr auto nslcdService = "nslcd.service";
 constexpr auto nscdService = "nscd.service";
-constexpr auto ldapScheme = "ldap";
-constexpr auto ldapsScheme = "ldaps";
+constexpr auto nscdPath = "/usr/sbin/nscd";
+constexpr auto certProperty = "CertificateString";
 
 using namespace phosphor::logging;
 using namespace sdbusplus::xyz::openbmc_project::Common::Error;
@@ -37,73 +44,897 @@ using Key = std::string;
 using Val = std::string;
 using ConfigInfo = std::map<Key, Val>;
 
+ConfigMgr::~ConfigMgr()
+{
+    flushPersist();
+    sd_event_source_disable_unref(persistTimer);
+    sd_event_source_disable_unref(debounceTimer);
+    sd_event_source_disable_unref(rankTimer);
+    sd_event_source_disable_unref(probeDumpTimer);
+    for (auto& [service, job] : serviceJobs)
+    {
+        sd_bus_slot_unref(job.call);
+    }
+}
+
 void ConfigMgr::startOrStopService(const std::string& service, bool start)
 {
     if (start)
     {
-        restartService(service);
+        restartReasons[static_cast<size_t>(RestartReason::PropertySet)] = true;
+    }
+    requestService(service,
+                   start ? ServiceAction::Restart : ServiceAction::Stop);
+}
+
+void ConfigMgr::attachEvent(sd_event* event, std::chrono::microseconds window,
+                            std::chrono::microseconds persistDelay)
+{
+    this->event = event;
+    if (window.count() > 0)
+    {
+        debounceWindow = window;
+        debounceTimer = addTimer(event, onDebounceTimer);
+    }
+    if (persistDelay.count() > 0)
+    {
+        this->persistDelay = persistDelay;
+        persistTimer = addTimer(event, onPersistTimer);
+    }
+}
+
+sd_event_source* ConfigMgr::addTimer(sd_event* event,
+                                     sd_event_time_handler_t handler)
+{
+    sd_event_source* timer = nullptr;
+    // 1ms accuracy, the default of 250ms would stretch the delay
+    int r = sd_event_add_time_relative(event, &timer, CLOCK_MONOTONIC, 0, 1000,
+                                       handler, this);
+    if (r < 0)
+    {
+        lg2::error("Failed to add an LDAP config timer: {ERRNO}", "ERRNO", -r);
+        elog<InternalFailure>();
+    }
+    sd_event_source_set_enabled(timer, SD_EVENT_OFF);
+    return timer;
+}
+
+void ConfigMgr::armTimer(sd_event_source* timer,
+                         std::chrono::microseconds delay)
+{
+    // The delay runs from the first request, later ones don't extend it.
+    int enabled = SD_EVENT_OFF;
+    sd_event_source_get_enabled(timer, &enabled);
+    if (enabled != SD_EVENT_OFF)
+    {
+        return;
+    }
+    sd_event_source_set_time_relative(timer, delay.count());
+    sd_event_source_set_enabled(timer, SD_EVENT_ONESHOT);
+}
+
+void ConfigMgr::requestConfigWrite(bool forceRestart, RestartReason reason)
+{
+    restartReasons[static_cast<size_t>(reason)] = true;
+    configDirty = true;
+    forceNslcdRestart = forceNslcdRestart || forceRestart;
+    schedule();
+}
+
+void ConfigMgr::certificateUpdated()
+{
+    // A disabled config leaves nslcd to the enabled one
+    if (enabledConfig() == nullptr)
+    {
+        return;
+    }
+    // The certificate content isn't part of nslcd.conf, restart anyway
+    requestConfigWrite(true, RestartReason::Certificate);
+    if (debounceTimer != nullptr)
+    {
+        sd_event_source_set_time_relative(debounceTimer,
+                                          debounceWindow.count());
+    }
+}
+
+void ConfigMgr::certificateInstalled(sdbusplus::message_t& msg,
+                                     const char* root)
+{
+    try
+    {
+        sdbusplus::message::object_path path;
+        msg.read(path);
+        // Other objects of the same certificate manager are of no concern
+        if (!path.str.starts_with(std::string(root) + '/'))
+        {
+            return;
+        }
+        certificateUpdated();
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to handle an installed certificate: {ERR}", "ERR",
+                   e);
+    }
+}
+
+void ConfigMgr::certificateChanged(sdbusplus::message_t& msg)
+{
+    try
+    {
+        std::string interface;
+        std::map<std::string, std::variant<std::string>> properties;
+        msg.read(interface, properties);
+        if (properties.contains(certProperty))
+        {
+            certificateUpdated();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to handle a changed certificate: {ERR}", "ERR", e);
+    }
+}
+
+void ConfigMgr::requestService(const std::string& service,
+                               ServiceAction action)
+{
+    queueService(service, action);
+    schedule();
+}
+
+void ConfigMgr::queueService(const std::string& service, ServiceAction action)
+{
+    auto it = std::find_if(
+        pendingServices.begin(), pendingServices.end(),
+        [&service](const auto& pending) { return pending.first == service; });
+    if (it != pendingServices.end())
+    {
+        it->second = action;
     }
     else
     {
-        stopService(service);
+        pendingServices.emplace_back(service, action);
     }
 }
 
-void ConfigMgr::restartService(const std::string& service)
+void ConfigMgr::schedule()
+{
+    if (debounceTimer == nullptr)
+    {
+        applyPending();
+        return;
+    }
+    armTimer(debounceTimer, debounceWindow);
+}
+
+void ConfigMgr::requestPersist(Config& config)
+{
+    if (persistTimer == nullptr)
+    {
+        persist(config);
+        return;
+    }
+    armTimer(persistTimer, persistDelay);
+}
+
+void ConfigMgr::flushPersist()
+{
+    for (Config* config : {openLDAPConfigPtr.get(), ADConfigPtr.get()})
+    {
+        if (config != nullptr && config->persistPending())
+        {
+            persist(*config);
+        }
+    }
+    dumpMetrics();
+}
+
+void ConfigMgr::persist(Config& config)
 {
     try
     {
-        auto method = bus.new_method_call(systemdBusname, systemdObjPath,
-                                          systemdInterface, "RestartUnit");
-        method.append(service.c_str(), "replace");
-        bus.call_noreply(method);
+        ScopedLatency latency(ldapMetrics, Operation::Persist);
+        config.persist();
     }
-    catch (const sdbusplus::exception_t& ex)
+    catch (const std::exception& e)
     {
-        lg2::error("Failed to restart service {SERVICE}: {ERR}", "SERVICE",
-                   service, "ERR", ex);
-        elog<InternalFailure>();
+        // Still pending, retried with the next change or flush.
+        lg2::error("Failed to persist the LDAP config: {ERR}", "ERR", e);
     }
 }
-void ConfigMgr::stopService(const std::string& service)
+
+int ConfigMgr::onPersistTimer(sd_event_source* /*source*/, uint64_t /*usec*/,
+                              void* userData)
+{
+    static_cast<ConfigMgr*>(userData)->flushPersist();
+    return 0;
+}
+
+int ConfigMgr::onDebounceTimer(sd_event_source* /*source*/, uint64_t /*usec*/,
+                               void* userData)
+{
+    try
+    {
+        static_cast<ConfigMgr*>(userData)->applyPending();
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to apply LDAP config changes: {ERR}", "ERR", e);
+    }
+    return 0;
+}
+
+void ConfigMgr::applyPending()
+{
+    // Cached LDAP answers are stale once nslcd talks to another server or
+    // stops, a restart of nscd drops them anyway
+    bool invalidate = false;
+    auto reasons = std::exchange(restartReasons, {});
+    if (std::exchange(configDirty, false))
+    {
+        bool force = std::exchange(forceNslcdRestart, false);
+        Config* config = enabledConfig();
+        if (config != nullptr)
+        {
+            bool changed = writeConfig(*config);
+            if (changed || force)
+            {
+                // Outranks a stop queued before the config got enabled
+                queueService(nslcdService, ServiceAction::Restart);
+            }
+            invalidate = changed;
+            if (config->writeNscdConfig())
+            {
+                // nscd reads its TTLs at startup only
+                queueService(nscdService, ServiceAction::Restart);
+            }
+        }
+    }
+
+    bool nscdRestarted = false;
+    bool coldCache = false;
+    auto services = std::exchange(pendingServices, {});
+    for (const auto& [service, action] : services)
+    {
+        if (!applyService(service, action))
+        {
+            continue;
+        }
+        if (action == ServiceAction::Restart)
+        {
+            if (service == nslcdService)
+            {
+                ldapMetrics.restarted();
+                for (size_t i = 0; i < restartReasonCount; ++i)
+                {
+                    if (reasons[i])
+                    {
+                        ldapMetrics.restarted(static_cast<RestartReason>(i));
+                    }
+                }
+            }
+            nscdRestarted = nscdRestarted || service == nscdService;
+            coldCache = coldCache || service == nscdService ||
+                        service == nslcdService;
+        }
+        else
+        {
+            invalidate = invalidate || service == nslcdService;
+        }
+    }
+    if (invalidate && !nscdRestarted && !invalidationPending)
+    {
+        // Once nslcd is done, or nscd would cache answers of the old one
+        invalidationPending = true;
+        whenServiceReady(nslcdService, [this](const ServiceStatus&) {
+            invalidationPending = false;
+            invalidateNameCache();
+        });
+    }
+    if (coldCache || invalidate)
+    {
+        scheduleWarmUp();
+    }
+    updateProbeTarget();
+    updateRankedServers();
+    updateGroupSearch();
+    dumpMetrics();
+}
+
+bool ConfigMgr::applyService(const std::string& service,
+                             ServiceAction action)
+{
+    try
+    {
+        if (action == ServiceAction::Restart)
+        {
+            restartService(service);
+        }
+        else
+        {
+            stopService(service);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to queue a job for {SERVICE}: {ERR}", "SERVICE",
+                   service, "ERR", e);
+        // callUnitMethod() already marked the job failed
+        if (serviceStatus(service).state != ServiceState::Failed)
+        {
+            jobRequested(service);
+            jobFinished(service, "failed");
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ConfigMgr::writeConfig(Config& config)
+{
+    ScopedLatency latency(ldapMetrics, Operation::WriteConfig);
+    return config.writeConfig();
+}
+
+void ConfigMgr::startMetricsDump(std::string path)
+{
+    metricsFile = std::move(path);
+    dumpMetrics();
+    startProbeDump();
+}
+
+void ConfigMgr::startProbeDump()
+{
+    // The probe statistics change on the prober's thread, so the file is
+    // refreshed as often as the server is probed.
+    if (!prober || event == nullptr || metricsFile.empty() ||
+        probeDumpTimer != nullptr)
+    {
+        return;
+    }
+    probeDumpTimer = addTimer(event, onProbeDumpTimer);
+    armTimer(probeDumpTimer, probeInterval);
+}
+
+int ConfigMgr::onProbeDumpTimer(sd_event_source* /*source*/, uint64_t /*usec*/,
+                                void* userData)
 {
+    auto mgr = static_cast<ConfigMgr*>(userData);
+    mgr->dumpMetrics();
+    armTimer(mgr->probeDumpTimer, mgr->probeInterval);
+    return 0;
+}
+
+std::map<std::string, size_t> ConfigMgr::mapperEntries() const
+{
+    std::map<std::string, size_t> entries;
+    if (ADConfigPtr)
+    {
+        entries.emplace("active_directory",
+                        ADConfigPtr->privilegeMapperCount());
+    }
+    if (openLDAPConfigPtr)
+    {
+        entries.emplace("openldap", openLDAPConfigPtr->privilegeMapperCount());
+    }
+    return entries;
+}
+
+std::string ConfigMgr::metricsText() const
+{
+    auto text = ldapMetrics.text(mapperEntries());
+    if (prober)
+    {
+        text += probeText(prober->stats());
+    }
+    return text;
+}
+
+const sdbusplus::vtable_t ConfigMgr::debugMetricsVtable[] = {
+    sdbusplus::vtable::start(),
+    sdbusplus::vtable::property("NslcdRestarts", "t",
+                                ConfigMgr::getMetricsProperty),
+    sdbusplus::vtable::property("NslcdRestartReasons", "a{st}",
+                                ConfigMgr::getMetricsProperty),
+    sdbusplus::vtable::property("OperationLatency", "a{s(attt)}",
+                                ConfigMgr::getMetricsProperty),
+    sdbusplus::vtable::property("LatencyBuckets", "at",
+                                ConfigMgr::getMetricsProperty,
+                                sdbusplus::vtable::property_::const_),
+    sdbusplus::vtable::property("MapperEntries", "a{st}",
+                                ConfigMgr::getMetricsProperty),
+    sdbusplus::vtable::method("Text", "", "s", ConfigMgr::callMetricsText),
+    sdbusplus::vtable::end()};
+
+int ConfigMgr::getMetricsProperty(sd_bus* /*bus*/, const char* /*path*/,
+                                  const char* /*interface*/,
+                                  const char* property, sd_bus_message* reply,
+                                  void* userData, sd_bus_error* error)
+{
+    auto mgr = static_cast<ConfigMgr*>(userData);
+    const auto& metrics = mgr->ldapMetrics;
+    std::string_view name(property);
+    try
+    {
+        sdbusplus::message_t msg(reply);
+        if (name == "NslcdRestarts")
+        {
+            msg.append(metrics.nslcdRestarts());
+        }
+        else if (name == "NslcdRestartReasons")
+        {
+            std::map<std::string, uint64_t> reasons;
+            for (size_t i = 0; i < restartReasonCount; ++i)
+            {
+                auto reason = static_cast<RestartReason>(i);
+                reasons.emplace(toString(reason), metrics.restarts(reason));
+            }
+            msg.append(reasons);
+        }
+        else if (name == "OperationLatency")
+        {
+            std::map<std::string,
+                     std::tuple<std::vector<uint64_t>, uint64_t, uint64_t>>
+                latencies;
+            for (size_t i = 0; i < operationCount; ++i)
+            {
+                auto operation = static_cast<Operation>(i);
+                const auto& histogram = metrics.latency(operation);
+                latencies.emplace(
+                    toString(operation),
+                    std::make_tuple(
+                        std::vector<uint64_t>(histogram.buckets.begin(),
+                                              histogram.buckets.end()),
+                        histogram.count,
+                        static_cast<uint64_t>(histogram.sum.count())));
+            }
+            msg.append(latencies);
+        }
+        else if (name == "LatencyBuckets")
+        {
+            std::vector<uint64_t> bounds;
+            for (const auto& bound : latencyBuckets)
+            {
+                bounds.push_back(bound.count());
+            }
+            msg.append(bounds);
+        }
+        else if (name == "MapperEntries")
+        {
+            std::map<std::string, uint64_t> entries;
+            for (const auto& [config, count] : mgr->mapperEntries())
+            {
+                entries.emplace(config, count);
+            }
+            msg.append(entries);
+        }
+        else
+        {
+            return sd_bus_error_set_errno(error, ENOENT);
+        }
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        return e.set_error(error);
+    }
+    return 1;
+}
+
+int ConfigMgr::callMetricsText(sd_bus_message* msg, void* userData,
+                               sd_bus_error* error)
+{
+    auto mgr = static_cast<ConfigMgr*>(userData);
+    try
+    {
+        sdbusplus::message_t call(msg);
+        auto reply = call.new_method_return();
+        reply.append(mgr->metricsText());
+        reply.method_return();
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        return e.set_error(error);
+    }
+    return 1;
+}
+
+void ConfigMgr::dumpMetrics()
+{
+    if (metricsFile.empty())
+    {
+        return;
+    }
     try
     {
-        auto method = bus.new_method_call(systemdBusname, systemdObjPath,
-                                          systemdInterface, "StopUnit");
-        method.append(service.c_str(), "replace");
-        bus.call_noreply(method);
+        writeMetricsFile(metricsFile, metricsText());
     }
-    catch (const sdbusplus::exception_t& ex)
+    catch (const std::exception& e)
     {
-        lg2::error("Failed to stop service {SERVICE}: {ERR}", "SERVICE",
-                   service, "ERR", ex);
+        lg2::warning("Failed to write the LDAP metrics to {FILE}: {ERR}",
+                     "FILE", metricsFile, "ERR", e);
+    }
+}
+
+void ConfigMgr::startProbe(std::chrono::milliseconds interval)
+{
+    prober = std::make_unique<Prober>(interval);
+    probeInterval = interval;
+    updateProbeTarget();
+    startProbeDump();
+}
+
+std::optional<ProbeStats> ConfigMgr::probeStats() const
+{
+    if (!prober)
+    {
+        return std::nullopt;
+    }
+    return prober->stats();
+}
+
+void ConfigMgr::updateProbeTarget()
+{
+    if (!prober)
+    {
+        return;
+    }
+    const Config* config = enabledConfig();
+    prober->setTarget(config != nullptr
+                          ? std::optional<ProbeTarget>(config->probeTarget())
+                          : std::nullopt);
+}
+
+void ConfigMgr::startCacheWarmUp(size_t concurrency)
+{
+    warmer = std::make_unique<CacheWarmer>(concurrency);
+}
+
+std::optional<WarmUpStats> ConfigMgr::warmUpStats() const
+{
+    if (!warmer)
+    {
+        return std::nullopt;
+    }
+    return warmer->stats();
+}
+
+void ConfigMgr::scheduleWarmUp()
+{
+    if (!warmer || warmUpPending)
+    {
+        return;
+    }
+    warmUpPending = true;
+    // After the invalidation, which waits for nslcd as well
+    whenServiceReady(nslcdService, [this](const ServiceStatus&) {
+        whenServiceReady(nscdService, [this](const ServiceStatus&) {
+            warmUpPending = false;
+            const Config* config = enabledConfig();
+            if (config == nullptr)
+            {
+                return;
+            }
+            std::vector<std::string> groups;
+            for (const auto& [group, privilege] : config->privilegeMappings())
+            {
+                groups.push_back(group);
+            }
+            warmer->warm(groups, config->warmUpUsers());
+        });
+    });
+}
+
+void ConfigMgr::startGroupResolver(size_t connections)
+{
+    groupResolver = std::make_unique<GroupResolver>(connections);
+    updateGroupSearch();
+}
+
+std::optional<std::vector<std::string>>
+    ConfigMgr::userGroups(const std::string& user, gid_t primaryGid) const
+{
+    if (!groupResolver)
+    {
+        return std::nullopt;
+    }
+    return groupResolver->groupsOf(user, primaryGid);
+}
+
+std::optional<GroupResolverStats> ConfigMgr::groupResolverStats() const
+{
+    if (!groupResolver)
+    {
+        return std::nullopt;
+    }
+    return groupResolver->stats();
+}
+
+void ConfigMgr::updateGroupSearch()
+{
+    if (!groupResolver)
+    {
+        return;
+    }
+    const Config* config = enabledConfig();
+    groupResolver->setSearch(
+        config != nullptr ? std::optional<GroupSearch>(config->groupSearch())
+                          : std::nullopt);
+}
+
+void ConfigMgr::startServerRanking(std::chrono::milliseconds interval)
+{
+    ranker = std::make_unique<ServerRanker>(interval);
+    updateRankedServers();
+    if (event != nullptr)
+    {
+        rankInterval = interval;
+        rankTimer = addTimer(event, onRankTimer);
+        armTimer(rankTimer, rankInterval);
+    }
+}
+
+void ConfigMgr::applyServerOrder()
+{
+    Config* config = enabledConfig();
+    if (!ranker || config == nullptr)
+    {
+        return;
+    }
+    if (config->orderServers(ranker->order()))
+    {
+        requestConfigWrite(false, RestartReason::ServerOrder);
+    }
+}
+
+void ConfigMgr::updateRankedServers()
+{
+    if (!ranker)
+    {
+        return;
+    }
+    const Config* config = enabledConfig();
+    ranker->setServers(config != nullptr ? config->probeTargets()
+                                         : std::vector<ProbeTarget>{});
+}
+
+int ConfigMgr::onRankTimer(sd_event_source* /*source*/, uint64_t /*usec*/,
+                           void* userData)
+{
+    auto mgr = static_cast<ConfigMgr*>(userData);
+    try
+    {
+        mgr->applyServerOrder();
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to apply the LDAP server order: {ERR}", "ERR", e);
+    }
+    armTimer(mgr->rankTimer, mgr->rankInterval);
+    return 0;
+}
+
+void ConfigMgr::invalidateNameCache()
+{
+    for (const char* table : {"passwd", "group"})
+    {
+        try
+        {
+            boost::process::child nscd(
+                nscdPath, "-i", table,
+                boost::process::std_out > boost::process::null,
+                boost::process::std_err > boost::process::null);
+            nscd.wait();
+            if (nscd.exit_code() != 0)
+            {
+                lg2::warning("Failed to invalidate the nscd {TABLE} cache: "
+                             "{RETCODE}",
+                             "TABLE", table, "RETCODE", nscd.exit_code());
+            }
+        }
+        catch (const std::exception& e)
+        {
+            lg2::warning("Failed to invalidate the nscd {TABLE} cache: {ERR}",
+                         "TABLE", table, "ERR", e);
+        }
+    }
+}
+
+void ConfigMgr::startService(const std::string& service)
+{
+    callUnitMethod(service, "StartUnit");
+}
+
+void ConfigMgr::restartService(const std::string& service)
+{
+    callUnitMethod(service, "RestartUnit");
+}
+
+void ConfigMgr::stopService(const std::string& service)
+{
+    callUnitMethod(service, "StopUnit");
+}
+
+void ConfigMgr::callUnitMethod(const std::string& service, const char* method)
+{
+    if (!jobRemovedMatch)
+    {
+        namespace rules = sdbusplus::bus::match::rules;
+        jobRemovedMatch = std::make_unique<sdbusplus::bus::match_t>(
+            bus,
+            rules::type::signal() + rules::member("JobRemoved") +
+                rules::path(systemdObjPath) +
+                rules::interface(systemdInterface),
+            [this](sdbusplus::message_t& msg) {
+                uint32_t id = 0;
+                sdbusplus::message::object_path jobPath;
+                std::string unit;
+                std::string result;
+                msg.read(id, jobPath, unit, result);
+                jobRemoved(jobPath.str, result);
+            });
+        // systemd only emits job signals once a client subscribed
+        sd_bus_call_method_async(bus.get(), nullptr, systemdBusname,
+                                 systemdObjPath, systemdInterface,
+                                 "Subscribe", nullptr, nullptr, "");
+    }
+
+    jobRequested(service);
+    auto& job = serviceJobs.at(service);
+    job.method = method;
+    // A reply still outstanding belongs to a job "replace" supersedes
+    job.call = sd_bus_slot_unref(job.call);
+    int r = sd_bus_call_method_async(
+        bus.get(), &job.call, systemdBusname, systemdObjPath, systemdInterface,
+        method, onUnitMethodReply, &job, "ss", service.c_str(), "replace");
+    if (r < 0)
+    {
+        lg2::error("Failed to call {METHOD} for {SERVICE}: {ERRNO}", "METHOD",
+                   method, "SERVICE", service, "ERRNO", -r);
+        jobFinished(service, "failed");
         elog<InternalFailure>();
     }
 }
 
-std::string ConfigMgr::createConfig(
-    std::string ldapServerURI, std::string ldapBindDN, std::string ldapBaseDN,
-    std::string ldapBindDNPassword, CreateIface::SearchScope ldapSearchScope,
-    CreateIface::Create::Type ldapType, std::string groupNameAttribute,
-    std::string userNameAttribute)
+int ConfigMgr::onUnitMethodReply(sd_bus_message* reply, void* userData,
+                                 sd_bus_error* /*error*/)
 {
-    bool secureLDAP = false;
+    auto& job = *static_cast<ServiceJob*>(userData);
+    job.call = sd_bus_slot_unref(job.call);
 
-    if (isValidLDAPURI(ldapServerURI, ldapsScheme))
+    if (sd_bus_message_is_method_error(reply, nullptr))
     {
-        secureLDAP = true;
+        const sd_bus_error* err = sd_bus_message_get_error(reply);
+        lg2::error("Failed to queue a job for {SERVICE}: {ERR}", "SERVICE",
+                   job.service, "ERR", err->message ? err->message : "");
+        job.mgr->jobFinished(job.service, err->name ? err->name : "failed");
+        return 0;
     }
-    else if (isValidLDAPURI(ldapServerURI, ldapScheme))
+
+    const char* jobPath = nullptr;
+    if (sd_bus_message_read(reply, "o", &jobPath) < 0 || jobPath == nullptr)
     {
-        secureLDAP = false;
+        job.mgr->jobFinished(job.service, "failed");
+        return 0;
     }
-    else
+    job.mgr->jobQueued(job.service, jobPath);
+    return 0;
+}
+
+void ConfigMgr::jobRequested(const std::string& service)
+{
+    auto& job = serviceJobs[service];
+    job.mgr = this;
+    job.service = service;
+    // A request superseding a pending one keeps the original start time,
+    // that's how long the service has been unavailable to clients.
+    if (job.status.state != ServiceState::Pending)
+    {
+        job.requested = std::chrono::steady_clock::now();
+    }
+    job.status.state = ServiceState::Pending;
+    job.jobPath.clear();
+}
+
+void ConfigMgr::jobQueued(const std::string& service,
+                         const std::string& jobPath)
+{
+    auto it = serviceJobs.find(service);
+    if (it != serviceJobs.end())
+    {
+        it->second.jobPath = jobPath;
+    }
+}
+
+void ConfigMgr::jobRemoved(const std::string& jobPath,
+                           const std::string& result)
+{
+    for (auto& [service, job] : serviceJobs)
+    {
+        if (!job.jobPath.empty() && job.jobPath == jobPath)
+        {
+            jobFinished(service, result);
+            return;
+        }
+    }
+}
+
+void ConfigMgr::jobFinished(const std::string& service,
+                            const std::string& result)
+{
+    auto it = serviceJobs.find(service);
+    if (it == serviceJobs.end())
+    {
+        return;
+    }
+    auto& job = it->second;
+    job.jobPath.clear();
+    job.status.state = result == "done" ? ServiceState::Ready
+                                        : ServiceState::Failed;
+    job.status.result = result;
+    job.status.duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - job.requested);
+    lg2::info("Job for {SERVICE} finished: {RESULT} after {DURATION}us",
+              "SERVICE", service, "RESULT", result, "DURATION",
+              job.status.duration.count());
+    if (service == nslcdService && job.method == "RestartUnit")
+    {
+        ldapMetrics.observe(Operation::NslcdRestart, job.status.duration);
+    }
+
+    auto waiters = std::exchange(job.waiters, {});
+    for (const auto& waiter : waiters)
+    {
+        try
+        {
+            waiter(job.status);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Service ready callback failed: {ERR}", "ERR", e);
+        }
+    }
+    dumpMetrics();
+}
+
+ServiceStatus ConfigMgr::serviceStatus(const std::string& service) const
+{
+    auto it = serviceJobs.find(service);
+    if (it == serviceJobs.end())
+    {
+        return {};
+    }
+    return it->second.status;
+}
+
+void ConfigMgr::whenServiceReady(const std::string& service,
+                                 ServiceReadyCallback callback)
+{
+    auto it = serviceJobs.find(service);
+    if (it == serviceJobs.end() ||
+        it->second.status.state != ServiceState::Pending)
+    {
+        callback(serviceStatus(service));
+        return;
+    }
+    it->second.waiters.emplace_back(std::move(callback));
+}
+
+std::string ConfigMgr::createConfig(
+    std::string ldapServerURI, std::string ldapBindDN, std::string ldapBaseDN,
+    std::string ldapBindDNPassword, CreateIface::SearchScope ldapSearchScope,
+    CreateIface::Create::Type ldapType, std::string groupNameAttribute,
+    std::string userNameAttribute)
+{
+    auto secure = validateLDAPURIs(ldapServerURI);
+    if (!secure)
     {
         lg2::error("Bad LDAP Server URI {URI}", "URI", ldapServerURI);
         elog<InvalidArgument>(Argument::ARGUMENT_NAME("ldapServerURI"),
                               Argument::ARGUMENT_VALUE(ldapServerURI.c_str()));
     }
+    bool secureLDAP = *secure;
 
     if (secureLDAP && !fs::exists(tlsCacertFile.c_str()))
     {
@@ -159,7 +990,6 @@ std::string ConfigMgr::createConfig(
             static_cast<ConfigIface::Type>(ldapType), false, groupNameAttribute,
             userNameAttribute, *this);
     }
-    restartService(nscdService);
     return objPath;
 }
 
@@ -201,6 +1031,24 @@ bool ConfigMgr::enableService(Config& config, bool value)
     return config.enableService(value);
 }
 
+const Config* ConfigMgr::enabledConfig() const
+{
+    return const_cast<ConfigMgr*>(this)->enabledConfig();
+}
+
+Config* ConfigMgr::enabledConfig()
+{
+    if (openLDAPConfigPtr && openLDAPConfigPtr->enabled())
+    {
+        return openLDAPConfigPtr.get();
+    }
+    if (ADConfigPtr && ADConfigPtr->enabled())
+    {
+        return ADConfigPtr.get();
+    }
+    return nullptr;
+}
+
 void ConfigMgr::restore()
 {
     createDefaultObjects();
@@ -208,18 +1056,57 @@ void ConfigMgr::restore()
     if (ADConfigPtr->deserialize())
     {
         // Restore the role mappings
-        ADConfigPtr->restoreRoleMapping();
+        {
+            ScopedLatency latency(ldapMetrics, Operation::RestoreRoleMapping);
+            ADConfigPtr->restoreRoleMapping();
+        }
         ADConfigPtr->emit_object_added();
+        for (const auto& uri : splitLDAPURIs(ADConfigPtr->ldapServerURI()))
+        {
+            revalidateLDAPURI(uri);
+        }
     }
     if (openLDAPConfigPtr->deserialize())
     {
         // Restore the role mappings
-        openLDAPConfigPtr->restoreRoleMapping();
+        {
+            ScopedLatency latency(ldapMetrics, Operation::RestoreRoleMapping);
+            openLDAPConfigPtr->restoreRoleMapping();
+        }
         openLDAPConfigPtr->emit_object_added();
+        for (const auto& uri :
+             splitLDAPURIs(openLDAPConfigPtr->ldapServerURI()))
+        {
+            revalidateLDAPURI(uri);
+        }
+    }
+
+    Config* config = nullptr;
+    if (openLDAPConfigPtr->enabled())
+    {
+        config = openLDAPConfigPtr.get();
+    }
+    else if (ADConfigPtr->enabled())
+    {
+        config = ADConfigPtr.get();
     }
 
-    startOrStopService(phosphor::ldap::nslcdService,
-                       ADConfigPtr->enabled() || openLDAPConfigPtr->enabled());
+    if (config == nullptr)
+    {
+        stopService(phosphor::ldap::nslcdService);
+    }
+    // nslcd already running on an unchanged config keeps its connections
+    else if (writeConfig(*config))
+    {
+        restartService(phosphor::ldap::nslcdService);
+        ldapMetrics.restarted();
+        ldapMetrics.restarted(RestartReason::Startup);
+    }
+    else
+    {
+        startService(phosphor::ldap::nslcdService);
+    }
+    dumpMetrics();
 }
 
 } // namespace ldap
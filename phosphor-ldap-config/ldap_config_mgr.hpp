@@ -2,13 +2,30 @@
 
 #include "config.h"
 
+#include "ldap_cache_warmer.hpp"
 #include "ldap_config.hpp"
+#include "ldap_metrics.hpp"
+#include "ldap_probe.hpp"
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
 
 #include <sdbusplus/bus.hpp>
+#include <sdbusplus/bus/match.hpp>
+#include <sdbusplus/server/interface.hpp>
+#include <sdbusplus/vtable.hpp>
 #include <xyz/openbmc_project/User/Ldap/Config/server.hpp>
 #include <xyz/openbmc_project/User/Ldap/Create/server.hpp>
 
+#include <array>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace phosphor
 {
@@ -17,6 +34,28 @@ namespace ldap
 
 static constexpr auto defaultNslcdFile = "nslcd.conf.default";
 static constexpr auto nsSwitchFile = "nsswitch.conf";
+static constexpr auto nscdConfFile = "nscd.conf";
+// Certificates nslcd is configured with, see Config::writeConfig()
+static constexpr auto certObjPath = "/xyz/openbmc_project/certs/client/ldap/1";
+static constexpr auto certRootPath = "/xyz/openbmc_project/certs/client/ldap";
+static constexpr auto authObjPath =
+    "/xyz/openbmc_project/certs/authority/truststore";
+static constexpr auto certIface = "xyz.openbmc_project.Certs.Certificate";
+/** @brief Debug interface on the root path exposing metrics(), not part of
+ *         phosphor-dbus-interfaces
+ *  @details Properties, read when asked:
+ *  - NslcdRestarts (t): nslcd restarts
+ *  - NslcdRestartReasons (a{st}): restarts by reason
+ *  - OperationLatency (a{s(attt)}): per operation the samples per latency
+ *    bucket, not cumulative, the sample count and the sum in microseconds
+ *  - LatencyBuckets (at): upper bounds of the buckets in microseconds, the
+ *    last bucket takes everything above
+ *  - MapperEntries (a{st}): privilege mapper entries by config
+ *
+ *  The Text method returns metricsText().
+ */
+static constexpr auto debugMetricsIface =
+    "xyz.openbmc_project.User.Ldap.Debug.Metrics";
 static auto openLDAPDbusObjectPath = std::string(LDAP_CONFIG_ROOT) +
                                      "/openldap";
 static auto adDbusObjectPath = std::string(LDAP_CONFIG_ROOT) +
@@ -25,6 +64,29 @@ static auto adDbusObjectPath = std::string(LDAP_CONFIG_ROOT) +
 using CreateIface = sdbusplus::server::object_t<
     sdbusplus::xyz::openbmc_project::User::Ldap::server::Create>;
 
+/** @brief State of a systemd unit controlled by ConfigMgr */
+enum class ServiceState
+{
+    /** @brief no job pending, the last one completed */
+    Ready,
+    /** @brief a start, restart or stop job is queued or running */
+    Pending,
+    /** @brief the last job failed or couldn't be queued */
+    Failed,
+};
+
+struct ServiceStatus
+{
+    ServiceState state = ServiceState::Ready;
+    /** @brief systemd result of the last job ("done", "failed", ...), or
+     *         the D-Bus error if it couldn't be queued */
+    std::string result;
+    /** @brief time from the request to the end of the last job */
+    std::chrono::microseconds duration{0};
+};
+
+using ServiceReadyCallback = std::function<void(const ServiceStatus&)>;
+
 // class Config;
 /** @class ConfigMgr
  *  @brief Creates LDAP server configuration.
@@ -35,7 +97,7 @@ class ConfigMgr : public CreateIface
 {
   public:
     ConfigMgr() = delete;
-    ~ConfigMgr() = default;
+    ~ConfigMgr();
     ConfigMgr(const ConfigMgr&) = delete;
     ConfigMgr& operator=(const ConfigMgr&) = delete;
     ConfigMgr(ConfigMgr&&) = delete;
@@ -53,7 +115,23 @@ class ConfigMgr : public CreateIface
               const char* certFile) :
         CreateIface(bus, path, CreateIface::action::defer_emit),
         dbusPersistentPath(dbusPersistentPath), configFilePath(filePath),
-        tlsCacertFile(caCertFile), tlsCertFile(certFile), bus(bus)
+        tlsCacertFile(caCertFile), tlsCertFile(certFile), bus(bus),
+        certificateInstalledSignal(
+            bus, sdbusplus::bus::match::rules::interfacesAdded(certRootPath),
+            [this](sdbusplus::message_t& msg) {
+                certificateInstalled(msg, certRootPath);
+            }),
+        caCertificateInstalledSignal(
+            bus, sdbusplus::bus::match::rules::interfacesAdded(authObjPath),
+            [this](sdbusplus::message_t& msg) {
+                certificateInstalled(msg, authObjPath);
+            }),
+        certificateChangedSignal(
+            bus,
+            sdbusplus::bus::match::rules::propertiesChanged(certObjPath,
+                                                            certIface),
+            [this](sdbusplus::message_t& msg) { certificateChanged(msg); }),
+        debugMetrics(bus, path, debugMetricsIface, debugMetricsVtable, this)
     {}
 
     /** @brief concrete implementation of the pure virtual funtion
@@ -80,6 +158,13 @@ class ConfigMgr : public CreateIface
                              std::string groupNameAttribute,
                              std::string userNameAttribute) override;
 
+    /** @brief starts given service, a no-op if it is already running
+     *  @details Like restartService() and stopService() this only queues
+     *  the systemd job, serviceStatus() tells when it is done.
+     *  @param[in] service - Service to be started.
+     */
+    virtual void startService(const std::string& service);
+
     /** @brief restarts given service
      *  @param[in] service - Service to be restarted.
      */
@@ -90,6 +175,26 @@ class ConfigMgr : public CreateIface
      */
     virtual void stopService(const std::string& service);
 
+    /** @brief Drop nscd's cached passwd and group entries, like nscd -i
+     *  @details Hosts and other tables stay cached. Failures are only
+     *  logged, the entries then expire with their TTL.
+     */
+    virtual void invalidateNameCache();
+
+    /** @brief Get the state of the last job queued for a service
+     *  @param[in] service - Service to look up.
+     *  @returns the status, Ready for services never touched
+     */
+    ServiceStatus serviceStatus(const std::string& service) const;
+
+    /** @brief Call back once no job is pending for a service any more
+     *  @details Called right away if none is pending.
+     *  @param[in] service - Service to wait for.
+     *  @param[in] callback - called with the status the job ended with
+     */
+    void whenServiceReady(const std::string& service,
+                          ServiceReadyCallback callback);
+
     /** @brief start or stop the service depending on the given value
      *  @param[in] service - Service to be start/stop.
      *  @param[in] value - true to start the service otherwise stop.
@@ -105,6 +210,127 @@ class ConfigMgr : public CreateIface
      */
     bool enableService(Config& config, bool value);
 
+    /** @brief Get the LDAP config which is currently enabled
+     *  @returns the enabled config, or nullptr if LDAP is disabled
+     */
+    const Config* enabledConfig() const;
+    Config* enabledConfig();
+
+    /** @brief Coalesce config writes and service restarts on an event loop
+     *  @details Requests are collected for 'window' after the first one and
+     *  then applied together, so a client setting several properties in a
+     *  row causes a single nslcd restart. Without an event loop, or with an
+     *  empty window, every request is applied right away. Likewise changed
+     *  config objects are persisted 'persistDelay' after the first change.
+     *  @param[in] event - event loop to run the timers on
+     *  @param[in] window - how long to collect requests for
+     *  @param[in] persistDelay - how long to delay persisting changes for
+     */
+    void attachEvent(sd_event* event, std::chrono::microseconds window,
+                     std::chrono::microseconds persistDelay =
+                         std::chrono::microseconds(0));
+
+    /** @brief Request nslcd.conf to be rendered from the enabled config
+     *  nslcd is restarted if the file changed.
+     *  @param[in] forceRestart - restart nslcd even if the file is unchanged
+     *  @param[in] reason - what a restart would be for, see metrics()
+     */
+    void requestConfigWrite(bool forceRestart = false,
+                            RestartReason reason = RestartReason::PropertySet);
+
+    /** @brief Apply the pending config write and service requests now */
+    void applyPending();
+
+    /** @brief Request a changed config object to be persisted
+     *  @param[in] config - the config, may still be under construction
+     */
+    void requestPersist(Config& config);
+
+    /** @brief Persist the config objects with changes now
+     *  @details Call before exiting, pending changes are lost otherwise.
+     */
+    void flushPersist();
+
+    /** @brief Probe the LDAP server of the enabled config periodically
+     *  @details The probe runs on a thread of its own and follows config
+     *  changes; nothing is probed while LDAP is disabled.
+     *  @param[in] interval - time between two probes
+     */
+    void startProbe(std::chrono::milliseconds interval);
+
+    /** @brief Statistics of the periodic probe
+     *  @returns the statistics, std::nullopt if the probe isn't running
+     */
+    std::optional<ProbeStats> probeStats() const;
+
+    /** @brief Warm the name caches after nslcd or nscd restarted
+     *  @details Once the restart is done the groups of the enabled config's
+     *  privilege mappings and its warm-up users are looked up in the
+     *  background, see CacheWarmer.
+     *  @param[in] concurrency - most lookups at a time
+     */
+    void startCacheWarmUp(size_t concurrency);
+
+    /** @brief Statistics of the cache warm-up
+     *  @returns the statistics, std::nullopt if warm-up isn't enabled
+     */
+    std::optional<WarmUpStats> warmUpStats() const;
+
+    /** @brief Look up the groups of LDAP users with the enabled config's
+     *         settings directly, see userGroups()
+     *  @param[in] connections - most idle connections kept to the server
+     */
+    void startGroupResolver(size_t connections);
+
+    /** @brief Groups of an LDAP user, from a single search of the directory
+     *  @param[in] user - the user name
+     *  @param[in] primaryGid - gid of the user's primary group
+     *  @returns the group names, std::nullopt if the resolver isn't started,
+     *           no config is enabled or the server could not answer; NSS is
+     *           the fallback then
+     */
+    std::optional<std::vector<std::string>>
+        userGroups(const std::string& user, gid_t primaryGid) const;
+
+    /** @brief Statistics of the group resolver
+     *  @returns the statistics, std::nullopt if it isn't started
+     */
+    std::optional<GroupResolverStats> groupResolverStats() const;
+
+    /** @brief Rank the servers of the enabled config by latency periodically
+     *  @details The servers are measured on a thread of their own. With an
+     *  event loop attached the nslcd config is rewritten in the measured
+     *  order every 'interval' when it changed, see applyServerOrder().
+     *  @param[in] interval - time between two rounds of measurements
+     */
+    void startServerRanking(std::chrono::milliseconds interval);
+
+    /** @brief Write the metrics to a file whenever they change
+     *  @details In the Prometheus text format, see metricsText(). The file
+     *  is refreshed after changes are applied, configs persisted and
+     *  service jobs done, and every probe interval while the probe runs.
+     *  @param[in] path - the file, typically under /run
+     */
+    void startMetricsDump(std::string path);
+
+    /** @brief nslcd restarts and operation latencies so far
+     *  @details Also published on D-Bus, see debugMetricsIface.
+     */
+    const Metrics& metrics() const
+    {
+        return ldapMetrics;
+    }
+
+    /** @brief The metrics with the privilege mapper entries of each config
+     *         and the probe statistics, in the Prometheus text format
+     */
+    std::string metricsText() const;
+
+    /** @brief Order the servers of the enabled config as last ranked
+     *  @details Requests a config write if the order changed.
+     */
+    void applyServerOrder();
+
     /* ldap service enabled property would be saved under
      * this path.
      */
@@ -133,6 +359,196 @@ class ConfigMgr : public CreateIface
     /* Create the default active directory and the openldap config
      * objects. */
     virtual void createDefaultObjects();
+
+    /** @brief Mark a job for a service as requested */
+    void jobRequested(const std::string& service);
+
+    /** @brief Record the systemd job object a request was queued as */
+    void jobQueued(const std::string& service, const std::string& jobPath);
+
+    /** @brief Handle systemd's JobRemoved for a job object */
+    void jobRemoved(const std::string& jobPath, const std::string& result);
+
+    /** @brief End the pending job of a service and notify the waiters */
+    void jobFinished(const std::string& service, const std::string& result);
+
+    /** @brief Reload the certificates of the enabled config
+     *  @details The certificate manager replaces a certificate in several
+     *  steps, each with a signal. Every one pushes the render and nslcd
+     *  restart out by the debounce window again, so a burst ends in one.
+     */
+    void certificateUpdated();
+
+    /** @brief sd-bus getter of the debugMetricsIface properties */
+    static int getMetricsProperty(sd_bus* bus, const char* path,
+                                  const char* interface, const char* property,
+                                  sd_bus_message* reply, void* userData,
+                                  sd_bus_error* error);
+
+  private:
+    struct ServiceJob
+    {
+        ConfigMgr* mgr = nullptr;
+        std::string service;
+        ServiceStatus status;
+        /** @brief systemd job object of the pending job, once queued */
+        std::string jobPath;
+        /** @brief outstanding method call queueing the job */
+        sd_bus_slot* call = nullptr;
+        /** @brief systemd method the job was queued with */
+        std::string method;
+        std::chrono::steady_clock::time_point requested;
+        std::vector<ServiceReadyCallback> waiters;
+    };
+
+    /** @brief Point the periodic probe at the enabled config */
+    void updateProbeTarget();
+
+    /** @brief periodic probe, if started */
+    std::unique_ptr<Prober> prober;
+    std::chrono::milliseconds probeInterval{0};
+
+    /** @brief Refresh the metrics file every probe interval, once both the
+     *  probe and the metrics dump are started on an event loop
+     */
+    void startProbeDump();
+
+    static int onProbeDumpTimer(sd_event_source* source, uint64_t usec,
+                                void* userData);
+
+    /** @brief periodic timer refreshing the probe statistics in the file */
+    sd_event_source* probeDumpTimer = nullptr;
+
+    /** @brief Warm the caches once nslcd and nscd are done restarting */
+    void scheduleWarmUp();
+
+    /** @brief cache warm-up, if started */
+    std::unique_ptr<CacheWarmer> warmer;
+
+    /** @brief a warm-up waits for nslcd or nscd */
+    bool warmUpPending = false;
+
+    /** @brief Point the group resolver at the enabled config */
+    void updateGroupSearch();
+
+    /** @brief direct group lookup, if started */
+    std::unique_ptr<GroupResolver> groupResolver;
+
+    /** @brief Point the server ranking at the enabled config */
+    void updateRankedServers();
+
+    static int onRankTimer(sd_event_source* source, uint64_t usec,
+                           void* userData);
+
+    /** @brief server ranking, if started */
+    std::unique_ptr<ServerRanker> ranker;
+
+    /** @brief periodic timer applying the server ranking */
+    sd_event_source* rankTimer = nullptr;
+    std::chrono::microseconds rankInterval{0};
+
+    /** @brief Queue a systemd unit job without waiting for the reply */
+    void callUnitMethod(const std::string& service, const char* method);
+
+    static int onUnitMethodReply(sd_bus_message* reply, void* userData,
+                                 sd_bus_error* error);
+
+    /** @brief per service job tracking, nodes stay put for the callbacks */
+    std::map<std::string, ServiceJob> serviceJobs;
+
+    /** @brief match for systemd's JobRemoved, added on first use */
+    std::unique_ptr<sdbusplus::bus::match_t> jobRemovedMatch;
+
+    enum class ServiceAction
+    {
+        Restart,
+        Stop,
+    };
+
+    /** @brief Queue a service action and schedule it */
+    void requestService(const std::string& service, ServiceAction action);
+
+    /** @brief Queue a service action, the last request per service wins */
+    void queueService(const std::string& service, ServiceAction action);
+
+    /** @brief Queue the systemd job of a pending service action
+     *  @details A failure is logged and the job marked failed instead of
+     *  thrown, so the other pending actions still get applied.
+     *  @returns whether the job got queued
+     */
+    bool applyService(const std::string& service, ServiceAction action);
+
+    /** @brief Apply the pending requests now or arm the debounce timer */
+    void schedule();
+
+    static int onDebounceTimer(sd_event_source* source, uint64_t usec,
+                               void* userData);
+
+    /** @brief Persist a config object, failures are only logged */
+    void persist(Config& config);
+
+    static int onPersistTimer(sd_event_source* source, uint64_t usec,
+                              void* userData);
+
+    /** @brief Add a disabled one shot timer to the event loop */
+    sd_event_source* addTimer(sd_event* event,
+                              sd_event_time_handler_t handler);
+
+    /** @brief Arm a timer unless it is armed already */
+    static void armTimer(sd_event_source* timer,
+                         std::chrono::microseconds delay);
+
+    /** @brief the event loop attached, if any */
+    sd_event* event = nullptr;
+
+    /** @brief one shot timer applying the pending requests */
+    sd_event_source* debounceTimer = nullptr;
+    std::chrono::microseconds debounceWindow{0};
+
+    /** @brief one shot timer persisting the changed config objects */
+    sd_event_source* persistTimer = nullptr;
+    std::chrono::microseconds persistDelay{0};
+
+    bool configDirty = false;
+    bool forceNslcdRestart = false;
+    /** @brief a name cache invalidation waits for nslcd */
+    bool invalidationPending = false;
+    /** @brief pending service actions, in the order first requested */
+    std::vector<std::pair<std::string, ServiceAction>> pendingServices;
+
+    /** @brief Render nslcd.conf from a config, timed */
+    bool writeConfig(Config& config);
+
+    /** @brief Refresh the metrics file, if any */
+    void dumpMetrics();
+
+    /** @brief privilege mapper entries by config, for the metrics */
+    std::map<std::string, size_t> mapperEntries() const;
+
+    /** @brief sd-bus handler of the debugMetricsIface Text method */
+    static int callMetricsText(sd_bus_message* msg, void* userData,
+                               sd_bus_error* error);
+
+    static const sdbusplus::vtable_t debugMetricsVtable[];
+
+    Metrics ldapMetrics;
+    /** @brief what the pending requests would restart nslcd for */
+    std::array<bool, restartReasonCount> restartReasons{};
+    /** @brief file the metrics are dumped to, none if empty */
+    std::string metricsFile;
+
+    /** @brief React to a certificate object added under 'root' */
+    void certificateInstalled(sdbusplus::message_t& msg, const char* root);
+
+    /** @brief React to the LDAP client certificate being replaced */
+    void certificateChanged(sdbusplus::message_t& msg);
+
+    sdbusplus::bus::match_t certificateInstalledSignal;
+    sdbusplus::bus::match_t caCertificateInstalledSignal;
+    sdbusplus::bus::match_t certificateChangedSignal;
+
+    /** @brief the debugMetricsIface on the root path */
+    sdbusplus::server::interface_t debugMetrics;
 };
 } // namespace ldap
 } // namespace phosphor
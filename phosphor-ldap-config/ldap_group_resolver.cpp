@@ -0,0 +1,389 @@
+#include "ldap_group_resolver.hpp"
+
+#include "utils.hpp"
+
+#include <ldap.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <string_view>
+#include <utility>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace
+{
+
+/** @brief escaped binary form of the SID '<domainSid>-<rid>', as objectSid
+ *         is compared, std::nullopt if 'domainSid' is not a SID
+ */
+std::optional<std::string> sidFilterValue(const std::string& domainSid,
+                                          uint32_t rid)
+{
+    // S-<revision>-<authority>-<subauthority>...
+    if (!domainSid.starts_with("S-"))
+    {
+        return std::nullopt;
+    }
+    std::vector<uint64_t> fields;
+    size_t start = 2;
+    while (start <= domainSid.size())
+    {
+        auto end = domainSid.find('-', start);
+        auto field = domainSid.substr(start, end - start);
+        if (field.empty() ||
+            field.find_first_not_of("0123456789") != std::string::npos ||
+            field.size() > 10)
+        {
+            return std::nullopt;
+        }
+        fields.push_back(std::strtoull(field.c_str(), nullptr, 10));
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+    if (fields.size() < 2 || fields.size() > 15)
+    {
+        return std::nullopt;
+    }
+
+    std::string value;
+    auto append = [&value](uint8_t byte) {
+        static constexpr char hex[] = "0123456789abcdef";
+        value += '\\';
+        value += hex[byte >> 4];
+        value += hex[byte & 0xf];
+    };
+    append(static_cast<uint8_t>(fields[0]));
+    append(static_cast<uint8_t>(fields.size() - 2 + 1));
+    // 48 bit big endian authority, 32 bit little endian subauthorities
+    for (int shift = 40; shift >= 0; shift -= 8)
+    {
+        append(static_cast<uint8_t>(fields[1] >> shift));
+    }
+    fields.push_back(rid);
+    for (size_t i = 2; i < fields.size(); ++i)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            append(static_cast<uint8_t>(fields[i] >> shift));
+        }
+    }
+    return value;
+}
+
+int toLdapScope(GroupSearch::Scope scope)
+{
+    switch (scope)
+    {
+        case GroupSearch::Scope::Base:
+            return LDAP_SCOPE_BASE;
+        case GroupSearch::Scope::One:
+            return LDAP_SCOPE_ONELEVEL;
+        case GroupSearch::Scope::Sub:
+            return LDAP_SCOPE_SUBTREE;
+    }
+    return LDAP_SCOPE_SUBTREE;
+}
+
+timeval toTimeval(std::chrono::milliseconds timeout)
+{
+    return {static_cast<time_t>(timeout.count() / 1000),
+            static_cast<suseconds_t>((timeout.count() % 1000) * 1000)};
+}
+
+/** @brief the server is gone, a new connection may do better */
+bool connectionLost(int r)
+{
+    return r == LDAP_SERVER_DOWN || r == LDAP_CONNECT_ERROR ||
+           r == LDAP_UNAVAILABLE || r == LDAP_BUSY;
+}
+
+} // namespace
+
+std::string groupMembershipFilter(const GroupSearch& search,
+                                  const std::string& user,
+                                  const std::string& userDN,
+                                  gid_t primaryGid)
+{
+    std::string members;
+    if (search.activeDirectory)
+    {
+        members = "(member:" + std::string(matchingRuleInChain) +
+                  ":=" + escapeLDAPFilterValue(userDN) + ")";
+        if (auto sid = sidFilterValue(search.domainSid, primaryGid))
+        {
+            members = "(|" + members + "(objectSid=" + *sid + "))";
+        }
+    }
+    else
+    {
+        members = "(|(memberUid=" + escapeLDAPFilterValue(user) +
+                  ")(gidNumber=" + std::to_string(primaryGid) + "))";
+    }
+    return "(&" + search.groupFilter + members + ")";
+}
+
+struct GroupResolver::Connection
+{
+    explicit Connection(uint64_t generation) : generation(generation) {}
+
+    ~Connection()
+    {
+        if (ld != nullptr)
+        {
+            ldap_unbind_ext_s(ld, nullptr, nullptr);
+        }
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    /** @brief search, collecting the first value of 'attribute' of every
+     *         entry, or the entry DNs if it is empty
+     *  @returns the LDAP result code
+     */
+    int search(const std::string& base, int scope, const std::string& filter,
+               const std::string& attribute, std::chrono::milliseconds timeout,
+               int sizeLimit, std::vector<std::string>& values)
+    {
+        char noAttributes[] = "1.1";
+        std::string name = attribute;
+        char* attributes[] = {attribute.empty() ? noAttributes : name.data(),
+                              nullptr};
+        auto tv = toTimeval(timeout);
+        LDAPMessage* message = nullptr;
+        int r = ldap_search_ext_s(ld, base.c_str(), scope, filter.c_str(),
+                                  attributes, 0, nullptr, nullptr, &tv,
+                                  sizeLimit, &message);
+        std::unique_ptr<LDAPMessage, decltype(&ldap_msgfree)> guard(
+            message, ldap_msgfree);
+        if (r != LDAP_SUCCESS)
+        {
+            return r;
+        }
+        for (auto entry = ldap_first_entry(ld, message); entry != nullptr;
+             entry = ldap_next_entry(ld, entry))
+        {
+            if (attribute.empty())
+            {
+                char* dn = ldap_get_dn(ld, entry);
+                if (dn != nullptr)
+                {
+                    values.emplace_back(dn);
+                    ldap_memfree(dn);
+                }
+                continue;
+            }
+            berval** found = ldap_get_values_len(ld, entry, attribute.c_str());
+            if (found != nullptr && found[0] != nullptr)
+            {
+                values.emplace_back(found[0]->bv_val, found[0]->bv_len);
+            }
+            ldap_value_free_len(found);
+        }
+        return r;
+    }
+
+    LDAP* ld = nullptr;
+    const uint64_t generation;
+    /** @brief taken from the pool rather than opened for this lookup */
+    bool pooled = false;
+};
+
+GroupResolver::GroupResolver(size_t poolSize) : poolSize(poolSize) {}
+
+GroupResolver::~GroupResolver() = default;
+
+void GroupResolver::setSearch(std::optional<GroupSearch> newSearch)
+{
+    // Unbinding talks to the server, so after the lock is released
+    std::vector<std::unique_ptr<Connection>> closing;
+    {
+        std::lock_guard lock(mutex);
+        if (newSearch == search)
+        {
+            return;
+        }
+        search = std::move(newSearch);
+        ++generation;
+        closing.swap(idle);
+    }
+}
+
+GroupResolverStats GroupResolver::stats() const
+{
+    std::lock_guard lock(mutex);
+    return counters;
+}
+
+std::unique_ptr<GroupResolver::Connection>
+    GroupResolver::acquire(const GroupSearch& target, uint64_t targetGeneration,
+                           bool reuse)
+{
+    if (reuse)
+    {
+        std::lock_guard lock(mutex);
+        if (!idle.empty())
+        {
+            auto connection = std::move(idle.back());
+            idle.pop_back();
+            connection->pooled = true;
+            return connection;
+        }
+    }
+
+    auto connection = std::make_unique<Connection>(targetGeneration);
+    // libldap tries the servers of the list in order, as nslcd does
+    int r = ldap_initialize(&connection->ld, target.uris.c_str());
+    if (r != LDAP_SUCCESS)
+    {
+        lg2::error("Invalid LDAP URIs '{URIS}': {ERR}", "URIS", target.uris,
+                   "ERR", ldap_err2string(r));
+        return nullptr;
+    }
+    LDAP* ld = connection->ld;
+    int version = LDAP_VERSION3;
+    ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version);
+    auto tv = toTimeval(target.timeout);
+    ldap_set_option(ld, LDAP_OPT_NETWORK_TIMEOUT, &tv);
+    ldap_set_option(ld, LDAP_OPT_TIMEOUT, &tv);
+    ldap_set_option(ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF);
+    if (target.uris.starts_with("ldaps:"))
+    {
+        // Same checks nslcd applies, see Config::writeConfig()
+        int requireCert = LDAP_OPT_X_TLS_HARD;
+        ldap_set_option(ld, LDAP_OPT_X_TLS_REQUIRE_CERT, &requireCert);
+        if (!target.caCert.empty())
+        {
+            ldap_set_option(ld,
+                            std::filesystem::is_directory(target.caCert)
+                                ? LDAP_OPT_X_TLS_CACERTDIR
+                                : LDAP_OPT_X_TLS_CACERTFILE,
+                            target.caCert.c_str());
+        }
+        int newContext = 0;
+        ldap_set_option(ld, LDAP_OPT_X_TLS_NEWCTX, &newContext);
+    }
+
+    // Anonymous if there is no bind DN, like nslcd
+    berval credentials{target.bindPassword.size(),
+                       const_cast<char*>(target.bindPassword.c_str())};
+    r = ldap_sasl_bind_s(ld, target.bindDN.c_str(), LDAP_SASL_SIMPLE,
+                         &credentials, nullptr, nullptr, nullptr);
+    {
+        std::lock_guard lock(mutex);
+        ++counters.connects;
+    }
+    if (r != LDAP_SUCCESS)
+    {
+        lg2::error("LDAP bind for the group lookup failed: {ERR}", "ERR",
+                   ldap_err2string(r));
+        return nullptr;
+    }
+    return connection;
+}
+
+void GroupResolver::release(std::unique_ptr<Connection> connection)
+{
+    std::lock_guard lock(mutex);
+    if (connection->generation == generation && idle.size() < poolSize)
+    {
+        idle.push_back(std::move(connection));
+    }
+    // Otherwise unbound with the parameter, after the lock is released
+}
+
+std::optional<std::vector<std::string>>
+    GroupResolver::groupsOf(const std::string& user, gid_t primaryGid)
+{
+    std::optional<GroupSearch> target;
+    uint64_t targetGeneration = 0;
+    {
+        std::lock_guard lock(mutex);
+        ++counters.lookups;
+        target = search;
+        targetGeneration = generation;
+        if (!target)
+        {
+            ++counters.failures;
+            return std::nullopt;
+        }
+    }
+
+    auto scope = toLdapScope(target->scope);
+    int r = LDAP_SUCCESS;
+    std::vector<std::string> groups;
+    // A pooled connection may have been closed by the server meanwhile,
+    // that one is retried on a new connection
+    for (bool reuse : {true, false})
+    {
+        auto connection = acquire(*target, targetGeneration, reuse);
+        if (!connection)
+        {
+            r = LDAP_SERVER_DOWN;
+            break;
+        }
+
+        std::string userDN;
+        if (target->activeDirectory)
+        {
+            // Nested memberships are matched by DN, which takes the user
+            // entry first
+            std::vector<std::string> dns;
+            r = connection->search(
+                target->userBase, scope,
+                "(&" + target->userFilter + "(" + target->userNameAttribute +
+                    "=" + escapeLDAPFilterValue(user) + "))",
+                "", target->timeout, 1, dns);
+            if (r == LDAP_SUCCESS && dns.empty())
+            {
+                // Not a user of this directory, so in no group of it
+                release(std::move(connection));
+                groups.clear();
+                break;
+            }
+            if (r == LDAP_SUCCESS)
+            {
+                userDN = dns.front();
+            }
+        }
+        if (r == LDAP_SUCCESS)
+        {
+            groups.clear();
+            r = connection->search(
+                target->groupBase, scope,
+                groupMembershipFilter(*target, user, userDN, primaryGid),
+                target->groupNameAttribute, target->timeout, 0, groups);
+        }
+        if (r == LDAP_SUCCESS)
+        {
+            release(std::move(connection));
+            break;
+        }
+        if (!connection->pooled || !connectionLost(r))
+        {
+            break;
+        }
+    }
+
+    if (r != LDAP_SUCCESS)
+    {
+        lg2::error("LDAP group lookup of {USER} failed: {ERR}", "USER", user,
+                   "ERR", ldap_err2string(r));
+        std::lock_guard lock(mutex);
+        ++counters.failures;
+        return std::nullopt;
+    }
+    return groups;
+}
+
+} // namespace ldap
+} // namespace phosphor
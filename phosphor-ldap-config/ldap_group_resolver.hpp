@@ -0,0 +1,153 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+/** @brief Idle connections the group resolver keeps to the LDAP server */
+constexpr size_t groupResolverPool = 2;
+
+/** @brief OID of Active Directory's LDAP_MATCHING_RULE_IN_CHAIN, which
+ *         follows nested group memberships on the server
+ */
+constexpr auto matchingRuleInChain = "1.2.840.113556.1.4.1941";
+
+/** @struct GroupSearch
+ *  @brief How to find the groups of a user, taken from an LDAP config so
+ *         that the names match the ones nslcd reports.
+ */
+struct GroupSearch
+{
+    enum class Scope
+    {
+        Base,
+        One,
+        Sub,
+    };
+
+    /** @brief the servers, separated by white space, in the order to try */
+    std::string uris;
+    std::string bindDN;
+    std::string bindPassword;
+    /** @brief CA certificate file or directory, for ldaps:// */
+    std::string caCert;
+    std::chrono::milliseconds timeout{5000};
+    Scope scope = Scope::Sub;
+
+    /** @brief Active Directory, memberships are found by user DN */
+    bool activeDirectory = false;
+    /** @brief domain SID nslcd maps AD's objectSid with, the user's primary
+     *         group is the one with this SID and the primary gid as RID
+     */
+    std::string domainSid;
+
+    std::string userBase;
+    std::string userFilter;
+    /** @brief attribute holding the user name */
+    std::string userNameAttribute;
+
+    std::string groupBase;
+    std::string groupFilter;
+    /** @brief attribute holding the group name */
+    std::string groupNameAttribute;
+
+    bool operator==(const GroupSearch&) const = default;
+};
+
+struct GroupResolverStats
+{
+    uint64_t lookups = 0;
+    /** @brief lookups answered with std::nullopt */
+    uint64_t failures = 0;
+    /** @brief connections opened, every lookup beyond them reused one */
+    uint64_t connects = 0;
+};
+
+/** @brief Build the filter finding the groups of a user
+ *  @details For OpenLDAP the posixGroups listing the user in memberUid or
+ *  having its primary gid. For Active Directory the groups having the user
+ *  as a member, nested ones included, or its primary group's SID.
+ *  @param[in] search - how to search
+ *  @param[in] user - the user name, for OpenLDAP
+ *  @param[in] userDN - DN of the user entry, for Active Directory
+ *  @param[in] primaryGid - gid of the user's primary group
+ *  @returns the filter
+ */
+std::string groupMembershipFilter(const GroupSearch& search,
+                                  const std::string& user,
+                                  const std::string& userDN,
+                                  gid_t primaryGid);
+
+/** @class GroupResolver
+ *  @brief Finds the groups of a user with one LDAP search on a persistent
+ *         connection, instead of NSS fetching every mapped group with all
+ *         of its members through nslcd.
+ */
+class GroupResolver
+{
+  public:
+    GroupResolver(const GroupResolver&) = delete;
+    GroupResolver& operator=(const GroupResolver&) = delete;
+    GroupResolver(GroupResolver&&) = delete;
+    GroupResolver& operator=(GroupResolver&&) = delete;
+
+    /** @brief Create the resolver, idle until a search is set.
+     *  @param[in] poolSize - most idle connections kept
+     */
+    explicit GroupResolver(size_t poolSize = groupResolverPool);
+    ~GroupResolver();
+
+    /** @brief Set how to search, closing the connections if it changed
+     *  @param[in] search - the search, std::nullopt without LDAP
+     */
+    void setSearch(std::optional<GroupSearch> search);
+
+    /** @brief Find the groups of a user
+     *  @details A pooled connection the server dropped is replaced once.
+     *  @param[in] user - the user name
+     *  @param[in] primaryGid - gid of the user's primary group
+     *  @returns the names of the groups, std::nullopt if there is no search
+     *           set or the server could not answer
+     */
+    std::optional<std::vector<std::string>> groupsOf(const std::string& user,
+                                                     gid_t primaryGid);
+
+    /** @brief the statistics so far */
+    GroupResolverStats stats() const;
+
+  private:
+    struct Connection;
+
+    /** @brief a pooled connection or a new one, nullptr if none could be
+     *         opened
+     */
+    std::unique_ptr<Connection> acquire(const GroupSearch& search,
+                                        uint64_t generation, bool reuse);
+
+    /** @brief return a connection to the pool */
+    void release(std::unique_ptr<Connection> connection);
+
+    const size_t poolSize;
+
+    mutable std::mutex mutex;
+    std::optional<GroupSearch> search;
+    /** @brief bumped on every new search, older connections are dropped */
+    uint64_t generation = 0;
+    std::vector<std::unique_ptr<Connection>> idle;
+    GroupResolverStats counters;
+};
+
+} // namespace ldap
+} // namespace phosphor
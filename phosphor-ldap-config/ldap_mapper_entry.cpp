@@ -3,7 +3,6 @@
 #include "ldap_mapper_entry.hpp"
 
 #include "ldap_config.hpp"
-#include "ldap_mapper_serialize.hpp"
 
 #include <phosphor-logging/redfish_event_log.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
@@ -17,12 +16,10 @@ namespace ldap
 {
 using namespace phosphor::logging;
 LDAPMapperEntry::LDAPMapperEntry(sdbusplus::bus_t& bus, const char* path,
-                                 const char* filePath,
                                  const std::string& groupName,
                                  const std::string& privilege, Config& parent) :
     Interfaces(bus, path, Interfaces::action::defer_emit),
-    id(std::stol(std::filesystem::path(path).filename())), manager(parent),
-    persistPath(filePath)
+    id(std::stol(std::filesystem::path(path).filename())), manager(parent)
 {
     dbusObjpath = path;
     Interfaces::privilege(privilege, true);
@@ -31,10 +28,9 @@ LDAPMapperEntry::LDAPMapperEntry(sdbusplus::bus_t& bus, const char* path,
 }
 
 LDAPMapperEntry::LDAPMapperEntry(sdbusplus::bus_t& bus, const char* path,
-                                 const char* filePath, Config& parent) :
+                                 Config& parent) :
     Interfaces(bus, path, Interfaces::action::defer_emit),
-    id(std::stol(std::filesystem::path(path).filename())), manager(parent),
-    persistPath(filePath)
+    id(std::stol(std::filesystem::path(path).filename())), manager(parent)
 {
     dbusObjpath = path;
 }
@@ -51,8 +47,11 @@ std::string LDAPMapperEntry::groupName(std::string value)
     }
 
     manager.checkPrivilegeMapper(value);
+    auto oldName = Interfaces::groupName();
     auto val = Interfaces::groupName(value);
-    serialize(*this, persistPath);
+    manager.renamePrivilegeMapper(id, oldName, value);
+    manager.persistPrivilegeMapper(id, Interfaces::groupName(),
+                                   Interfaces::privilege());
     if (value == Interfaces::groupName())
     {
         // send a redfish event
@@ -74,7 +73,8 @@ std::string LDAPMapperEntry::privilege(std::string value)
 
     manager.checkPrivilegeLevel(value);
     auto val = Interfaces::privilege(value);
-    serialize(*this, persistPath);
+    manager.persistPrivilegeMapper(id, Interfaces::groupName(),
+                                   Interfaces::privilege());
     if (value == Interfaces::privilege())
     {
         // send a redfish event
@@ -39,24 +39,21 @@ class LDAPMapperEntry : public Interfaces
      *
      *  @param[in] bus  - sdbusplus handler
      *  @param[in] path - D-Bus path
-     *  @param[in] filePath - serialization directory path
      *  @param[in] groupName - LDAP group name
      *  @param[in] privilege - the privilege for the group
      *  @param[in] parent - LDAP privilege mapper manager
      */
     LDAPMapperEntry(sdbusplus::bus_t& bus, const char* path,
-                    const char* filePath, const std::string& groupName,
-                    const std::string& privilege, Config& parent);
+                    const std::string& groupName, const std::string& privilege,
+                    Config& parent);
 
     /** @brief Constructs LDAP privilege mapper entry object
      *
      *  @param[in] bus  - sdbusplus handler
      *  @param[in] path - D-Bus path
-     *  @param[in] filePath - serialization directory path
      *  @param[in] parent - LDAP privilege mapper manager
      */
-    LDAPMapperEntry(sdbusplus::bus_t& bus, const char* path,
-                    const char* filePath, Config& parent);
+    LDAPMapperEntry(sdbusplus::bus_t& bus, const char* path, Config& parent);
 
     /** @brief Delete privilege mapper entry object
      *
@@ -89,9 +86,6 @@ class LDAPMapperEntry : public Interfaces
   private:
     Id id;
     Config& manager;
-
-    /** @brief serialization directory path */
-    std::string persistPath;
     std::string dbusObjpath;
 };
 
@@ -0,0 +1,420 @@
+#include "ldap_mapper_journal.hpp"
+
+#include "file.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <utility>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+enum class Op : uint8_t
+{
+    Put = 1,
+    Erase = 2,
+};
+
+// magic and format version
+constexpr size_t fileHeaderSize = 2 * sizeof(uint32_t);
+// payload length and CRC
+constexpr size_t recordHeaderSize = 2 * sizeof(uint32_t);
+
+template <typename T>
+void putValue(std::string& buf, T value)
+{
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool getValue(std::string_view& buf, T& value)
+{
+    if (buf.size() < sizeof(value))
+    {
+        return false;
+    }
+    std::memcpy(&value, buf.data(), sizeof(value));
+    buf.remove_prefix(sizeof(value));
+    return true;
+}
+
+void putString(std::string& buf, std::string_view str)
+{
+    putValue(buf, static_cast<uint32_t>(str.size()));
+    buf.append(str);
+}
+
+bool getString(std::string_view& buf, std::string& str)
+{
+    uint32_t size = 0;
+    if (!getValue(buf, size) || buf.size() < size)
+    {
+        return false;
+    }
+    str.assign(buf.data(), size);
+    buf.remove_prefix(size);
+    return true;
+}
+
+uint32_t checksum(std::string_view data)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    return crc.checksum();
+}
+
+std::string encodeHeader()
+{
+    std::string header;
+    putValue(header, journal::magic);
+    putValue(header, journal::formatVersion);
+    return header;
+}
+
+std::string encodeRecord(Op op, Id id, const Mapping* mapping = nullptr)
+{
+    std::string payload;
+    putValue(payload, static_cast<uint8_t>(op));
+    putValue(payload, static_cast<uint64_t>(id));
+    if (mapping)
+    {
+        putString(payload, mapping->groupName);
+        putString(payload, mapping->privilege);
+    }
+
+    std::string record;
+    record.reserve(recordHeaderSize + payload.size());
+    putValue(record, static_cast<uint32_t>(payload.size()));
+    putValue(record, checksum(payload));
+    record += payload;
+    return record;
+}
+
+/** @brief Apply one record payload to the mappings.
+ *  @return - false if the payload is malformed
+ */
+bool applyRecord(std::string_view payload, Mappings& mappings)
+{
+    uint8_t op = 0;
+    uint64_t id = 0;
+    if (!getValue(payload, op) || !getValue(payload, id))
+    {
+        return false;
+    }
+
+    switch (static_cast<Op>(op))
+    {
+        case Op::Put:
+        {
+            Mapping mapping;
+            if (!getString(payload, mapping.groupName) ||
+                !getString(payload, mapping.privilege) || !payload.empty())
+            {
+                return false;
+            }
+            mappings.insert_or_assign(id, std::move(mapping));
+            return true;
+        }
+        case Op::Erase:
+            if (!payload.empty())
+            {
+                return false;
+            }
+            mappings.erase(id);
+            return true;
+    }
+    return false;
+}
+
+void writeAll(int fd, std::string_view data, const fs::path& path)
+{
+    while (!data.empty())
+    {
+        auto written = ::write(fd, data.data(), data.size());
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        data.remove_prefix(written);
+    }
+}
+
+/** @brief make a rename or file creation in the directory durable */
+void syncDirectory(const fs::path& dir)
+{
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), dir);
+    }
+    int r = fsync(fd);
+    int error = errno;
+    close(fd);
+    if (r != 0)
+    {
+        throw std::system_error(error, std::generic_category(), dir);
+    }
+}
+
+} // namespace
+
+MapperJournal::MapperJournal(fs::path filePath) : filePath(std::move(filePath))
+{}
+
+MapperJournal::~MapperJournal()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+const Mappings& MapperJournal::load()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    live.clear();
+    recordCount = 0;
+    validSize = 0;
+    loaded = true;
+
+    if (!fs::exists(filePath))
+    {
+        return live;
+    }
+    // One sequential read of the whole journal, it is parsed from memory.
+    std::ifstream is(filePath, std::ios::in | std::ios::binary);
+    if (!is)
+    {
+        throw std::system_error(errno, std::generic_category(), filePath);
+    }
+    std::string contents(std::istreambuf_iterator<char>(is), {});
+
+    std::string_view data(contents);
+    uint32_t fileMagic = 0;
+    uint32_t version = 0;
+    if (!getValue(data, fileMagic) || !getValue(data, version) ||
+        fileMagic != journal::magic || version != journal::formatVersion)
+    {
+        // Nothing usable, the next change starts the file over.
+        lg2::error("Ignoring {FILE}, it isn't a role mapping journal", "FILE",
+                   filePath);
+        return live;
+    }
+    validSize = fileHeaderSize;
+
+    while (!data.empty())
+    {
+        auto record = data;
+        uint32_t length = 0;
+        uint32_t crc = 0;
+        if (!getValue(record, length) || !getValue(record, crc) ||
+            record.size() < length)
+        {
+            break;
+        }
+        auto payload = record.substr(0, length);
+        if (checksum(payload) != crc || !applyRecord(payload, live))
+        {
+            break;
+        }
+        data = record.substr(length);
+        validSize += recordHeaderSize + length;
+        ++recordCount;
+    }
+
+    if (!data.empty())
+    {
+        // A torn write at the tail, from a crash in the middle of an append,
+        // or corruption. Either way nothing past this point can be trusted.
+        lg2::error("Dropping {SIZE} bytes of invalid records from {FILE}",
+                   "SIZE", data.size(), "FILE", filePath);
+    }
+    return live;
+}
+
+void MapperJournal::put(Id id, const Mapping& mapping)
+{
+    ensureLoaded();
+    append(encodeRecord(Op::Put, id, &mapping));
+    live.insert_or_assign(id, mapping);
+    compactIfWorthwhile();
+}
+
+void MapperJournal::erase(Id id)
+{
+    ensureLoaded();
+    if (!live.contains(id))
+    {
+        return;
+    }
+    append(encodeRecord(Op::Erase, id));
+    live.erase(id);
+    compactIfWorthwhile();
+}
+
+void MapperJournal::replace(Mappings mappings)
+{
+    loaded = true;
+    live = std::move(mappings);
+    compact();
+}
+
+void MapperJournal::compact()
+{
+    ensureLoaded();
+
+    std::string contents = encodeHeader();
+    size_t records = 0;
+    for (const auto& [id, mapping] : live)
+    {
+        contents += encodeRecord(Op::Put, id, &mapping);
+        ++records;
+    }
+
+    std::string tmpFile = filePath.string() + ".XXXXXX";
+    int tmpFd = mkstemp(tmpFile.data());
+    if (tmpFd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), tmpFile);
+    }
+    {
+        phosphor::user::File file(tmpFd, tmpFile, "w", true);
+        if (file() == nullptr)
+        {
+            close(tmpFd);
+            throw std::system_error(errno, std::generic_category(), tmpFile);
+        }
+        if (fchmod(tmpFd, S_IRUSR | S_IWUSR) != 0 ||
+            fwrite(contents.data(), 1, contents.size(), file()) !=
+                contents.size() ||
+            fflush(file()) != 0 || fsync(tmpFd) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), tmpFile);
+        }
+        fs::rename(tmpFile, filePath);
+    }
+    syncDirectory(filePath.parent_path());
+
+    // The append descriptor still refers to the replaced file.
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    validSize = contents.size();
+    recordCount = records;
+}
+
+void MapperJournal::compactIfWorthwhile()
+{
+    if (recordCount >= journal::compactMinRecords &&
+        recordCount > 2 * live.size())
+    {
+        compact();
+    }
+}
+
+void MapperJournal::ensureLoaded()
+{
+    if (!loaded)
+    {
+        load();
+    }
+}
+
+void MapperJournal::append(std::string_view record)
+{
+    if (fd < 0)
+    {
+        openForAppend();
+    }
+
+    try
+    {
+        writeAll(fd, record, filePath);
+        if (fdatasync(fd) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), filePath);
+        }
+    }
+    catch (const std::system_error&)
+    {
+        // Don't leave a partial record for the next append to follow.
+        if (ftruncate(fd, validSize) != 0)
+        {
+            lg2::error("Failed to truncate {FILE}: {ERRNO}", "FILE", filePath,
+                       "ERRNO", errno);
+        }
+        throw;
+    }
+    validSize += record.size();
+    ++recordCount;
+}
+
+void MapperJournal::openForAppend()
+{
+    bool created = !fs::exists(filePath);
+    fd = open(filePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+              S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), filePath);
+    }
+    try
+    {
+        // Cut off whatever load() didn't accept, appends continue from there.
+        if (ftruncate(fd, validSize) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), filePath);
+        }
+        if (validSize == 0)
+        {
+            auto header = encodeHeader();
+            writeAll(fd, header, filePath);
+            if (fsync(fd) != 0)
+            {
+                throw std::system_error(errno, std::generic_category(),
+                                        filePath);
+            }
+            validSize = header.size();
+        }
+        if (created)
+        {
+            syncDirectory(filePath.parent_path());
+        }
+    }
+    catch (const std::system_error&)
+    {
+        close(fd);
+        fd = -1;
+        throw;
+    }
+}
+
+} // namespace ldap
+} // namespace phosphor
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+using Id = size_t;
+
+namespace journal
+{
+
+/** @brief Name of the journal, kept in the persistent directory of a config */
+inline constexpr const char* fileName = "role_map.journal";
+
+inline constexpr uint32_t magic = 0x4a4d4c50;
+inline constexpr uint32_t formatVersion = 1;
+
+/** @brief Don't bother compacting journals with fewer records than this */
+inline constexpr size_t compactMinRecords = 64;
+
+} // namespace journal
+
+/** @struct Mapping
+ *  @brief Persisted state of one privilege mapper entry.
+ */
+struct Mapping
+{
+    std::string groupName;
+    std::string privilege;
+
+    bool operator==(const Mapping&) const = default;
+};
+
+using Mappings = std::map<Id, Mapping>;
+
+/** @class MapperJournal
+ *  @brief Append-only store of the privilege mappings of one LDAP config.
+ *  @details Every change appends a CRC protected record and is synced
+ *  before returning. Restoring replays the file with a single sequential
+ *  read, it stops at the first torn or corrupt record and drops everything
+ *  from there on. Once superseded records outnumber the live ones the file
+ *  is rewritten (compacted) with just the live mappings, atomically.
+ */
+class MapperJournal
+{
+  public:
+    MapperJournal() = delete;
+    MapperJournal(const MapperJournal&) = delete;
+    MapperJournal& operator=(const MapperJournal&) = delete;
+    MapperJournal(MapperJournal&&) = delete;
+    MapperJournal& operator=(MapperJournal&&) = delete;
+
+    /** @brief Constructs the journal, the file is only read on first use.
+     *
+     *  @param[in] filePath - path of the journal file
+     */
+    explicit MapperJournal(std::filesystem::path filePath);
+    ~MapperJournal();
+
+    /** @brief Replay the journal file.
+     *
+     *  @return - the live mappings, empty if there is no journal yet
+     *  @throws std::system_error if the file can't be read
+     */
+    const Mappings& load();
+
+    /** @brief the live mappings, as of the last load or change */
+    const Mappings& mappings() const
+    {
+        return live;
+    }
+
+    /** @brief number of records in the file, including superseded ones */
+    size_t records() const
+    {
+        return recordCount;
+    }
+
+    /** @brief Add or update a mapping.
+     *
+     *  @param[in] id - id of the privilege mapper entry
+     *  @param[in] mapping - its group name and privilege
+     *  @throws std::system_error if the record can't be written
+     */
+    void put(Id id, const Mapping& mapping);
+
+    /** @brief Remove a mapping.
+     *
+     *  @param[in] id - id of the privilege mapper entry
+     *  @throws std::system_error if the record can't be written
+     */
+    void erase(Id id);
+
+    /** @brief Replace all mappings at once and compact the file.
+     *
+     *  @param[in] mappings - the new live mappings
+     *  @throws std::system_error if the file can't be written
+     */
+    void replace(Mappings mappings);
+
+    /** @brief Rewrite the file with only the live mappings.
+     *
+     *  @throws std::system_error if the file can't be written
+     */
+    void compact();
+
+  private:
+    /** @brief read the file unless it was read already */
+    void ensureLoaded();
+
+    /** @brief compact once superseded records outnumber the live ones */
+    void compactIfWorthwhile();
+
+    /** @brief append one encoded record */
+    void append(std::string_view record);
+
+    /** @brief open the file for appending, cutting off any torn tail */
+    void openForAppend();
+
+    std::filesystem::path filePath;
+    int fd = -1;
+    bool loaded = false;
+
+    /** @brief length of the file up to the end of the last valid record */
+    size_t validSize = 0;
+    size_t recordCount = 0;
+    Mappings live;
+};
+
+} // namespace ldap
+} // namespace phosphor
@@ -13,6 +13,9 @@ namespace ldap
 
 namespace fs = std::filesystem;
 
+// Mappings are persisted in a MapperJournal now, these read and write the
+// former one file per entry layout, for migration.
+
 /** @brief Serialize and persist LDAP privilege mapper D-Bus object
  *
  *  @param[in] entry - LDAP privilege mapper entry
@@ -0,0 +1,211 @@
+#include "ldap_metrics.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace fs = std::filesystem;
+
+constexpr auto metricPrefix = "phosphor_ldap_";
+
+const char* toString(Operation operation)
+{
+    switch (operation)
+    {
+        case Operation::WriteConfig:
+            return "write_config";
+        case Operation::Persist:
+            return "persist";
+        case Operation::RestoreRoleMapping:
+            return "restore_role_mapping";
+        case Operation::NslcdRestart:
+            return "nslcd_restart";
+    }
+    return "unknown";
+}
+
+const char* toString(RestartReason reason)
+{
+    switch (reason)
+    {
+        case RestartReason::Startup:
+            return "startup";
+        case RestartReason::PropertySet:
+            return "property_set";
+        case RestartReason::Certificate:
+            return "certificate";
+        case RestartReason::ServerOrder:
+            return "server_order";
+    }
+    return "unknown";
+}
+
+void LatencyHistogram::observe(std::chrono::microseconds latency)
+{
+    size_t bucket = 0;
+    while (bucket < latencyBuckets.size() && latency > latencyBuckets[bucket])
+    {
+        ++bucket;
+    }
+    ++buckets[bucket];
+    ++count;
+    sum += latency;
+}
+
+void Metrics::observe(Operation operation, std::chrono::microseconds latency)
+{
+    histograms[static_cast<size_t>(operation)].observe(latency);
+}
+
+void Metrics::restarted(RestartReason reason)
+{
+    ++restartsByReason[static_cast<size_t>(reason)];
+}
+
+void Metrics::restarted()
+{
+    ++restartCount;
+}
+
+/** @brief a duration in seconds, as Prometheus expects them */
+static std::string seconds(std::chrono::microseconds value)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(6)
+        << static_cast<double>(value.count()) / 1e6;
+    return out.str();
+}
+
+std::string
+    Metrics::text(const std::map<std::string, size_t>& mapperEntries) const
+{
+    std::ostringstream out;
+
+    out << "# HELP " << metricPrefix
+        << "nslcd_restarts_total nslcd restarts requested\n"
+        << "# TYPE " << metricPrefix << "nslcd_restarts_total counter\n"
+        << metricPrefix << "nslcd_restarts_total " << restartCount << '\n';
+
+    out << "# HELP " << metricPrefix
+        << "nslcd_restart_reasons_total nslcd restarts by what they were "
+           "done for\n"
+        << "# TYPE " << metricPrefix << "nslcd_restart_reasons_total counter\n";
+    for (size_t i = 0; i < restartReasonCount; ++i)
+    {
+        out << metricPrefix << "nslcd_restart_reasons_total{reason=\""
+            << toString(static_cast<RestartReason>(i)) << "\"} "
+            << restartsByReason[i] << '\n';
+    }
+
+    out << "# HELP " << metricPrefix
+        << "operation_seconds Latency of LDAP config operations\n"
+        << "# TYPE " << metricPrefix << "operation_seconds histogram\n";
+    for (size_t i = 0; i < operationCount; ++i)
+    {
+        const auto& histogram = histograms[i];
+        std::string label = std::string("operation=\"") +
+                            toString(static_cast<Operation>(i)) + '"';
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < histogram.buckets.size(); ++b)
+        {
+            cumulative += histogram.buckets[b];
+            out << metricPrefix << "operation_seconds_bucket{" << label
+                << ",le=\""
+                << (b < latencyBuckets.size() ? seconds(latencyBuckets[b])
+                                              : "+Inf")
+                << "\"} " << cumulative << '\n';
+        }
+        out << metricPrefix << "operation_seconds_sum{" << label << "} "
+            << seconds(histogram.sum) << '\n'
+            << metricPrefix << "operation_seconds_count{" << label << "} "
+            << histogram.count << '\n';
+    }
+
+    out << "# HELP " << metricPrefix
+        << "mapper_entries Privilege mapper entries\n"
+        << "# TYPE " << metricPrefix << "mapper_entries gauge\n";
+    for (const auto& [config, entries] : mapperEntries)
+    {
+        out << metricPrefix << "mapper_entries{config=\"" << config << "\"} "
+            << entries << '\n';
+    }
+    return out.str();
+}
+
+std::string probeText(const ProbeStats& stats)
+{
+    std::ostringstream out;
+
+    out << "# HELP " << metricPrefix
+        << "probes_total Probes of the enabled LDAP server\n"
+        << "# TYPE " << metricPrefix << "probes_total counter\n"
+        << metricPrefix << "probes_total " << stats.probes << '\n';
+
+    out << "# HELP " << metricPrefix
+        << "probe_failures_total Failed probes by the step that failed\n"
+        << "# TYPE " << metricPrefix << "probe_failures_total counter\n";
+    for (size_t i = 0; i < probeStageCount; ++i)
+    {
+        out << metricPrefix << "probe_failures_total{stage=\""
+            << toString(static_cast<ProbeStage>(i)) << "\"} "
+            << stats.failuresByStage[i] << '\n';
+    }
+
+    out << "# HELP " << metricPrefix
+        << "probe_up Whether the last probe succeeded\n"
+        << "# TYPE " << metricPrefix << "probe_up gauge\n"
+        << metricPrefix << "probe_up "
+        << (stats.last && stats.last->success ? 1 : 0) << '\n';
+
+    out << "# HELP " << metricPrefix
+        << "probe_seconds Latency percentiles of the recent successful "
+           "probes\n"
+        << "# TYPE " << metricPrefix << "probe_seconds gauge\n";
+    auto percentiles = [&out](const char* stage,
+                              const LatencyPercentiles& latency) {
+        for (const auto& [quantile, value] :
+             {std::pair{"0.5", latency.p50}, std::pair{"0.9", latency.p90},
+              std::pair{"0.99", latency.p99}})
+        {
+            out << metricPrefix << "probe_seconds{stage=\"" << stage
+                << "\",quantile=\"" << quantile << "\"} " << seconds(value)
+                << '\n';
+        }
+    };
+    for (size_t i = 0; i < probeStageCount; ++i)
+    {
+        percentiles(toString(static_cast<ProbeStage>(i)),
+                    stats.stageLatency[i]);
+    }
+    percentiles("total", stats.totalLatency);
+    return out.str();
+}
+
+void writeMetricsFile(const std::string& path, const std::string& text)
+{
+    fs::path file(path);
+    fs::create_directories(file.parent_path());
+    auto tmpFile = file;
+    tmpFile += ".tmp";
+    {
+        std::ofstream out(tmpFile, std::ios::trunc);
+        out << text;
+        out.close();
+        if (!out)
+        {
+            throw std::system_error(EIO, std::generic_category(),
+                                    tmpFile.string());
+        }
+    }
+    fs::rename(tmpFile, file);
+}
+
+} // namespace ldap
+} // namespace phosphor
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "ldap_probe.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+/** @brief Operations whose latency is recorded */
+enum class Operation
+{
+    /** @brief rendering nslcd.conf */
+    WriteConfig,
+    /** @brief writing a config object to the persistent location */
+    Persist,
+    /** @brief restoring the privilege mappings of a config at startup */
+    RestoreRoleMapping,
+    /** @brief an nslcd restart job, from the request until systemd is done */
+    NslcdRestart,
+};
+
+constexpr size_t operationCount = 4;
+
+/** @brief What an nslcd restart was done for */
+enum class RestartReason
+{
+    Startup,
+    /** @brief a property of the enabled config, or enabling it */
+    PropertySet,
+    /** @brief a certificate installed or replaced */
+    Certificate,
+    /** @brief the servers got ranked in another order */
+    ServerOrder,
+};
+
+constexpr size_t restartReasonCount = 4;
+
+/** @brief name of an operation, for the metrics */
+const char* toString(Operation operation);
+
+/** @brief name of a restart reason, for the metrics */
+const char* toString(RestartReason reason);
+
+/** @brief Upper bounds of the latency histogram buckets, a last one takes
+ *         everything above
+ */
+constexpr std::array<std::chrono::microseconds, 6> latencyBuckets = {
+    std::chrono::microseconds(100),     std::chrono::microseconds(1000),
+    std::chrono::microseconds(10000),   std::chrono::microseconds(100000),
+    std::chrono::microseconds(1000000), std::chrono::microseconds(10000000),
+};
+
+struct LatencyHistogram
+{
+    /** @brief samples per bucket, not cumulative */
+    std::array<uint64_t, latencyBuckets.size() + 1> buckets{};
+    uint64_t count = 0;
+    std::chrono::microseconds sum{0};
+
+    void observe(std::chrono::microseconds latency);
+};
+
+/** @class Metrics
+ *  @brief Counters and latency histograms of the LDAP config manager.
+ *  @details Kept on the event loop thread, not synchronized.
+ */
+class Metrics
+{
+  public:
+    /** @brief Record how long an operation took */
+    void observe(Operation operation, std::chrono::microseconds latency);
+
+    /** @brief Count an nslcd restart done for a reason
+     *  @details A restart collecting changes of several kinds counts for
+     *  each of them, nslcdRestarts() counts it once.
+     */
+    void restarted(RestartReason reason);
+
+    /** @brief Count an nslcd restart */
+    void restarted();
+
+    const LatencyHistogram& latency(Operation operation) const
+    {
+        return histograms[static_cast<size_t>(operation)];
+    }
+
+    uint64_t restarts(RestartReason reason) const
+    {
+        return restartsByReason[static_cast<size_t>(reason)];
+    }
+
+    uint64_t nslcdRestarts() const
+    {
+        return restartCount;
+    }
+
+    /** @brief Render the metrics in the Prometheus text format
+     *  @param[in] mapperEntries - privilege mapper entries by config name
+     *  @returns the text
+     */
+    std::string text(const std::map<std::string, size_t>& mapperEntries) const;
+
+  private:
+    std::array<LatencyHistogram, operationCount> histograms{};
+    std::array<uint64_t, restartReasonCount> restartsByReason{};
+    uint64_t restartCount = 0;
+};
+
+/** @class ScopedLatency
+ *  @brief Records the time from construction to destruction of an
+ *         operation, also when it throws.
+ */
+class ScopedLatency
+{
+  public:
+    ScopedLatency(Metrics& metrics, Operation operation) :
+        metrics(metrics), operation(operation),
+        start(std::chrono::steady_clock::now())
+    {}
+
+    ~ScopedLatency()
+    {
+        metrics.observe(operation,
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start));
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+  private:
+    Metrics& metrics;
+    Operation operation;
+    std::chrono::steady_clock::time_point start;
+};
+
+/** @brief Render the statistics of the periodic server probe in the
+ *         Prometheus text format
+ *  @details Probe and failure counters, whether the last probe succeeded
+ *  and the latency percentiles of the recent successful probes.
+ *  @param[in] stats - the statistics
+ *  @returns the text
+ */
+std::string probeText(const ProbeStats& stats);
+
+/** @brief Replace a metrics file, creating its directory
+ *  @details Meant for /run, the file is replaced atomically but not synced.
+ *  @throws std::filesystem::filesystem_error or std::system_error on failure
+ */
+void writeMetricsFile(const std::string& path, const std::string& text);
+
+} // namespace ldap
+} // namespace phosphor
@@ -0,0 +1,537 @@
+#include "ldap_probe.hpp"
+
+#include <fcntl.h>
+#include <ldap.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+microseconds since(Clock::time_point start)
+{
+    return std::chrono::duration_cast<microseconds>(Clock::now() - start);
+}
+
+/** @brief TCP connect to 'address', giving up after 'timeout'
+ *  @returns 0 on success, the errno otherwise
+ */
+int tcpConnect(const addrinfo& address, std::chrono::milliseconds timeout)
+{
+    int fd = socket(address.ai_family,
+                    address.ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    address.ai_protocol);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    int error = 0;
+    if (connect(fd, address.ai_addr, address.ai_addrlen) != 0)
+    {
+        error = errno;
+        if (error == EINPROGRESS)
+        {
+            pollfd pfd{fd, POLLOUT, 0};
+            int r = poll(&pfd, 1, static_cast<int>(timeout.count()));
+            if (r == 0)
+            {
+                error = ETIMEDOUT;
+            }
+            else if (r < 0)
+            {
+                error = errno;
+            }
+            else
+            {
+                socklen_t size = sizeof(error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size);
+            }
+        }
+    }
+    close(fd);
+    return error;
+}
+
+LatencyPercentiles percentiles(std::vector<microseconds> samples)
+{
+    LatencyPercentiles result;
+    if (samples.empty())
+    {
+        return result;
+    }
+    std::sort(samples.begin(), samples.end());
+    // nearest rank
+    auto rank = [&samples](size_t percent) {
+        size_t index = (percent * samples.size() + 99) / 100;
+        return samples[std::max<size_t>(index, 1) - 1];
+    };
+    result.p50 = rank(50);
+    result.p90 = rank(90);
+    result.p99 = rank(99);
+    return result;
+}
+
+} // namespace
+
+const char* toString(ProbeStage stage)
+{
+    switch (stage)
+    {
+        case ProbeStage::Resolve:
+            return "resolve";
+        case ProbeStage::Connect:
+            return "connect";
+        case ProbeStage::TLS:
+            return "tls";
+        case ProbeStage::Bind:
+            return "bind";
+        case ProbeStage::Search:
+            return "search";
+    }
+    return "unknown";
+}
+
+ProbeResult probe(const ProbeTarget& target)
+{
+    ProbeResult result;
+    auto start = Clock::now();
+    auto latency = [&result](ProbeStage stage) -> microseconds& {
+        return result.latency[static_cast<size_t>(stage)];
+    };
+    auto fail = [&result, start](ProbeStage stage, std::string error) {
+        result.failedStage = stage;
+        result.error = std::move(error);
+        result.total = since(start);
+        return result;
+    };
+
+    LDAPURLDesc* desc = nullptr;
+    if (ldap_url_parse(target.uri.c_str(), &desc) != LDAP_URL_SUCCESS)
+    {
+        return fail(ProbeStage::Resolve, "Invalid URI");
+    }
+    std::unique_ptr<LDAPURLDesc, decltype(&ldap_free_urldesc)> descGuard(
+        desc, ldap_free_urldesc);
+    bool secure = desc->lud_scheme != nullptr &&
+                  std::string_view(desc->lud_scheme) == "ldaps";
+    std::string host = desc->lud_host != nullptr ? desc->lud_host : "";
+    int port = desc->lud_port != 0 ? desc->lud_port : (secure ? 636 : 389);
+
+    // Name resolution
+    auto stepStart = Clock::now();
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    int r = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                        &addresses);
+    latency(ProbeStage::Resolve) = since(stepStart);
+    if (r != 0)
+    {
+        return fail(ProbeStage::Resolve, gai_strerror(r));
+    }
+    std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> addressGuard(
+        addresses, freeaddrinfo);
+
+    // TCP alone, so that the network and the TLS handshake can be told apart
+    stepStart = Clock::now();
+    int error = tcpConnect(*addresses, target.timeout);
+    latency(ProbeStage::Connect) = since(stepStart);
+    if (error != 0)
+    {
+        return fail(ProbeStage::Connect, std::strerror(error));
+    }
+
+    LDAP* ld = nullptr;
+    r = ldap_initialize(&ld, target.uri.c_str());
+    if (r != LDAP_SUCCESS)
+    {
+        return fail(ProbeStage::Connect, ldap_err2string(r));
+    }
+    auto unbind = [](LDAP* ld) { ldap_unbind_ext_s(ld, nullptr, nullptr); };
+    std::unique_ptr<LDAP, decltype(unbind)> ldGuard(ld, unbind);
+
+    int version = LDAP_VERSION3;
+    ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version);
+    auto usec = std::chrono::duration_cast<microseconds>(target.timeout);
+    timeval tv{static_cast<time_t>(usec.count() / 1000000),
+               static_cast<suseconds_t>(usec.count() % 1000000)};
+    ldap_set_option(ld, LDAP_OPT_NETWORK_TIMEOUT, &tv);
+    ldap_set_option(ld, LDAP_OPT_TIMEOUT, &tv);
+    ldap_set_option(ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF);
+    if (secure)
+    {
+        // Same checks nslcd applies, see Config::writeConfig()
+        int requireCert = LDAP_OPT_X_TLS_HARD;
+        ldap_set_option(ld, LDAP_OPT_X_TLS_REQUIRE_CERT, &requireCert);
+        if (!target.caCert.empty())
+        {
+            ldap_set_option(ld,
+                            std::filesystem::is_directory(target.caCert)
+                                ? LDAP_OPT_X_TLS_CACERTDIR
+                                : LDAP_OPT_X_TLS_CACERTFILE,
+                            target.caCert.c_str());
+        }
+        int newContext = 0;
+        ldap_set_option(ld, LDAP_OPT_X_TLS_NEWCTX, &newContext);
+    }
+
+    stepStart = Clock::now();
+    r = ldap_connect(ld);
+    auto sessionConnect = since(stepStart);
+    if (r != LDAP_SUCCESS)
+    {
+        return fail(secure ? ProbeStage::TLS : ProbeStage::Connect,
+                    ldap_err2string(r));
+    }
+    if (secure)
+    {
+        latency(ProbeStage::TLS) = std::max(
+            sessionConnect - latency(ProbeStage::Connect), microseconds(0));
+    }
+
+    // Anonymous if there is no bind DN, like nslcd
+    berval credentials{target.bindPassword.size(),
+                       const_cast<char*>(target.bindPassword.c_str())};
+    stepStart = Clock::now();
+    r = ldap_sasl_bind_s(ld, target.bindDN.c_str(), LDAP_SASL_SIMPLE,
+                         &credentials, nullptr, nullptr, nullptr);
+    latency(ProbeStage::Bind) = since(stepStart);
+    if (r != LDAP_SUCCESS)
+    {
+        return fail(ProbeStage::Bind, ldap_err2string(r));
+    }
+
+    // The base entry alone, without attributes
+    char noAttributes[] = "1.1";
+    char* attributes[] = {noAttributes, nullptr};
+    LDAPMessage* message = nullptr;
+    stepStart = Clock::now();
+    r = ldap_search_ext_s(ld, target.baseDN.c_str(), LDAP_SCOPE_BASE,
+                          "(objectClass=*)", attributes, 0, nullptr, nullptr,
+                          &tv, 1, &message);
+    latency(ProbeStage::Search) = since(stepStart);
+    if (message != nullptr)
+    {
+        ldap_msgfree(message);
+    }
+    if (r != LDAP_SUCCESS)
+    {
+        return fail(ProbeStage::Search, ldap_err2string(r));
+    }
+
+    result.success = true;
+    result.total = since(start);
+    return result;
+}
+
+Prober::Prober(std::chrono::milliseconds interval) : interval(interval)
+{
+    worker = std::thread(&Prober::run, this);
+}
+
+Prober::~Prober()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    // Waits for a probe in progress, bounded by the probe timeouts
+    worker.join();
+}
+
+void Prober::setTarget(std::optional<ProbeTarget> newTarget)
+{
+    {
+        std::lock_guard lock(mutex);
+        if (target == newTarget)
+        {
+            return;
+        }
+        target = std::move(newTarget);
+        targetChanged = true;
+    }
+    wake.notify_all();
+}
+
+ProbeStats Prober::stats() const
+{
+    std::lock_guard lock(mutex);
+    return counters;
+}
+
+void Prober::run()
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        wake.wait_for(lock, interval,
+                      [this] { return stopping || targetChanged; });
+        if (stopping)
+        {
+            break;
+        }
+        targetChanged = false;
+        if (!target)
+        {
+            continue;
+        }
+
+        auto current = *target;
+        lock.unlock();
+        auto result = probe(current);
+        lock.lock();
+        record(result);
+    }
+}
+
+void Prober::record(const ProbeResult& result)
+{
+    bool wasFailing = counters.last && !counters.last->success;
+    ++counters.probes;
+    if (!result.success)
+    {
+        ++counters.failures;
+        if (result.failedStage)
+        {
+            ++counters.failuresByStage[static_cast<size_t>(
+                *result.failedStage)];
+        }
+        if (!wasFailing)
+        {
+            lg2::warning("LDAP server probe failed at {STAGE}: {ERROR}",
+                         "STAGE", toString(result.failedStage.value_or(
+                                      ProbeStage::Resolve)),
+                         "ERROR", result.error);
+        }
+    }
+    else if (wasFailing)
+    {
+        lg2::info("LDAP server probe succeeded again");
+    }
+    counters.last = result;
+
+    window.push_back(result);
+    if (window.size() > probeWindow)
+    {
+        window.pop_front();
+    }
+
+    std::array<std::vector<microseconds>, probeStageCount> stageSamples;
+    std::vector<microseconds> totalSamples;
+    for (const auto& sample : window)
+    {
+        if (!sample.success)
+        {
+            continue;
+        }
+        for (size_t stage = 0; stage < probeStageCount; ++stage)
+        {
+            stageSamples[stage].push_back(sample.latency[stage]);
+        }
+        totalSamples.push_back(sample.total);
+    }
+    for (size_t stage = 0; stage < probeStageCount; ++stage)
+    {
+        counters.stageLatency[stage] =
+            percentiles(std::move(stageSamples[stage]));
+    }
+    counters.totalLatency = percentiles(std::move(totalSamples));
+}
+
+std::vector<std::string> rankServers(const std::vector<std::string>& current,
+                                     const ServerLatencies& latencies)
+{
+    auto latencyOf =
+        [&latencies](const std::string& uri) -> std::optional<microseconds> {
+        auto it = latencies.find(uri);
+        return it != latencies.end() ? it->second : std::nullopt;
+    };
+
+    auto ranked = current;
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [&latencyOf](const auto& a, const auto& b) {
+        auto latencyA = latencyOf(a);
+        auto latencyB = latencyOf(b);
+        if (!latencyA || !latencyB)
+        {
+            return latencyA.has_value() && !latencyB;
+        }
+        return *latencyA < *latencyB;
+    });
+    if (ranked == current)
+    {
+        return current;
+    }
+
+    // A healthy server behind a failing one, nslcd would wait for the
+    // failing one first
+    auto firstFailing = std::find_if(
+        current.begin(), current.end(),
+        [&latencyOf](const auto& uri) { return !latencyOf(uri); });
+    if (std::any_of(firstFailing, current.end(),
+                    [&latencyOf](const auto& uri) {
+        return latencyOf(uri).has_value();
+    }))
+    {
+        return ranked;
+    }
+
+    auto lead = latencyOf(current.front());
+    auto best = latencyOf(ranked.front());
+    if (lead && best && ranked.front() != current.front() &&
+        *best < *lead * rankLeadRatio && *lead - *best >= rankLeadMargin)
+    {
+        return ranked;
+    }
+    return current;
+}
+
+ServerRanker::ServerRanker(std::chrono::milliseconds interval) :
+    interval(interval)
+{
+    worker = std::thread(&ServerRanker::run, this);
+}
+
+ServerRanker::~ServerRanker()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+void ServerRanker::setServers(std::vector<ProbeTarget> newServers)
+{
+    {
+        std::lock_guard lock(mutex);
+        if (servers == newServers)
+        {
+            return;
+        }
+        std::vector<std::string> uris;
+        for (const auto& server : newServers)
+        {
+            uris.push_back(server.uri);
+        }
+        if (uris != ranked)
+        {
+            // Not just new credentials, rank the new servers from scratch
+            ranked = std::move(uris);
+            smoothed.clear();
+        }
+        servers = std::move(newServers);
+        serversChanged = true;
+    }
+    wake.notify_all();
+}
+
+std::vector<std::string> ServerRanker::order() const
+{
+    std::lock_guard lock(mutex);
+    return ranked;
+}
+
+ServerLatencies ServerRanker::latencies() const
+{
+    std::lock_guard lock(mutex);
+    return smoothed;
+}
+
+void ServerRanker::run()
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        wake.wait_for(lock, interval,
+                      [this] { return stopping || serversChanged; });
+        if (stopping)
+        {
+            break;
+        }
+        serversChanged = false;
+        if (servers.size() < 2)
+        {
+            continue;
+        }
+
+        auto round = servers;
+        lock.unlock();
+        ServerLatencies measured;
+        for (const auto& server : round)
+        {
+            auto result = probe(server);
+            // The search isn't needed for nslcd to pick the server
+            if (result.success || result.failedStage == ProbeStage::Search)
+            {
+                measured[server.uri] =
+                    result.latency[static_cast<size_t>(ProbeStage::Connect)] +
+                    result.latency[static_cast<size_t>(ProbeStage::TLS)] +
+                    result.latency[static_cast<size_t>(ProbeStage::Bind)];
+            }
+            else
+            {
+                measured[server.uri] = std::nullopt;
+            }
+        }
+        lock.lock();
+        if (stopping)
+        {
+            break;
+        }
+        if (serversChanged)
+        {
+            // Measured the old servers, start over with the new ones
+            continue;
+        }
+
+        for (const auto& [uri, latency] : measured)
+        {
+            auto& average = smoothed[uri];
+            if (latency && average)
+            {
+                average = std::chrono::duration_cast<microseconds>(
+                    *latency * rankSmoothing + *average * (1 - rankSmoothing));
+            }
+            else
+            {
+                average = latency;
+            }
+        }
+        auto order = rankServers(ranked, smoothed);
+        if (order.front() != ranked.front())
+        {
+            lg2::info("LDAP server {URI} is tried first now", "URI",
+                      order.front());
+        }
+        ranked = std::move(order);
+    }
+}
+
+} // namespace ldap
+} // namespace phosphor
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+/** @brief Longest a single probe step may take */
+constexpr std::chrono::seconds probeTimeout{5};
+
+/** @brief Number of recent probes the latency percentiles are taken over */
+constexpr size_t probeWindow = 100;
+
+/** @brief Weight of a new sample in the smoothed latency of a server */
+constexpr double rankSmoothing = 0.3;
+
+/** @brief A server only takes the lead from the one tried first if its
+ *  latency is below this fraction of the leader's and rankLeadMargin less.
+ */
+constexpr double rankLeadRatio = 0.8;
+constexpr std::chrono::microseconds rankLeadMargin{5000};
+
+/** @brief Steps of a probe, in the order they are taken */
+enum class ProbeStage
+{
+    Resolve,
+    Connect,
+    TLS,
+    Bind,
+    Search,
+};
+
+constexpr size_t probeStageCount = 5;
+
+/** @brief name of a probe stage, for logs and metrics */
+const char* toString(ProbeStage stage);
+
+/** @struct ProbeTarget
+ *  @brief What to probe, taken from an LDAP config.
+ */
+struct ProbeTarget
+{
+    std::string uri;
+    std::string bindDN;
+    std::string bindPassword;
+    std::string baseDN;
+    /** @brief CA certificate file or directory, for ldaps:// */
+    std::string caCert;
+    std::chrono::milliseconds timeout = probeTimeout;
+
+    bool operator==(const ProbeTarget&) const = default;
+};
+
+/** @struct ProbeResult
+ *  @brief Outcome and step latencies of one probe.
+ *  @details 'connect' is the TCP connect alone. For ldaps:// 'tls' is the
+ *  time the LDAP library's connect took on top of that, i.e. the TLS
+ *  handshake; it stays zero for ldap://. Steps after a failed one are zero.
+ */
+struct ProbeResult
+{
+    bool success = false;
+    /** @brief the step that failed, if any */
+    std::optional<ProbeStage> failedStage;
+    std::string error;
+    std::array<std::chrono::microseconds, probeStageCount> latency{};
+    std::chrono::microseconds total{0};
+};
+
+struct LatencyPercentiles
+{
+    std::chrono::microseconds p50{0};
+    std::chrono::microseconds p90{0};
+    std::chrono::microseconds p99{0};
+};
+
+/** @struct ProbeStats
+ *  @brief Counters since the prober started and latency percentiles of the
+ *  successful probes among the last probeWindow ones.
+ */
+struct ProbeStats
+{
+    uint64_t probes = 0;
+    uint64_t failures = 0;
+    std::array<uint64_t, probeStageCount> failuresByStage{};
+    std::optional<ProbeResult> last;
+    std::array<LatencyPercentiles, probeStageCount> stageLatency{};
+    LatencyPercentiles totalLatency;
+};
+
+/** @brief Probe an LDAP server: resolve its name, connect, do the TLS
+ *         handshake for ldaps://, bind and search the base DN.
+ *  @details Blocks for up to a few times the target's timeout.
+ *  @param[in] target - server and credentials to probe with
+ *  @returns the outcome with the latency of every step taken
+ */
+ProbeResult probe(const ProbeTarget& target);
+
+/** @class Prober
+ *  @brief Probes the LDAP server periodically on a background thread.
+ */
+class Prober
+{
+  public:
+    Prober() = delete;
+    Prober(const Prober&) = delete;
+    Prober& operator=(const Prober&) = delete;
+    Prober(Prober&&) = delete;
+    Prober& operator=(Prober&&) = delete;
+
+    /** @brief Start the probe thread, idle until a target is set.
+     *  @param[in] interval - time between two probes
+     */
+    explicit Prober(std::chrono::milliseconds interval);
+    ~Prober();
+
+    /** @brief Set the server to probe, probed right away if it changed
+     *  @param[in] target - the server, std::nullopt to stop probing
+     */
+    void setTarget(std::optional<ProbeTarget> target);
+
+    /** @brief the statistics so far */
+    ProbeStats stats() const;
+
+  private:
+    void run();
+    void record(const ProbeResult& result);
+
+    const std::chrono::milliseconds interval;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool targetChanged = false;
+    std::optional<ProbeTarget> target;
+
+    ProbeStats counters;
+    /** @brief the last probeWindow results, oldest first */
+    std::deque<ProbeResult> window;
+
+    std::thread worker;
+};
+
+/** @brief connect and bind latency by server URI, std::nullopt for a server
+ *         failing them
+ */
+using ServerLatencies =
+    std::map<std::string, std::optional<std::chrono::microseconds>>;
+
+/** @brief Order servers by latency, with hysteresis
+ *  @details Healthy servers go first, the fastest one first, followed by the
+ *  failing ones in their current order. Servers missing from 'latencies'
+ *  count as failing. Since every new order restarts nslcd the current one
+ *  is kept unless a failing server is ahead of a healthy one or another
+ *  server beats the first one by rankLeadRatio and rankLeadMargin; the
+ *  order behind the first server only matters once it fails.
+ *  @param[in] current - the servers, in the order used now
+ *  @param[in] latencies - the measured latencies
+ *  @returns the servers in the order to use
+ */
+std::vector<std::string> rankServers(const std::vector<std::string>& current,
+                                     const ServerLatencies& latencies);
+
+/** @class ServerRanker
+ *  @brief Measures the connect and bind latency of every LDAP server of a
+ *         config periodically on a background thread and ranks them.
+ */
+class ServerRanker
+{
+  public:
+    ServerRanker() = delete;
+    ServerRanker(const ServerRanker&) = delete;
+    ServerRanker& operator=(const ServerRanker&) = delete;
+    ServerRanker(ServerRanker&&) = delete;
+    ServerRanker& operator=(ServerRanker&&) = delete;
+
+    /** @brief Start the ranking thread, idle until servers are set.
+     *  @param[in] interval - time between two rounds of probes
+     */
+    explicit ServerRanker(std::chrono::milliseconds interval);
+    ~ServerRanker();
+
+    /** @brief Set the servers to rank, probed right away if they changed
+     *  @details A new list of servers starts over from its configured
+     *  order. A single server is not probed, there is nothing to rank.
+     *  @param[in] servers - the servers, in the configured order
+     */
+    void setServers(std::vector<ProbeTarget> servers);
+
+    /** @brief the servers, in the order to try them */
+    std::vector<std::string> order() const;
+
+    /** @brief the smoothed latencies of the last round */
+    ServerLatencies latencies() const;
+
+  private:
+    void run();
+
+    const std::chrono::milliseconds interval;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool serversChanged = false;
+    std::vector<ProbeTarget> servers;
+
+    ServerLatencies smoothed;
+    std::vector<std::string> ranked;
+
+    std::thread worker;
+};
+
+} // namespace ldap
+} // namespace phosphor
@@ -2,17 +2,30 @@
 
 #include "ldap_config_mgr.hpp"
 
+#include <signal.h>
+#include <systemd/sd-event.h>
+
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/lg2.hpp>
 #include <sdbusplus/bus.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
+#include <chrono>
 #include <filesystem>
+#include <string_view>
 
 int main(int /*argc*/, char** /*argv*/)
 {
     using namespace phosphor::logging;
     using namespace sdbusplus::xyz::openbmc_project::Common::Error;
+    // Handled by the event loop, blocked before any thread is started so
+    // that none of them gets the signal either.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+
     try
     {
         std::filesystem::path configDir =
@@ -37,12 +50,50 @@ int main(int /*argc*/, char** /*argv*/)
                                       TLS_CERT_FILE);
         mgr.restore();
 
+        sd_event* event = nullptr;
+        int r = sd_event_default(&event);
+        if (r < 0)
+        {
+            lg2::error("Failed to get the default event loop: {ERRNO}",
+                       "ERRNO", -r);
+            return -1;
+        }
+        bus.attach_event(event, SD_EVENT_PRIORITY_NORMAL);
+        mgr.attachEvent(event,
+                        std::chrono::milliseconds(LDAP_RESTART_DEBOUNCE_MS),
+                        std::chrono::milliseconds(LDAP_PERSIST_DELAY_MS));
+        if constexpr (LDAP_PROBE_INTERVAL_SEC > 0)
+        {
+            mgr.startProbe(std::chrono::seconds(LDAP_PROBE_INTERVAL_SEC));
+        }
+        if constexpr (LDAP_SERVER_RANK_INTERVAL_SEC > 0)
+        {
+            mgr.startServerRanking(
+                std::chrono::seconds(LDAP_SERVER_RANK_INTERVAL_SEC));
+        }
+        if constexpr (LDAP_CACHE_WARMUP_CONCURRENCY > 0)
+        {
+            mgr.startCacheWarmUp(LDAP_CACHE_WARMUP_CONCURRENCY);
+        }
+        if constexpr (!std::string_view(LDAP_METRICS_FILE).empty())
+        {
+            mgr.startMetricsDump(LDAP_METRICS_FILE);
+        }
+        // Without a handler the loop just exits, see the flush below
+        sd_event_add_signal(event, nullptr, SIGTERM, nullptr, nullptr);
+        sd_event_add_signal(event, nullptr, SIGINT, nullptr, nullptr);
+
         bus.request_name(LDAP_CONFIG_BUSNAME);
 
-        while (true)
+        r = sd_event_loop(event);
+        // Write the changes still waiting for the persist delay
+        mgr.flushPersist();
+        bus.detach_event();
+        sd_event_unref(event);
+        if (r < 0)
         {
-            bus.process_discard();
-            bus.wait();
+            lg2::error("Event loop failed: {ERRNO}", "ERRNO", -r);
+            return -1;
         }
     }
     catch (const std::exception& e)
@@ -5,26 +5,71 @@
 #include <netdb.h>
 
 #include <boost/algorithm/string.hpp>
+#include <phosphor-logging/lg2.hpp>
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 
 namespace phosphor
 {
 namespace ldap
 {
 
-bool isValidLDAPURI(const std::string& uri, const char* scheme)
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Failures are cached shortly, so a fixed DNS entry is picked up soon.
+constexpr auto resolvedTTL = std::chrono::seconds(60);
+constexpr auto unresolvedTTL = std::chrono::seconds(5);
+
+struct Lookup
+{
+    std::mutex mutex;
+    std::condition_variable done;
+    std::optional<bool> resolved;
+};
+
+struct CacheEntry
+{
+    bool resolved;
+    Clock::time_point expires;
+};
+
+struct Resolver
+{
+    std::mutex mutex;
+    std::unordered_map<std::string, CacheEntry> cache;
+    std::unordered_map<std::string, std::shared_ptr<Lookup>> inFlight;
+};
+
+/** @brief resolver state, never destroyed as lookups may outlive main() */
+Resolver& resolver()
+{
+    static auto* instance = new Resolver;
+    return *instance;
+}
+
+/** @brief get the host of a valid LDAP URI */
+std::optional<std::string> parseLDAPURI(const std::string& uri,
+                                        const char* scheme)
 {
     // Return false if the user tries to configure port 0
-    // This check is not done in line 42, because ldap_url_parse
+    // This check is not done below, because ldap_url_parse
     // method internally converts port 0 to ldap port 389 and it
     // will always return true (thus allowing the user to
     // configure port 0)
 
     if (boost::algorithm::ends_with(uri, ":0"))
     {
-        return false;
+        return std::nullopt;
     }
 
     LDAPURLDesc* ludpp = nullptr;
@@ -39,33 +84,271 @@ bool isValidLDAPURI(const std::string& uri, const char* scheme)
 
     if (res != LDAP_URL_SUCCESS)
     {
-        return false;
+        return std::nullopt;
     }
     if (std::strcmp(scheme, ludppPtr->lud_scheme) != 0)
     {
-        return false;
+        return std::nullopt;
     }
     if (ludppPtr->lud_port < 0 || ludppPtr->lud_port > 65536)
     {
-        return false;
+        return std::nullopt;
     }
+    if (ludppPtr->lud_host == nullptr || *ludppPtr->lud_host == '\0')
+    {
+        return std::nullopt;
+    }
+    return ludppPtr->lud_host;
+}
+
+bool isNumericHost(const std::string& host)
+{
+    in6_addr addr{};
+    return inet_pton(AF_INET, host.c_str(), &addr) == 1 ||
+           inet_pton(AF_INET6, host.c_str(), &addr) == 1;
+}
+
+bool getAddrInfo(const std::string& host)
+{
     addrinfo hints{};
     addrinfo* servinfo = nullptr;
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_flags |= AI_CANONNAME;
 
-    auto result = getaddrinfo(ludppPtr->lud_host, nullptr, &hints, &servinfo);
+    auto result = getaddrinfo(host.c_str(), nullptr, &hints, &servinfo);
     auto cleanupFunc = [](addrinfo* servinfo) { freeaddrinfo(servinfo); };
     std::unique_ptr<addrinfo, decltype(cleanupFunc)> servinfoPtr(servinfo,
                                                                  cleanupFunc);
+    return result == 0;
+}
+
+/** @brief get a fresh cached result for a host, if any */
+std::optional<bool> cached(const std::string& host)
+{
+    auto& r = resolver();
+    std::lock_guard lock(r.mutex);
+    auto it = r.cache.find(host);
+    if (it == r.cache.end() || it->second.expires <= Clock::now())
+    {
+        return std::nullopt;
+    }
+    return it->second.resolved;
+}
+
+/** @brief start resolving a host, or join the lookup already running */
+std::shared_ptr<Lookup> startLookup(const std::string& host)
+{
+    auto& r = resolver();
+    std::lock_guard lock(r.mutex);
+    auto& lookup = r.inFlight[host];
+    if (lookup)
+    {
+        return lookup;
+    }
+    lookup = std::make_shared<Lookup>();
+
+    std::thread([host, lookup]() {
+        bool resolved = getAddrInfo(host);
+        if (!resolved)
+        {
+            lg2::warning("Unable to resolve LDAP server {HOST}", "HOST",
+                         host);
+        }
+
+        auto& r = resolver();
+        {
+            std::lock_guard lock(r.mutex);
+            auto now = Clock::now();
+            std::erase_if(r.cache, [now](const auto& entry) {
+                return entry.second.expires <= now;
+            });
+            r.cache[host] = {resolved,
+                             now + (resolved ? resolvedTTL : unresolvedTTL)};
+            r.inFlight.erase(host);
+        }
+        {
+            std::lock_guard lock(lookup->mutex);
+            lookup->resolved = resolved;
+        }
+        lookup->done.notify_all();
+    }).detach();
+    return lookup;
+}
+
+} // namespace
+
+bool isValidLDAPURISyntax(const std::string& uri, const char* scheme)
+{
+    return parseLDAPURI(uri, scheme).has_value();
+}
+
+bool isValidLDAPURI(const std::string& uri, const char* scheme)
+{
+    auto host = parseLDAPURI(uri, scheme);
+    return host && resolveHost(*host, resolveTimeout);
+}
+
+std::vector<std::string> splitLDAPURIs(const std::string& uris)
+{
+    std::vector<std::string> result;
+    boost::algorithm::split(result, uris, boost::algorithm::is_space(),
+                            boost::algorithm::token_compress_on);
+    std::erase_if(result, [](const auto& uri) { return uri.empty(); });
+    return result;
+}
 
-    if (result)
+std::optional<bool> validateLDAPURIs(const std::string& uris, bool resolve)
+{
+    auto list = splitLDAPURIs(uris);
+    if (list.empty())
+    {
+        return std::nullopt;
+    }
+    // The scheme of the first URI is checked on every one of them
+    bool secure = list.front().starts_with("ldaps:");
+    auto scheme = secure ? "ldaps" : "ldap";
+    std::vector<std::string> hosts;
+    for (const auto& uri : list)
+    {
+        auto host = parseLDAPURI(uri, scheme);
+        if (!host)
+        {
+            return std::nullopt;
+        }
+        hosts.push_back(std::move(*host));
+    }
+    if (resolve && !resolveHosts(hosts, resolveTimeout))
+    {
+        return std::nullopt;
+    }
+    return secure;
+}
+
+bool isValidLDAPDN(const std::string& dn)
+{
+    LDAPDN parsed = nullptr;
+    if (dn.empty() ||
+        ldap_str2dn(dn.c_str(), &parsed, LDAP_DN_FORMAT_LDAPV3) !=
+            LDAP_SUCCESS)
     {
         return false;
     }
+    ldap_dnfree(parsed);
+    return true;
+}
+
+bool isValidLDAPFilter(const std::string& filter)
+{
+    if (filter.size() < 3 || !filter.starts_with('(') ||
+        filter.find_first_of("\r\n") != std::string::npos)
+    {
+        return false;
+    }
+    // Balanced, and closed at the very end. Escaped parentheses are \28
+    // and \29, so every one counts.
+    int depth = 0;
+    for (size_t i = 0; i < filter.size(); ++i)
+    {
+        if (filter[i] == '(')
+        {
+            ++depth;
+        }
+        else if (filter[i] == ')' && --depth == 0 && i + 1 != filter.size())
+        {
+            return false;
+        }
+        if (depth < 0)
+        {
+            return false;
+        }
+    }
+    return depth == 0;
+}
+
+std::string escapeLDAPFilterValue(const std::string& value)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value)
+    {
+        if (c == '*' || c == '(' || c == ')' || c == '\\' || c == '\0')
+        {
+            auto byte = static_cast<unsigned char>(c);
+            escaped += '\\';
+            escaped += hex[byte >> 4];
+            escaped += hex[byte & 0xf];
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+bool resolveHost(const std::string& host, std::chrono::milliseconds timeout)
+{
+    return resolveHosts({host}, timeout);
+}
+
+bool resolveHosts(const std::vector<std::string>& hosts,
+                  std::chrono::milliseconds timeout)
+{
+    // Every lookup is started before waiting for any, so a list of servers
+    // takes no longer than its slowest one.
+    auto deadline = Clock::now() + timeout;
+    std::vector<std::pair<const std::string*, std::shared_ptr<Lookup>>>
+        lookups;
+    for (const auto& host : hosts)
+    {
+        if (isNumericHost(host))
+        {
+            continue;
+        }
+        if (auto resolved = cached(host))
+        {
+            if (!*resolved)
+            {
+                return false;
+            }
+            continue;
+        }
+        lookups.emplace_back(&host, startLookup(host));
+    }
+
+    for (const auto& [host, lookup] : lookups)
+    {
+        std::unique_lock lock(lookup->mutex);
+        auto done = [&lookup]() { return lookup->resolved.has_value(); };
+        if (!lookup->done.wait_until(lock, deadline, done))
+        {
+            lg2::error("Resolving LDAP server {HOST} timed out", "HOST",
+                       *host);
+            return false;
+        }
+        if (!*lookup->resolved)
+        {
+            return false;
+        }
+    }
     return true;
 }
 
+void revalidateLDAPURI(const std::string& uri)
+{
+    auto host = parseLDAPURI(uri, "ldaps");
+    if (!host)
+    {
+        host = parseLDAPURI(uri, "ldap");
+    }
+    if (!host || isNumericHost(*host) || cached(*host))
+    {
+        return;
+    }
+    startLookup(*host);
+}
+
 } // namespace ldap
 } // namespace phosphor
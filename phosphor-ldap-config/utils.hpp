@@ -1,14 +1,21 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace phosphor
 {
 namespace ldap
 {
 
+/** @brief Longest a D-Bus request waits for the LDAP server name to resolve */
+constexpr std::chrono::milliseconds resolveTimeout{2000};
+
 /** @brief checks that the given URI is valid LDAP's URI.
  *      LDAP's URL begins with "ldap://" and LDAPS's URL begins with "ldap://"
+ *      The host must resolve within resolveTimeout, see resolveHost().
  *  @param[in] URI - URI which needs to be validated.
  *  @param[in] scheme - LDAP's scheme, scheme equals to "ldaps" to validate
  *       against LDAPS type URI, for LDAP type URI it is equals to "ldap".
@@ -16,5 +23,80 @@ namespace ldap
  */
 bool isValidLDAPURI(const std::string& uri, const char* scheme);
 
+/** @brief checks the syntax, scheme and port of an LDAP URI only
+ *      Unlike isValidLDAPURI() this never touches DNS.
+ *  @param[in] URI - URI which needs to be validated.
+ *  @param[in] scheme - LDAP's scheme, "ldap" or "ldaps".
+ *  @returns true if it is valid otherwise false.
+ */
+bool isValidLDAPURISyntax(const std::string& uri, const char* scheme);
+
+/** @brief split a list of LDAP URIs separated by white space
+ *      nslcd tries the servers of its uri lines in this order.
+ *  @param[in] uris - the list, as kept in the LDAPServerURI property
+ *  @returns the URIs, in order
+ */
+std::vector<std::string> splitLDAPURIs(const std::string& uris);
+
+/** @brief checks a list of LDAP URIs separated by white space
+ *      Every URI must be valid by isValidLDAPURISyntax() and all must use
+ *      the same scheme since nslcd's ssl setting covers every server. With
+ *      'resolve' every host must also resolve, all of them within
+ *      resolveTimeout, see resolveHosts().
+ *  @param[in] uris - the list
+ *  @param[in] resolve - whether the hosts must resolve
+ *  @returns whether the servers are LDAPS ones, std::nullopt if the list is
+ *       empty or not valid.
+ */
+std::optional<bool> validateLDAPURIs(const std::string& uris,
+                                     bool resolve = true);
+
+/** @brief checks the syntax of an LDAP distinguished name
+ *  @param[in] dn - the DN, in the string form of RFC 4514
+ *  @returns true if it is valid otherwise false.
+ */
+bool isValidLDAPDN(const std::string& dn);
+
+/** @brief checks that an LDAP search filter is a single parenthesized
+ *      filter, as nslcd's filter option takes
+ *  @param[in] filter - the filter
+ *  @returns true if it is valid otherwise false.
+ */
+bool isValidLDAPFilter(const std::string& filter);
+
+/** @brief escape a value for use in an LDAP search filter
+ *      The characters RFC 4515 reserves, '*', '(', ')', '\\' and NUL, are
+ *      replaced by their \\XX hex form.
+ *  @param[in] value - the assertion value, e.g. a user name
+ *  @returns the escaped value
+ */
+std::string escapeLDAPFilterValue(const std::string& value);
+
+/** @brief checks that a host name resolves
+ *      Numeric addresses are accepted without a lookup. Results are cached
+ *      for a short while. A lookup that takes longer than the timeout keeps
+ *      running in the background and fills the cache for the next call.
+ *  @param[in] host - host name or address
+ *  @param[in] timeout - longest time to wait for the resolver
+ *  @returns true if the host resolved in time.
+ */
+bool resolveHost(const std::string& host, std::chrono::milliseconds timeout);
+
+/** @brief checks that several host names resolve, like resolveHost()
+ *      The lookups run in parallel and share the timeout.
+ *  @param[in] hosts - host names or addresses
+ *  @param[in] timeout - longest time to wait for all of them
+ *  @returns true if every host resolved in time.
+ */
+bool resolveHosts(const std::vector<std::string>& hosts,
+                  std::chrono::milliseconds timeout);
+
+/** @brief resolve the host of an LDAP URI in the background
+ *      Used at startup, where a slow DNS must not hold up the daemon. The
+ *      result only warms the cache, a failure is logged.
+ *  @param[in] URI - URI of the LDAP server.
+ */
+void revalidateLDAPURI(const std::string& uri);
+
 } // namespace ldap
 } // namespace phosphor
@@ -34,7 +34,8 @@ class Lock
     /** @brief Default constructor that just locks the shadow file */
     Lock()
     {
-        if (!lckpwdf())
+        // lckpwdf(3) returns 0 on success
+        if (lckpwdf() != 0)
         {
             lg2::error("Failed to lock shadow file");
             elog<InternalFailure>();
@@ -42,10 +43,10 @@ class Lock
     }
     ~Lock()
     {
-        if (!ulckpwdf())
+        // Never throw from a destructor, the lock is dropped on exit anyway
+        if (ulckpwdf() != 0)
         {
             lg2::error("Failed to unlock shadow file");
-            elog<InternalFailure>();
         }
     }
 };
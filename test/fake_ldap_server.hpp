@@ -0,0 +1,256 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+/** @class FakeLdapServer
+ *  @brief Stand-in for slapd, answering binds and searches on localhost.
+ *  @details Just enough BER to reply to the short messages the clients
+ *  send: every bind gets 'bindResult', every search the entries set with
+ *  addEntry() followed by a successful result.
+ */
+class FakeLdapServer
+{
+  public:
+    explicit FakeLdapServer(uint8_t bindResult = 0) : bindResult(bindResult)
+    {
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t size = sizeof(addr);
+        getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &size);
+        port = ntohs(addr.sin_port);
+        listen(listener, 8);
+        thread = std::thread([this] { serve(); });
+    }
+
+    ~FakeLdapServer()
+    {
+        stopping = true;
+        thread.join();
+        close(listener);
+    }
+
+    std::string uri() const
+    {
+        return "ldap://127.0.0.1:" + std::to_string(port);
+    }
+
+    /** @brief Return an entry with a single valued attribute from every
+     *         search, only before the first client connects
+     */
+    void addEntry(const std::string& dn, const std::string& attribute,
+                  const std::string& value)
+    {
+        entries.push_back({dn, attribute, value});
+    }
+
+    /** @brief connections accepted so far */
+    unsigned connections() const
+    {
+        return accepted;
+    }
+
+  private:
+    struct Entry
+    {
+        std::string dn;
+        std::string attribute;
+        std::string value;
+    };
+
+    static std::vector<uint8_t> ber(uint8_t tag,
+                                    const std::vector<uint8_t>& content)
+    {
+        std::vector<uint8_t> encoded{tag};
+        if (content.size() < 0x80)
+        {
+            encoded.push_back(static_cast<uint8_t>(content.size()));
+        }
+        else
+        {
+            encoded.push_back(0x82);
+            encoded.push_back(static_cast<uint8_t>(content.size() >> 8));
+            encoded.push_back(static_cast<uint8_t>(content.size()));
+        }
+        encoded.insert(encoded.end(), content.begin(), content.end());
+        return encoded;
+    }
+
+    static std::vector<uint8_t> octets(const std::string& value)
+    {
+        return ber(0x04, std::vector<uint8_t>(value.begin(), value.end()));
+    }
+
+    static std::vector<uint8_t>
+        concat(std::initializer_list<std::vector<uint8_t>> parts)
+    {
+        std::vector<uint8_t> joined;
+        for (const auto& part : parts)
+        {
+            joined.insert(joined.end(), part.begin(), part.end());
+        }
+        return joined;
+    }
+
+    void serve()
+    {
+        while (!stopping)
+        {
+            pollfd pfd{listener, POLLIN, 0};
+            if (poll(&pfd, 1, 10) <= 0)
+            {
+                continue;
+            }
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                ++accepted;
+                converse(fd);
+                close(fd);
+            }
+        }
+    }
+
+    bool readFully(int fd, uint8_t* buf, size_t size)
+    {
+        while (size > 0)
+        {
+            pollfd pfd{fd, POLLIN, 0};
+            // Keeps an idle client connected, checking for shutdown
+            int r = 0;
+            while (!stopping && (r = poll(&pfd, 1, 10)) == 0)
+            {}
+            if (r <= 0)
+            {
+                return false;
+            }
+            auto n = read(fd, buf, size);
+            if (n <= 0)
+            {
+                return false;
+            }
+            buf += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool send(int fd, const std::vector<uint8_t>& message)
+    {
+        return write(fd, message.data(), message.size()) ==
+               static_cast<ssize_t>(message.size());
+    }
+
+    void converse(int fd)
+    {
+        while (!stopping)
+        {
+            // LDAPMessage ::= SEQUENCE { messageID, protocolOp, ... }
+            uint8_t header[2];
+            if (!readFully(fd, header, sizeof(header)) || header[0] != 0x30)
+            {
+                return;
+            }
+            size_t length = header[1];
+            if (length & 0x80)
+            {
+                uint8_t lengthBytes[4];
+                size_t count = length & 0x7f;
+                if (count > sizeof(lengthBytes) ||
+                    !readFully(fd, lengthBytes, count))
+                {
+                    return;
+                }
+                length = 0;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    length = (length << 8) | lengthBytes[i];
+                }
+            }
+            std::vector<uint8_t> body(length);
+            if (!readFully(fd, body.data(), body.size()) || body.size() < 4 ||
+                body[0] != 0x02 || body[1] != 0x01)
+            {
+                return;
+            }
+            uint8_t messageId = body[2];
+            uint8_t op = body[3];
+            std::vector<uint8_t> id = {0x02, 0x01, messageId};
+
+            uint8_t resultCode = 0;
+            uint8_t responseOp = 0;
+            if (op == 0x60) // BindRequest
+            {
+                responseOp = 0x61;
+                resultCode = bindResult;
+            }
+            else if (op == 0x63) // SearchRequest
+            {
+                for (const auto& entry : entries)
+                {
+                    auto attribute = ber(
+                        0x30, concat({octets(entry.attribute),
+                                      ber(0x31, octets(entry.value))}));
+                    auto result = ber(
+                        0x64, concat({octets(entry.dn), ber(0x30, attribute)}));
+                    if (!send(fd, ber(0x30, concat({id, result}))))
+                    {
+                        return;
+                    }
+                }
+                responseOp = 0x65; // SearchResultDone
+            }
+            else // UnbindRequest or anything else
+            {
+                return;
+            }
+            auto result = ber(responseOp, {0x0a, 0x01, resultCode, 0x04, 0x00,
+                                           0x04, 0x00});
+            if (!send(fd, ber(0x30, concat({id, result}))))
+            {
+                return;
+            }
+        }
+    }
+
+    uint8_t bindResult;
+    std::vector<Entry> entries;
+    int listener = -1;
+    uint16_t port = 0;
+    std::atomic<bool> stopping = false;
+    std::atomic<unsigned> accepted = 0;
+    std::thread thread;
+};
+
+/** @brief a local port nothing listens on */
+inline uint16_t closedPort()
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t size = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &size);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+} // namespace ldap
+} // namespace phosphor
@@ -0,0 +1,128 @@
+#include "home_dir_worker.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace user
+{
+
+namespace fs = std::filesystem;
+
+class TestHomeDirWorker : public testing::Test
+{
+  public:
+    TestHomeDirWorker()
+    {
+        char tmpDir[] = "/tmp/test-home-XXXXXX";
+        dir = mkdtemp(tmpDir);
+        homeRoot = dir / "home";
+        skelDir = dir / "skel";
+        fs::create_directories(homeRoot);
+        fs::create_directories(skelDir / ".config");
+        std::ofstream(skelDir / ".profile") << "export PS1='$ '\n";
+    }
+
+    ~TestHomeDirWorker() override
+    {
+        fs::remove_all(dir);
+    }
+
+  protected:
+    fs::path dir;
+    fs::path homeRoot;
+    fs::path skelDir;
+};
+
+TEST_F(TestHomeDirWorker, createCopiesSkeleton)
+{
+    HomeDirWorker worker(homeRoot, skelDir);
+    worker.create("user0", getuid(), getgid());
+    worker.drain();
+
+    EXPECT_TRUE(fs::is_directory(homeRoot / "user0" / ".config"));
+    EXPECT_TRUE(fs::is_regular_file(homeRoot / "user0" / ".profile"));
+
+    struct stat st{};
+    ASSERT_EQ(0, stat((homeRoot / "user0").c_str(), &st));
+    EXPECT_EQ(getuid(), st.st_uid);
+    EXPECT_EQ(getgid(), st.st_gid);
+}
+
+TEST_F(TestHomeDirWorker, createKeepsExistingHome)
+{
+    fs::create_directories(homeRoot / "user0");
+    std::ofstream(homeRoot / "user0" / "notes") << "keep me\n";
+
+    HomeDirWorker worker(homeRoot, skelDir);
+    worker.create("user0", getuid(), getgid());
+    worker.drain();
+
+    EXPECT_TRUE(fs::exists(homeRoot / "user0" / "notes"));
+    EXPECT_FALSE(fs::exists(homeRoot / "user0" / ".profile"));
+}
+
+TEST_F(TestHomeDirWorker, renameMovesHome)
+{
+    HomeDirWorker worker(homeRoot, skelDir);
+    worker.create("user0", getuid(), getgid());
+    worker.rename("user0", "user1");
+    worker.drain();
+
+    EXPECT_FALSE(fs::exists(homeRoot / "user0"));
+    EXPECT_TRUE(fs::is_regular_file(homeRoot / "user1" / ".profile"));
+}
+
+TEST_F(TestHomeDirWorker, renameWithoutHomeIsNoop)
+{
+    HomeDirWorker worker(homeRoot, skelDir);
+    worker.rename("user0", "user1");
+    worker.drain();
+
+    EXPECT_FALSE(fs::exists(homeRoot / "user1"));
+}
+
+TEST_F(TestHomeDirWorker, removeDeletesHomeAndTrash)
+{
+    HomeDirWorker worker(homeRoot, skelDir);
+    worker.create("user0", getuid(), getgid());
+    worker.remove("user0");
+    worker.drain();
+
+    EXPECT_FALSE(fs::exists(homeRoot / "user0"));
+    EXPECT_TRUE(fs::is_empty(homeRoot / ".deleted"));
+}
+
+TEST_F(TestHomeDirWorker, jobsOfOneUserKeepTheirOrder)
+{
+    HomeDirWorker worker(homeRoot, skelDir);
+    worker.create("user0", getuid(), getgid());
+    worker.remove("user0");
+    worker.create("user0", getuid(), getgid());
+    worker.rename("user0", "user1");
+    worker.drain();
+
+    EXPECT_FALSE(fs::exists(homeRoot / "user0"));
+    EXPECT_TRUE(fs::is_regular_file(homeRoot / "user1" / ".profile"));
+}
+
+TEST_F(TestHomeDirWorker, leftoverTrashIsReclaimedOnStart)
+{
+    fs::create_directories(homeRoot / ".deleted" / "user0.0" / "data");
+
+    HomeDirWorker worker(homeRoot, skelDir);
+    worker.drain();
+
+    EXPECT_TRUE(fs::is_empty(homeRoot / ".deleted"));
+}
+
+} // namespace user
+} // namespace phosphor
@@ -0,0 +1,131 @@
+#include "phosphor-ldap-config/ldap_cache_warmer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+using namespace std::chrono_literals;
+
+/** @class FakeDirectory
+ *  @brief Stand-in for NSS, recording the names looked up and the most
+ *         lookups that were in flight at once.
+ */
+class FakeDirectory
+{
+  public:
+    explicit FakeDirectory(std::chrono::milliseconds delay = 0ms) :
+        delay(delay)
+    {}
+
+    CacheWarmer::Lookup lookup(const std::string& prefix)
+    {
+        return [this, prefix](const std::string& name) {
+            {
+                std::lock_guard lock(mutex);
+                ++inFlight;
+                maxInFlight = std::max(maxInFlight, inFlight);
+            }
+            std::this_thread::sleep_for(delay);
+            std::lock_guard lock(mutex);
+            --inFlight;
+            looked.push_back(prefix + name);
+            return name != "missing";
+        };
+    }
+
+    std::multiset<std::string> names() const
+    {
+        std::lock_guard lock(mutex);
+        return {looked.begin(), looked.end()};
+    }
+
+    size_t maxConcurrency() const
+    {
+        std::lock_guard lock(mutex);
+        return maxInFlight;
+    }
+
+  private:
+    const std::chrono::milliseconds delay;
+    mutable std::mutex mutex;
+    size_t inFlight = 0;
+    size_t maxInFlight = 0;
+    std::vector<std::string> looked;
+};
+
+TEST(CacheWarmer, looksUpEveryNameWithBoundedConcurrency)
+{
+    FakeDirectory directory(5ms);
+    CacheWarmer warmer(2, directory.lookup("group:"),
+                       directory.lookup("user:"));
+
+    std::vector<std::string> groups = {"admins", "operators", "readers",
+                                       "missing"};
+    std::vector<std::string> users = {"alice", "bob"};
+    warmer.warm(groups, users);
+    ASSERT_TRUE(warmer.waitIdle(5s));
+
+    std::multiset<std::string> expected = {
+        "group:admins", "group:operators", "group:readers",
+        "group:missing", "user:alice",     "user:bob"};
+    EXPECT_EQ(expected, directory.names());
+    EXPECT_LE(directory.maxConcurrency(), 2u);
+
+    auto stats = warmer.stats();
+    EXPECT_EQ(1u, stats.runs);
+    EXPECT_EQ(0u, stats.cancelled);
+    EXPECT_EQ(6u, stats.lookups);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_GT(stats.lastDuration, 0us);
+}
+
+TEST(CacheWarmer, newRunDropsQueuedNames)
+{
+    FakeDirectory directory(20ms);
+    CacheWarmer warmer(1, directory.lookup("group:"),
+                       directory.lookup("user:"));
+
+    std::vector<std::string> stale;
+    for (int i = 0; i < 20; ++i)
+    {
+        stale.push_back("stale" + std::to_string(i));
+    }
+    warmer.warm(stale, {});
+    warmer.warm({"fresh"}, {});
+    ASSERT_TRUE(warmer.waitIdle(5s));
+
+    auto names = directory.names();
+    EXPECT_EQ(1u, names.count("group:fresh"));
+    // At most the one in flight when the new run came in
+    EXPECT_LE(names.size(), 2u);
+
+    auto stats = warmer.stats();
+    EXPECT_EQ(2u, stats.runs);
+    EXPECT_EQ(1u, stats.cancelled);
+    EXPECT_EQ(names.size(), stats.lookups);
+}
+
+TEST(CacheWarmer, nothingToWarm)
+{
+    FakeDirectory directory;
+    CacheWarmer warmer(2, directory.lookup("group:"),
+                       directory.lookup("user:"));
+    warmer.warm({}, {});
+    EXPECT_TRUE(warmer.waitIdle(0ms));
+    EXPECT_EQ(0u, warmer.stats().runs);
+    EXPECT_TRUE(directory.names().empty());
+}
+
+} // namespace ldap
+} // namespace phosphor
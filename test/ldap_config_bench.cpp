@@ -0,0 +1,669 @@
+#include "config.h"
+
+#include "phosphor-ldap-config/ldap_config.hpp"
+#include "phosphor-ldap-config/ldap_config_mgr.hpp"
+
+#include <dlfcn.h>
+#include <netdb.h>
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+#include <unistd.h>
+
+#include <sdbusplus/bus.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+/* Runs ConfigMgr on a private bus against stand-ins for systemd and the
+ * certificate manager, which inject latency and failures:
+ *
+ *   dbus-run-session -- ./ldap_config_bench \
+ *       --benchmark_out=ldap_config_bench.json --benchmark_out_format=json
+ *
+ * Besides the time, every scenario reports per iteration how often systemd
+ * was asked to start, restart and stop a unit, how many jobs failed, how
+ * many files were replaced and synced, and how many host names were looked
+ * up. Without a session bus every benchmark is skipped.
+ */
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+/** @brief host names in this domain resolve to localhost, after dnsLatency */
+constexpr std::string_view benchDomain = ".bench.test";
+
+struct Tally
+{
+    /** @brief files replaced atomically, all of the daemon's writes but
+     *         journal appends */
+    std::atomic<uint64_t> renames = 0;
+    std::atomic<uint64_t> fsyncs = 0;
+    std::atomic<uint64_t> lookups = 0;
+};
+
+static Tally tally;
+static std::atomic<std::chrono::milliseconds> dnsLatency{0ms};
+
+template <typename Function>
+static Function next(const char* name)
+{
+    return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+}
+
+// The daemon's file and name service calls end up here instead of libc
+
+extern "C" int fsync(int fd)
+{
+    static auto real = next<int (*)(int)>("fsync");
+    ++tally.fsyncs;
+    return real(fd);
+}
+
+extern "C" int fdatasync(int fd)
+{
+    static auto real = next<int (*)(int)>("fdatasync");
+    ++tally.fsyncs;
+    return real(fd);
+}
+
+extern "C" int rename(const char* from, const char* to) noexcept
+{
+    static auto real = next<int (*)(const char*, const char*)>("rename");
+    ++tally.renames;
+    return real(from, to);
+}
+
+extern "C" int getaddrinfo(const char* node, const char* service,
+                           const addrinfo* hints, addrinfo** res)
+{
+    static auto real = next<int (*)(const char*, const char*,
+                                    const addrinfo*, addrinfo**)>(
+        "getaddrinfo");
+    ++tally.lookups;
+    std::string_view name = node != nullptr ? node : "";
+    if (!name.ends_with(benchDomain))
+    {
+        return real(node, service, hints, res);
+    }
+    std::this_thread::sleep_for(dnsLatency.load());
+    return real("127.0.0.1", service, hints, res);
+}
+
+/** @class StandInSystemd
+ *  @brief The unit methods and JobRemoved signal of systemd's manager, on
+ *         a connection of its own.
+ *  @details Every job is queued right away and done after 'jobLatency'.
+ */
+class StandInSystemd
+{
+  public:
+    explicit StandInSystemd(sd_event* event) :
+        bus(sdbusplus::bus::new_user()), event(event)
+    {
+        bus.attach_event(event, SD_EVENT_PRIORITY_NORMAL);
+        sd_bus_add_object_vtable(bus.get(), &slot, systemdObjPath,
+                                 systemdInterface, vtable, this);
+        bus.request_name(systemdBusname);
+    }
+
+    ~StandInSystemd()
+    {
+        for (auto& job : jobs)
+        {
+            sd_event_source_disable_unref(job.timer);
+        }
+        sd_bus_slot_unref(slot);
+        bus.detach_event();
+    }
+
+    StandInSystemd(const StandInSystemd&) = delete;
+    StandInSystemd& operator=(const StandInSystemd&) = delete;
+
+    /** @brief time from queueing a job to JobRemoved */
+    std::chrono::milliseconds jobLatency{0};
+    /** @brief every failEvery-th job fails, none if 0 */
+    uint32_t failEvery = 0;
+
+    /** @brief calls by method name */
+    std::map<std::string, uint64_t> calls;
+    uint64_t failedJobs = 0;
+
+  private:
+    static constexpr auto systemdBusname = "org.freedesktop.systemd1";
+    static constexpr auto systemdObjPath = "/org/freedesktop/systemd1";
+    static constexpr auto systemdInterface =
+        "org.freedesktop.systemd1.Manager";
+
+    struct Job
+    {
+        StandInSystemd* systemd;
+        uint32_t id;
+        std::string path;
+        std::string unit;
+        std::string result;
+        sd_event_source* timer = nullptr;
+    };
+
+    static int onUnitMethod(sd_bus_message* msg, void* userData,
+                            sd_bus_error* /*error*/)
+    {
+        auto& self = *static_cast<StandInSystemd*>(userData);
+        const char* unit = nullptr;
+        const char* mode = nullptr;
+        int r = sd_bus_message_read(msg, "ss", &unit, &mode);
+        if (r < 0)
+        {
+            return r;
+        }
+        ++self.calls[sd_bus_message_get_member(msg)];
+
+        auto id = ++self.lastJob;
+        bool fail = self.failEvery != 0 && id % self.failEvery == 0;
+        auto& job = self.jobs.emplace_back(
+            Job{&self, id, std::string(systemdObjPath) + "/job/" +
+                               std::to_string(id),
+                unit, fail ? "failed" : "done"});
+        // The reply goes out first, as the JobRemoved handler expects
+        sd_event_add_time_relative(
+            self.event, &job.timer, CLOCK_MONOTONIC,
+            std::chrono::microseconds(self.jobLatency).count(), 1000,
+            onJobDone, &job);
+        return sd_bus_reply_method_return(msg, "o", job.path.c_str());
+    }
+
+    static int onSubscribe(sd_bus_message* msg, void* /*userData*/,
+                           sd_bus_error* /*error*/)
+    {
+        return sd_bus_reply_method_return(msg, "");
+    }
+
+    static int onJobDone(sd_event_source* /*source*/, uint64_t /*usec*/,
+                         void* userData)
+    {
+        auto& job = *static_cast<Job*>(userData);
+        auto& self = *job.systemd;
+        if (job.result != "done")
+        {
+            ++self.failedJobs;
+        }
+        sd_bus_emit_signal(self.bus.get(), systemdObjPath, systemdInterface,
+                           "JobRemoved", "uoss", job.id, job.path.c_str(),
+                           job.unit.c_str(), job.result.c_str());
+        sd_event_source_disable_unref(job.timer);
+        self.jobs.remove_if([&job](const Job& j) { return &j == &job; });
+        return 0;
+    }
+
+    static constexpr sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("StartUnit", "ss", "o", onUnitMethod,
+                      SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("RestartUnit", "ss", "o", onUnitMethod,
+                      SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("StopUnit", "ss", "o", onUnitMethod,
+                      SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("Subscribe", "", "", onSubscribe,
+                      SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_SIGNAL("JobRemoved", "uoss", 0),
+        SD_BUS_VTABLE_END,
+    };
+
+    sdbusplus::bus_t bus;
+    sd_event* event;
+    sd_bus_slot* slot = nullptr;
+    uint32_t lastJob = 0;
+    std::list<Job> jobs;
+};
+
+/** @brief Emit what the certificate manager does when the LDAP client
+ *         certificate is replaced, 'count' signals in all
+ */
+static void replaceCertificate(sdbusplus::bus_t& bus, int count)
+{
+    using Properties = std::map<std::string, std::variant<std::string>>;
+    for (int i = 0; i < count; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            auto msg = bus.new_signal(certRootPath,
+                                      "org.freedesktop.DBus.ObjectManager",
+                                      "InterfacesAdded");
+            msg.append(sdbusplus::message::object_path(certObjPath),
+                       std::map<std::string, Properties>{
+                           {certIface, {{"CertificateString", "x"}}}});
+            msg.signal_send();
+        }
+        else
+        {
+            auto msg = bus.new_signal(certObjPath,
+                                      "org.freedesktop.DBus.Properties",
+                                      "PropertiesChanged");
+            msg.append(std::string(certIface),
+                       Properties{{"CertificateString", "x"}},
+                       std::vector<std::string>{});
+            msg.signal_send();
+        }
+    }
+}
+
+/** @class HarnessConfigMgr
+ *  @brief ConfigMgr with access to its configs, nscd left alone.
+ */
+class HarnessConfigMgr : public ConfigMgr
+{
+  public:
+    using ConfigMgr::ConfigMgr;
+    using ConfigMgr::createDefaultObjects;
+
+    void invalidateNameCache() override
+    {
+        ++invalidations;
+    }
+
+    Config& adConfig()
+    {
+        return *ADConfigPtr;
+    }
+
+    uint64_t invalidations = 0;
+};
+
+/** @class Harness
+ *  @brief An event loop, the stand-ins and a directory for the daemon's
+ *         files, for one benchmark.
+ */
+class Harness
+{
+  public:
+    Harness() :
+        event(newEvent()), bus(sdbusplus::bus::new_user()),
+        standIns(sdbusplus::bus::new_user()), systemd(event)
+    {
+        bus.attach_event(event, SD_EVENT_PRIORITY_NORMAL);
+        standIns.attach_event(event, SD_EVENT_PRIORITY_NORMAL);
+        char tmpDir[] = "/tmp/ldap-config-bench-XXXXXX";
+        dir = mkdtemp(tmpDir);
+        for (auto file : {defaultNslcdFile, nsSwitchFile, "ca.pem", "cert.pem"})
+        {
+            std::ofstream(dir / file);
+        }
+    }
+
+    ~Harness()
+    {
+        standIns.detach_event();
+        bus.detach_event();
+        fs::remove_all(dir);
+        sd_event_unref(event);
+    }
+
+    Harness(const Harness&) = delete;
+    Harness& operator=(const Harness&) = delete;
+
+    /** @brief false without a session bus to run on */
+    static bool available()
+    {
+        return std::getenv("DBUS_SESSION_BUS_ADDRESS") != nullptr;
+    }
+
+    /** @brief A manager on the harness' files and event loop
+     *  @param[in] window - debounce window, 0 to apply requests right away
+     */
+    std::unique_ptr<HarnessConfigMgr>
+        manager(std::chrono::microseconds window = 0us)
+    {
+        auto mgr = std::make_unique<HarnessConfigMgr>(
+            bus, LDAP_CONFIG_ROOT, (dir / "nslcd.conf").c_str(), dir.c_str(),
+            (dir / "ca.pem").c_str(), (dir / "cert.pem").c_str());
+        mgr->attachEvent(event, window);
+        return mgr;
+    }
+
+    /** @brief An enabled Active Directory config */
+    std::unique_ptr<HarnessConfigMgr>
+        enabledManager(std::chrono::microseconds window = 0us)
+    {
+        auto mgr = manager(window);
+        mgr->createConfig("ldap://127.0.0.1/", "cn=Users,dc=com",
+                          "cn=Users,dc=corp", "MyLdap12",
+                          CreateIface::SearchScope::sub,
+                          CreateIface::Type::ActiveDirectory, "uid", "gid");
+        mgr->adConfig().enabled(true);
+        return mgr;
+    }
+
+    /** @brief Run the event loop until 'done' or a timeout
+     *  @return false on timeout
+     */
+    bool runUntil(const std::function<bool()>& done,
+                  std::chrono::milliseconds timeout = 10s)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!done())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+            sd_event_run(event, 10000);
+        }
+        return true;
+    }
+
+    /** @brief Run until no nslcd job is pending any more */
+    bool settle(const ConfigMgr& mgr)
+    {
+        return runUntil([&mgr] {
+            return mgr.serviceStatus(nslcdService).state !=
+                   ServiceState::Pending;
+        });
+    }
+
+    /** @brief Report the counters since the last call, per iteration */
+    void report(benchmark::State& state)
+    {
+        auto snapshot = counters();
+        for (const auto& [name, value] : snapshot)
+        {
+            state.counters[name] = benchmark::Counter(
+                static_cast<double>(value - reported[name]),
+                benchmark::Counter::kAvgIterations);
+        }
+        reported = std::move(snapshot);
+    }
+
+    /** @brief Restart the counters, e.g. after the setup */
+    void resetCounters()
+    {
+        reported = counters();
+    }
+
+    static constexpr auto nslcdService = "nslcd.service";
+
+    sd_event* event;
+    sdbusplus::bus_t bus;
+    /** @brief the certificate manager's connection */
+    sdbusplus::bus_t standIns;
+    StandInSystemd systemd;
+    fs::path dir;
+
+  private:
+    static sd_event* newEvent()
+    {
+        sd_event* event = nullptr;
+        sd_event_new(&event);
+        return event;
+    }
+
+    std::map<std::string, uint64_t> counters() const
+    {
+        auto calls = [this](const char* method) {
+            auto it = systemd.calls.find(method);
+            return it != systemd.calls.end() ? it->second : 0;
+        };
+        return {
+            {"starts", calls("StartUnit")},
+            {"restarts", calls("RestartUnit")},
+            {"stops", calls("StopUnit")},
+            {"failedJobs", systemd.failedJobs},
+            {"filesWritten", tally.renames.load()},
+            {"fsyncs", tally.fsyncs.load()},
+            {"dnsLookups", tally.lookups.load()},
+        };
+    }
+
+    std::map<std::string, uint64_t> reported;
+};
+
+/** @brief Skip a benchmark without a session bus to run on */
+static bool skipWithoutBus(benchmark::State& state)
+{
+    if (!Harness::available())
+    {
+        state.SkipWithError("No session bus, run under dbus-run-session");
+        return true;
+    }
+    return false;
+}
+
+// Daemon start with 'range(0)' role mappings persisted
+static void BM_Restore(benchmark::State& state)
+{
+    if (skipWithoutBus(state))
+    {
+        return;
+    }
+    Harness harness;
+    {
+        auto mgr = harness.enabledManager();
+        RoleMappings mappings;
+        for (int64_t i = 0; i < state.range(0); ++i)
+        {
+            mappings.emplace_back("group" + std::to_string(i), "priv-user");
+        }
+        mgr->adConfig().createMany(std::move(mappings));
+        harness.settle(*mgr);
+    }
+    harness.resetCounters();
+
+    for (auto _ : state)
+    {
+        auto mgr = harness.manager();
+        mgr->restore();
+        state.PauseTiming();
+        if (!harness.settle(*mgr))
+        {
+            state.SkipWithError("nslcd start timed out");
+            break;
+        }
+        mgr.reset();
+        state.ResumeTiming();
+    }
+    harness.report(state);
+}
+BENCHMARK(BM_Restore)->Arg(10)->Arg(100)->Arg(1000)->Unit(
+    benchmark::kMillisecond);
+
+// Rendering nslcd.conf alone, the file differing every time
+static void BM_WriteConfig(benchmark::State& state)
+{
+    if (skipWithoutBus(state))
+    {
+        return;
+    }
+    Harness harness;
+    auto mgr = harness.enabledManager();
+    harness.settle(*mgr);
+    harness.resetCounters();
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        fs::remove(harness.dir / "nslcd.conf");
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(mgr->adConfig().writeConfig());
+    }
+    harness.report(state);
+}
+BENCHMARK(BM_WriteConfig);
+
+// A client setting three properties in a row, until nslcd is back with a
+// debounce window of 'range(0)' ms
+static void BM_PropertyBurst(benchmark::State& state)
+{
+    if (skipWithoutBus(state))
+    {
+        return;
+    }
+    Harness harness;
+    auto mgr =
+        harness.enabledManager(std::chrono::milliseconds(state.range(0)));
+    harness.settle(*mgr);
+    harness.resetCounters();
+
+    int round = 0;
+    for (auto _ : state)
+    {
+        auto suffix = std::to_string(++round);
+        auto& config = mgr->adConfig();
+        auto restarts = harness.systemd.calls["RestartUnit"];
+        config.ldapBaseDN("cn=Users" + suffix + ",dc=corp");
+        config.groupNameAttribute("gid" + suffix);
+        config.userNameAttribute("uid" + suffix);
+        if (!harness.runUntil([&] {
+                return harness.systemd.calls["RestartUnit"] > restarts &&
+                       mgr->serviceStatus(Harness::nslcdService).state !=
+                           ServiceState::Pending;
+            }))
+        {
+            state.SkipWithError("nslcd restart timed out");
+            break;
+        }
+    }
+    harness.report(state);
+}
+BENCHMARK(BM_PropertyBurst)
+    ->Arg(0)
+    ->Arg(50)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// The certificate manager replacing the client certificate with
+// 'range(0)' signals, until nslcd is back
+static void BM_CertificateBurst(benchmark::State& state)
+{
+    if (skipWithoutBus(state))
+    {
+        return;
+    }
+    Harness harness;
+    auto mgr = harness.enabledManager(50ms);
+    harness.settle(*mgr);
+    harness.resetCounters();
+
+    for (auto _ : state)
+    {
+        auto restarts = harness.systemd.calls["RestartUnit"];
+        replaceCertificate(harness.standIns, state.range(0));
+        if (!harness.runUntil([&] {
+                return harness.systemd.calls["RestartUnit"] > restarts &&
+                       mgr->serviceStatus(Harness::nslcdService).state !=
+                           ServiceState::Pending;
+            }))
+        {
+            state.SkipWithError("nslcd restart timed out");
+            break;
+        }
+    }
+    harness.report(state);
+}
+BENCHMARK(BM_CertificateBurst)
+    ->Arg(1)
+    ->Arg(3)
+    ->Arg(10)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// A forced nslcd restart with systemd taking 'range(0)' ms per job and
+// failing every 'range(1)'-th one
+static void BM_RestartSlowSystemd(benchmark::State& state)
+{
+    if (skipWithoutBus(state))
+    {
+        return;
+    }
+    Harness harness;
+    auto mgr = harness.enabledManager();
+    harness.settle(*mgr);
+    harness.systemd.jobLatency = std::chrono::milliseconds(state.range(0));
+    harness.systemd.failEvery = static_cast<uint32_t>(state.range(1));
+    harness.resetCounters();
+
+    for (auto _ : state)
+    {
+        mgr->requestConfigWrite(true);
+        if (!harness.settle(*mgr))
+        {
+            state.SkipWithError("nslcd restart timed out");
+            break;
+        }
+    }
+    harness.report(state);
+}
+BENCHMARK(BM_RestartSlowSystemd)
+    ->Args({0, 0})
+    ->Args({100, 0})
+    ->Args({100, 3})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// CreateConfig with the server's name taking 'range(0)' ms to resolve, the
+// D-Bus method blocks the daemon for as long
+static void BM_CreateConfigSlowDns(benchmark::State& state)
+{
+    if (skipWithoutBus(state))
+    {
+        return;
+    }
+    Harness harness;
+    auto mgr = harness.manager();
+    mgr->createDefaultObjects();
+    dnsLatency = std::chrono::milliseconds(state.range(0));
+    harness.resetCounters();
+
+    int round = 0;
+    uint64_t rejected = 0;
+    for (auto _ : state)
+    {
+        // A new name every time, resolved names are cached
+        auto uri = "ldap://server" + std::to_string(++round) +
+                   std::string(benchDomain) + "/";
+        try
+        {
+            mgr->createConfig(uri, "cn=Users,dc=com", "cn=Users,dc=corp",
+                              "MyLdap12", CreateIface::SearchScope::sub,
+                              CreateIface::Type::ActiveDirectory, "uid", "gid");
+        }
+        catch (const std::exception&)
+        {
+            ++rejected;
+        }
+    }
+    dnsLatency = 0ms;
+    harness.report(state);
+    state.counters["rejected"] = benchmark::Counter(
+        static_cast<double>(rejected), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_CreateConfigSlowDns)
+    ->Arg(0)
+    ->Arg(100)
+    ->Arg(3000)
+    ->Iterations(5)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace ldap
+} // namespace phosphor
+
+BENCHMARK_MAIN();
@@ -2,16 +2,27 @@
 
 #include "phosphor-ldap-config/ldap_config.hpp"
 #include "phosphor-ldap-config/ldap_config_mgr.hpp"
+#include "phosphor-ldap-config/ldap_mapper_serialize.hpp"
 
 #include <sys/types.h>
+#include <systemd/sd-event.h>
 
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
 #include <sdbusplus/bus.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 #include <xyz/openbmc_project/User/Common/error.hpp>
 
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -91,8 +102,15 @@ class MockConfigMgr : public phosphor::ldap::ConfigMgr
         phosphor::ldap::ConfigMgr(bus, path, filePath, dbusPersistentFile,
                                   caCertFile, certFile)
     {}
+    MOCK_METHOD1(startService, void(const std::string& service));
     MOCK_METHOD1(restartService, void(const std::string& service));
     MOCK_METHOD1(stopService, void(const std::string& service));
+    MOCK_METHOD0(invalidateNameCache, void());
+    using phosphor::ldap::ConfigMgr::jobQueued;
+    using phosphor::ldap::ConfigMgr::jobRemoved;
+    using phosphor::ldap::ConfigMgr::jobRequested;
+    using phosphor::ldap::ConfigMgr::certificateUpdated;
+    using phosphor::ldap::ConfigMgr::getMetricsProperty;
     std::unique_ptr<Config>& getOpenLdapConfigPtr()
     {
         return openLDAPConfigPtr;
@@ -144,7 +162,10 @@ TEST_F(TestLDAPConfig, testCreate)
 
     EXPECT_CALL(manager, stopService("nslcd.service")).Times(2);
     EXPECT_CALL(manager, restartService("nslcd.service")).Times(2);
-    EXPECT_CALL(manager, restartService("nscd.service")).Times(2);
+    // The cache is invalidated instead, whenever nslcd stops or gets
+    // another config
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(0);
+    EXPECT_CALL(manager, invalidateNameCache()).Times(4);
 
     manager.createConfig(
         "ldap://9.194.251.136/", "cn=Users,dc=com", "cn=Users,dc=corp",
@@ -263,8 +284,9 @@ TEST_F(TestLDAPConfig, testRestores)
                           dbusPersistentFilePath.c_str(),
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
         "MyLdap12", ldap_base::Create::SearchScope::sub,
@@ -294,6 +316,481 @@ TEST_F(TestLDAPConfig, testRestores)
     delete managerPtr;
 }
 
+TEST_F(TestLDAPConfig, unchangedConfigIsNotRewritten)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    if (fs::exists(configFilePath))
+    {
+        fs::remove(configFilePath);
+    }
+    EXPECT_FALSE(fs::exists(configFilePath));
+    MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                          dbusPersistentFilePath.c_str(),
+                          tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
+    EXPECT_CALL(manager, stopService("nslcd.service")).Times(1);
+    EXPECT_CALL(manager, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(manager, restartService("nslcd.service")).Times(2);
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(0);
+    manager.createConfig(
+        "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+        "MyLdap12", ldap_base::Create::SearchScope::sub,
+        ldap_base::Create::Type::ActiveDirectory, "attr1", "attr2");
+    manager.getADConfigPtr()->enabled(true);
+    auto permission = fs::perms::owner_read | fs::perms::owner_write |
+                      fs::perms::group_read;
+    EXPECT_EQ(fs::status(configFilePath).permissions(), permission);
+
+    // Same password renders the same file, nslcd keeps running
+    manager.getADConfigPtr()->ldapBindDNPassword("MyLdap12");
+    manager.restore();
+
+    // A file changed behind our back is rewritten and nslcd restarted
+    std::ofstream(configFilePath, std::ios::app) << "# local edit\n";
+    manager.restore();
+    EXPECT_EQ(fs::status(configFilePath).permissions(), permission);
+
+    // No temporary files are left behind
+    for (const auto& entry : fs::directory_iterator(dir))
+    {
+        EXPECT_FALSE(entry.path().filename().string().starts_with(
+            ldapConfFile + "."));
+    }
+}
+
+TEST_F(TestLDAPConfig, restartsAreCoalesced)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    if (fs::exists(configFilePath))
+    {
+        fs::remove(configFilePath);
+    }
+    EXPECT_FALSE(fs::exists(configFilePath));
+    sd_event* event = nullptr;
+    ASSERT_GE(sd_event_new(&event), 0);
+    {
+        MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                              dbusPersistentFilePath.c_str(),
+                              tlsCACertFilePath.c_str(),
+                              tlsCertFilePath.c_str());
+        manager.attachEvent(event, std::chrono::milliseconds(10));
+
+        // Configuring LDAP the way Redfish does, one property at a time
+        EXPECT_CALL(manager, stopService("nslcd.service")).Times(0);
+        EXPECT_CALL(manager, restartService("nslcd.service")).Times(1);
+        EXPECT_CALL(manager, restartService("nscd.service")).Times(0);
+        manager.createConfig(
+            "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+            "MyLdap12", ldap_base::Create::SearchScope::sub,
+            ldap_base::Create::Type::ActiveDirectory, "attr1", "attr2");
+        manager.getADConfigPtr()->enabled(true);
+        manager.getADConfigPtr()->ldapServerURI("ldap://9.194.251.139/");
+        manager.getADConfigPtr()->ldapBindDN("cn=Admin,dc=com");
+        manager.getADConfigPtr()->ldapBaseDN("cn=Users,dc=test");
+        manager.getADConfigPtr()->ldapSearchScope(
+            ldap_base::Config::SearchScope::one);
+        manager.getADConfigPtr()->userNameAttribute("uid");
+        EXPECT_FALSE(fs::exists(configFilePath));
+
+        ASSERT_GE(sd_event_run(event, 1000000), 0);
+        EXPECT_TRUE(fs::exists(configFilePath));
+        testing::Mock::VerifyAndClearExpectations(&manager);
+
+        // Disabling within the window wins over the pending restart
+        EXPECT_CALL(manager, stopService("nslcd.service")).Times(1);
+        EXPECT_CALL(manager, restartService("nslcd.service")).Times(0);
+        manager.getADConfigPtr()->ldapBindDN("cn=Other,dc=com");
+        manager.getADConfigPtr()->enabled(false);
+        ASSERT_GE(sd_event_run(event, 1000000), 0);
+    }
+    sd_event_unref(event);
+}
+
+TEST_F(TestLDAPConfig, certificateBurstRestartsOnce)
+{
+    using namespace std::chrono_literals;
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    sd_event* event = nullptr;
+    ASSERT_GE(sd_event_new(&event), 0);
+    {
+        testing::NiceMock<MockConfigMgr> manager(
+            bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+            dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+            tlsCertFilePath.c_str());
+        manager.attachEvent(event, 200ms);
+        manager.createConfig(
+            "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+            "MyLdap12", ldap_base::Create::SearchScope::sub,
+            ldap_base::Create::Type::ActiveDirectory, "uid", "gid");
+
+        // Nothing to reload without an enabled config
+        EXPECT_CALL(manager, restartService("nslcd.service")).Times(0);
+        manager.certificateUpdated();
+        EXPECT_EQ(0, sd_event_run(event, 0));
+        testing::Mock::VerifyAndClearExpectations(&manager);
+
+        manager.getADConfigPtr()->enabled(true);
+        ASSERT_GE(sd_event_run(event, 1000000), 0);
+
+        // A CA bundle replace: removed, added and changed in a row
+        EXPECT_CALL(manager, restartService("nslcd.service")).Times(1);
+        manager.certificateUpdated();
+        std::this_thread::sleep_for(150ms);
+        manager.certificateUpdated();
+        manager.certificateUpdated();
+        // Pushed out by the later signals
+        EXPECT_EQ(0, sd_event_run(event, 100000));
+        ASSERT_GT(sd_event_run(event, 1000000), 0);
+        testing::Mock::VerifyAndClearExpectations(&manager);
+    }
+    sd_event_unref(event);
+}
+
+TEST_F(TestLDAPConfig, restartsAreCountedByReason)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+    auto metricsFile = dir / "run" / "metrics";
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.startMetricsDump(metricsFile);
+    EXPECT_TRUE(fs::exists(metricsFile));
+
+    manager.createConfig("ldap://9.194.251.138/", "cn=Users,dc=com",
+                         "cn=Users,dc=corp", "MyLdap12",
+                         ldap_base::Create::SearchScope::sub,
+                         ldap_base::Create::Type::ActiveDirectory, "uid",
+                         "gid");
+    manager.getADConfigPtr()->create("admins", "priv-admin");
+    manager.getADConfigPtr()->enabled(true);
+    manager.getADConfigPtr()->ldapBaseDN("cn=Users,dc=corp2");
+    manager.certificateUpdated();
+
+    const auto& metrics = manager.metrics();
+    EXPECT_EQ(3u, metrics.nslcdRestarts());
+    EXPECT_EQ(2u, metrics.restarts(RestartReason::PropertySet));
+    EXPECT_EQ(1u, metrics.restarts(RestartReason::Certificate));
+    EXPECT_EQ(0u, metrics.restarts(RestartReason::Startup));
+    EXPECT_EQ(3u, metrics.latency(Operation::WriteConfig).count);
+    EXPECT_LT(0u, metrics.latency(Operation::Persist).count);
+
+    std::ifstream in(metricsFile);
+    std::string text((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    EXPECT_EQ(manager.metricsText(), text);
+    EXPECT_NE(std::string::npos,
+              text.find("phosphor_ldap_mapper_entries"
+                        "{config=\"active_directory\"} 1\n"));
+}
+
+TEST_F(TestLDAPConfig, metricsAreOnTheDebugInterface)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createConfig("ldap://9.194.251.138/", "cn=Users,dc=com",
+                         "cn=Users,dc=corp", "MyLdap12",
+                         ldap_base::Create::SearchScope::sub,
+                         ldap_base::Create::Type::ActiveDirectory, "uid",
+                         "gid");
+    manager.getADConfigPtr()->create("admins", "priv-admin");
+    manager.getADConfigPtr()->enabled(true);
+
+    // What sd-bus does for a Get of the property
+    auto get = [this, &manager](const char* property, auto& value) {
+        auto msg = bus.new_signal(LDAP_CONFIG_ROOT, debugMetricsIface, "Get");
+        ConfigMgr* mgr = &manager;
+        ASSERT_LE(0, MockConfigMgr::getMetricsProperty(
+                         bus.get(), LDAP_CONFIG_ROOT, debugMetricsIface,
+                         property, msg.get(), mgr, nullptr));
+        ASSERT_LE(0, sd_bus_message_seal(msg.get(), 1, 0));
+        ASSERT_LE(0, sd_bus_message_rewind(msg.get(), true));
+        msg.read(value);
+    };
+
+    const auto& metrics = manager.metrics();
+    uint64_t restarts = 0;
+    get("NslcdRestarts", restarts);
+    EXPECT_EQ(metrics.nslcdRestarts(), restarts);
+
+    std::map<std::string, uint64_t> reasons;
+    get("NslcdRestartReasons", reasons);
+    EXPECT_EQ(metrics.restarts(RestartReason::PropertySet),
+              reasons["property_set"]);
+
+    std::map<std::string,
+             std::tuple<std::vector<uint64_t>, uint64_t, uint64_t>>
+        latencies;
+    get("OperationLatency", latencies);
+    const auto& writeConfig = metrics.latency(Operation::WriteConfig);
+    ASSERT_EQ(1u, latencies.count(toString(Operation::WriteConfig)));
+    const auto& [buckets, count, sum] =
+        latencies[toString(Operation::WriteConfig)];
+    EXPECT_EQ(writeConfig.buckets.size(), buckets.size());
+    EXPECT_EQ(writeConfig.count, count);
+    EXPECT_EQ(static_cast<uint64_t>(writeConfig.sum.count()), sum);
+
+    std::vector<uint64_t> bounds;
+    get("LatencyBuckets", bounds);
+    EXPECT_EQ(latencyBuckets.size(), bounds.size());
+
+    std::map<std::string, uint64_t> mapperEntries;
+    get("MapperEntries", mapperEntries);
+    EXPECT_EQ(1u, mapperEntries["active_directory"]);
+}
+
+TEST_F(TestLDAPConfig, persistIsDelayedAndChecked)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+    fs::path persistFile = dbusPersistentFilePath + LDAP_CONFIG_ROOT +
+                           "/active_directory/config";
+
+    sd_event* event = nullptr;
+    ASSERT_GE(sd_event_new(&event), 0);
+    {
+        testing::NiceMock<MockConfigMgr> manager(
+            bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+            dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+            tlsCertFilePath.c_str());
+        manager.attachEvent(event, std::chrono::microseconds(0),
+                            std::chrono::milliseconds(10));
+        manager.createConfig(
+            "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+            "MyLdap12", ldap_base::Create::SearchScope::sub,
+            ldap_base::Create::Type::ActiveDirectory, "uid", "gid");
+        auto& config = *manager.getADConfigPtr();
+        config.ldapBindDN("cn=Admin,dc=com");
+        config.ldapBaseDN("cn=Users,dc=test");
+        EXPECT_FALSE(fs::exists(persistFile));
+        EXPECT_TRUE(config.persistPending());
+
+        // All changes are written together once the delay expired
+        ASSERT_GE(sd_event_run(event, 1000000), 0);
+        EXPECT_TRUE(fs::exists(persistFile));
+        EXPECT_FALSE(config.persistPending());
+        EXPECT_TRUE(config.deserialize());
+        EXPECT_EQ("cn=Admin,dc=com", config.ldapBindDN());
+
+        // A file written without the header is still read, and upgraded
+        std::string content;
+        {
+            std::ifstream is(persistFile, std::ios::binary);
+            content.assign(std::istreambuf_iterator<char>(is), {});
+        }
+        {
+            std::ofstream os(persistFile, std::ios::binary | std::ios::trunc);
+            os << content.substr(4 * sizeof(uint32_t));
+        }
+        EXPECT_TRUE(config.deserialize());
+        EXPECT_TRUE(config.persistPending());
+        manager.flushPersist();
+        EXPECT_EQ(content.size(), fs::file_size(persistFile));
+
+        // A corrupted file is set aside instead of being loaded
+        {
+            std::ofstream os(persistFile, std::ios::binary | std::ios::trunc);
+            content.back() ^= 1;
+            os << content;
+        }
+        EXPECT_FALSE(config.deserialize());
+        EXPECT_FALSE(fs::exists(persistFile));
+        EXPECT_TRUE(fs::exists(persistFile.string() + ".corrupt"));
+
+        // Changes still waiting for the delay are written on destruction
+        config.ldapBindDN("cn=Last,dc=com");
+        EXPECT_FALSE(fs::exists(persistFile));
+    }
+    sd_event_unref(event);
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    EXPECT_TRUE(manager.getADConfigPtr()->deserialize());
+    EXPECT_EQ("cn=Last,dc=com", manager.getADConfigPtr()->ldapBindDN());
+}
+
+TEST_F(TestLDAPConfig, serviceReadyFollowsJobs)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                          dbusPersistentFilePath.c_str(),
+                          tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
+    EXPECT_EQ(manager.serviceStatus("nslcd.service").state,
+              ServiceState::Ready);
+
+    manager.jobRequested("nslcd.service");
+    EXPECT_EQ(manager.serviceStatus("nslcd.service").state,
+              ServiceState::Pending);
+    std::optional<ServiceStatus> notified;
+    manager.whenServiceReady("nslcd.service",
+                             [&notified](const ServiceStatus& status) {
+                                 notified = status;
+                             });
+
+    // Jobs of other services don't count
+    manager.jobQueued("nslcd.service", "/org/freedesktop/systemd1/job/42");
+    manager.jobRemoved("/org/freedesktop/systemd1/job/41", "done");
+    EXPECT_FALSE(notified);
+
+    manager.jobRemoved("/org/freedesktop/systemd1/job/42", "done");
+    ASSERT_TRUE(notified);
+    EXPECT_EQ(notified->state, ServiceState::Ready);
+    EXPECT_EQ(notified->result, "done");
+    EXPECT_GE(notified->duration.count(), 0);
+
+    manager.jobRequested("nslcd.service");
+    manager.jobQueued("nslcd.service", "/org/freedesktop/systemd1/job/43");
+    manager.jobRemoved("/org/freedesktop/systemd1/job/43", "failed");
+    EXPECT_EQ(manager.serviceStatus("nslcd.service").state,
+              ServiceState::Failed);
+
+    // Nothing pending, the callback runs right away
+    notified.reset();
+    manager.whenServiceReady("nslcd.service",
+                             [&notified](const ServiceStatus& status) {
+                                 notified = status;
+                             });
+    ASSERT_TRUE(notified);
+    EXPECT_EQ(notified->result, "failed");
+}
+
+TEST_F(TestLDAPConfig, updateConfigAppliesAllOrNothing)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    if (fs::exists(configFilePath))
+    {
+        fs::remove(configFilePath);
+    }
+    EXPECT_FALSE(fs::exists(configFilePath));
+    MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                          dbusPersistentFilePath.c_str(),
+                          tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
+    EXPECT_CALL(manager, stopService("nslcd.service")).Times(1);
+    EXPECT_CALL(manager, restartService("nslcd.service")).Times(2);
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(0);
+    manager.createConfig(
+        "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+        "MyLdap12", ldap_base::Create::SearchScope::sub,
+        ldap_base::Create::Type::ActiveDirectory, "attr1", "attr2");
+    manager.getADConfigPtr()->enabled(true);
+
+    // One restart for all of them
+    manager.getADConfigPtr()->updateConfig({
+        {"LDAPServerURI", std::string("ldap://9.194.251.139/")},
+        {"LDAPBindDN", std::string("cn=Admin,dc=com")},
+        {"LDAPBaseDN", std::string("cn=Users,dc=test")},
+        {"LDAPSearchScope", ldap_base::Config::SearchScope::one},
+        {"LDAPBindDNPassword", std::string("MyLdap13")},
+    });
+    EXPECT_EQ(manager.getADConfigPtr()->ldapServerURI(),
+              "ldap://9.194.251.139/");
+    EXPECT_EQ(manager.getADConfigPtr()->ldapBindDN(), "cn=Admin,dc=com");
+    EXPECT_EQ(manager.getADConfigPtr()->ldapBaseDN(), "cn=Users,dc=test");
+    EXPECT_EQ(manager.getADConfigPtr()->ldapSearchScope(),
+              ldap_base::Config::SearchScope::one);
+    EXPECT_EQ(manager.configBindPassword(), "MyLdap13");
+
+    // An invalid value leaves every property alone
+    EXPECT_THROW(manager.getADConfigPtr()->updateConfig({
+                     {"LDAPBindDN", std::string("cn=Other,dc=com")},
+                     {"LDAPBaseDN", std::string("")},
+                 }),
+                 InvalidArgument);
+    EXPECT_THROW(manager.getADConfigPtr()->updateConfig({
+                     {"LDAPBindDN", std::string("cn=Other,dc=com")},
+                     {"LDAPBaseDN", ldap_base::Config::SearchScope::sub},
+                 }),
+                 InvalidArgument);
+    EXPECT_THROW(manager.getADConfigPtr()->updateConfig({
+                     {"LDAPType", ldap_base::Config::Type::OpenLdap},
+                 }),
+                 NotAllowed);
+    EXPECT_EQ(manager.getADConfigPtr()->ldapBindDN(), "cn=Admin,dc=com");
+    EXPECT_EQ(manager.getADConfigPtr()->ldapBaseDN(), "cn=Users,dc=test");
+
+    // Unchanged values don't restart anything
+    manager.getADConfigPtr()->updateConfig({
+        {"LDAPBindDN", std::string("cn=Admin,dc=com")},
+    });
+
+    // And the batch is persisted
+    manager.restore();
+    EXPECT_EQ(manager.getADConfigPtr()->ldapBindDN(), "cn=Admin,dc=com");
+    EXPECT_EQ(manager.configBindPassword(), "MyLdap13");
+}
+
+TEST_F(TestLDAPConfig, updateConfigOnUnconfiguredObject)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    auto& config = *manager.getOpenLdapConfigPtr();
+    ASSERT_TRUE(config.ldapBindDN().empty());
+    ASSERT_TRUE(config.ldapBaseDN().empty());
+
+    // The DNs are only checked when they are part of the update
+    config.updateConfig({
+        {"LDAPServerURI", std::string("ldap://9.194.251.138/")},
+    });
+    config.updateConfig({
+        {"LDAPSearchScope", ldap_base::Config::SearchScope::one},
+    });
+    EXPECT_EQ(config.ldapServerURI(), "ldap://9.194.251.138/");
+    EXPECT_EQ(config.ldapSearchScope(), ldap_base::Config::SearchScope::one);
+
+    config.updateConfig({
+        {"LDAPBindDN", std::string("cn=Admin,dc=com")},
+        {"LDAPBaseDN", std::string("dc=corp")},
+    });
+    EXPECT_THROW(config.updateConfig({
+                     {"LDAPBindDN", std::string("")},
+                 }),
+                 InvalidArgument);
+    EXPECT_EQ(config.ldapBindDN(), "cn=Admin,dc=com");
+}
+
 TEST_F(TestLDAPConfig, testLDAPServerURI)
 {
     auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
@@ -312,8 +809,9 @@ TEST_F(TestLDAPConfig, testLDAPServerURI)
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
 
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(3);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
 
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
@@ -343,6 +841,477 @@ TEST_F(TestLDAPConfig, testLDAPServerURI)
     delete managerPtr;
 }
 
+TEST_F(TestLDAPConfig, severalServersAreWrittenInOrder)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    EXPECT_THROW(manager.createConfig(
+                     "ldap://9.194.251.138/ ldaps://9.194.251.139/",
+                     "cn=Users,dc=com", "cn=Users,dc=corp", "MyLdap12",
+                     ldap_base::Create::SearchScope::sub,
+                     ldap_base::Create::Type::ActiveDirectory, "uid", "gid"),
+                 InvalidArgument);
+    manager.createConfig(
+        "ldap://9.194.251.138/ ldap://9.194.251.139/", "cn=Users,dc=com",
+        "cn=Users,dc=corp", "MyLdap12", ldap_base::Create::SearchScope::sub,
+        ldap_base::Create::Type::ActiveDirectory, "uid", "gid");
+    auto& config = *manager.getADConfigPtr();
+    config.enabled(true);
+
+    auto uriLines = [&configFilePath]() {
+        std::ifstream is(configFilePath);
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(is, line);)
+        {
+            if (line.starts_with("uri "))
+            {
+                lines.push_back(line);
+            }
+        }
+        return lines;
+    };
+    std::vector<std::string> expected = {"uri ldap://9.194.251.138/",
+                                         "uri ldap://9.194.251.139/"};
+    EXPECT_EQ(expected, uriLines());
+
+    // Measured order, only for the servers configured
+    EXPECT_FALSE(config.orderServers({"ldap://9.194.251.140/",
+                                      "ldap://9.194.251.138/"}));
+    EXPECT_TRUE(config.orderServers({"ldap://9.194.251.139/",
+                                     "ldap://9.194.251.138/"}));
+    EXPECT_EQ("ldap://9.194.251.139/", config.probeTarget().uri);
+    EXPECT_TRUE(config.writeConfig());
+    expected = {"uri ldap://9.194.251.139/", "uri ldap://9.194.251.138/"};
+    EXPECT_EQ(expected, uriLines());
+
+    // A new server list drops the measured order
+    config.ldapServerURI("ldap://9.194.251.138/ ldap://9.194.251.141/");
+    expected = {"uri ldap://9.194.251.138/", "uri ldap://9.194.251.141/"};
+    EXPECT_EQ(expected, uriLines());
+    EXPECT_EQ(2u, config.probeTargets().size());
+}
+
+TEST_F(TestLDAPConfig, nslcdTuningIsValidatedAndPersisted)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    auto readConfig = [&configFilePath]() {
+        std::ifstream is(configFilePath);
+        return std::string(std::istreambuf_iterator<char>(is), {});
+    };
+
+    NslcdTuning tuning;
+    {
+        testing::NiceMock<MockConfigMgr> manager(
+            bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+            dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+            tlsCertFilePath.c_str());
+        manager.createConfig(
+            "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+            "MyLdap12", ldap_base::Create::SearchScope::sub,
+            ldap_base::Create::Type::ActiveDirectory, "uid", "gid");
+        auto& config = *manager.getADConfigPtr();
+        config.enabled(true);
+        EXPECT_NE(std::string::npos,
+                  readConfig().find("timelimit 10\nbind_timelimit 5\n"
+                                    "idle_timelimit 60\n"
+                                    "reconnect_sleeptime 1\n"
+                                    "reconnect_retrytime 10\nthreads 2\n"
+                                    "pagesize 1000\n"));
+
+        tuning.bindTimelimit = 0;
+        EXPECT_THROW(config.tuning(tuning), InvalidArgument);
+        tuning.bindTimelimit = 3;
+        tuning.reconnectRetrytime = 0;
+        EXPECT_THROW(config.tuning(tuning), InvalidArgument);
+        tuning.reconnectRetrytime = 30;
+        tuning.threads = 17;
+        EXPECT_THROW(config.tuning(tuning), InvalidArgument);
+        // Nothing applied from the rejected settings
+        EXPECT_EQ(NslcdTuning{}, config.tuning());
+
+        tuning.threads = 4;
+        config.tuning(tuning);
+        EXPECT_EQ(tuning, config.tuning());
+        auto content = readConfig();
+        EXPECT_NE(std::string::npos, content.find("bind_timelimit 3\n"));
+        EXPECT_NE(std::string::npos,
+                  content.find("reconnect_retrytime 30\n"));
+        EXPECT_NE(std::string::npos, content.find("threads 4\n"));
+    }
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    EXPECT_TRUE(manager.getADConfigPtr()->deserialize());
+    EXPECT_EQ(tuning, manager.getADConfigPtr()->tuning());
+}
+
+TEST_F(TestLDAPConfig, nssShapingIsRendered)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    auto readConfig = [&configFilePath]() {
+        std::ifstream is(configFilePath);
+        return std::string(std::istreambuf_iterator<char>(is), {});
+    };
+
+    NssShaping shaping;
+    {
+        testing::NiceMock<MockConfigMgr> manager(
+            bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+            dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+            tlsCertFilePath.c_str());
+        manager.createConfig(
+            "ldap://9.194.251.138/", "cn=Users,dc=com", "dc=corp",
+            "MyLdap12", ldap_base::Create::SearchScope::sub,
+            ldap_base::Create::Type::OpenLdap, "uid", "gid");
+        auto& config = *manager.getOpenLdapConfigPtr();
+        config.enabled(true);
+
+        // Local accounts and enumerations stay local by default
+        auto content = readConfig();
+        EXPECT_NE(std::string::npos,
+                  content.find("base passwd dc=corp\nbase shadow dc=corp\n"
+                               "base group dc=corp\n"));
+        EXPECT_NE(std::string::npos,
+                  content.find("filter passwd (objectclass=posixAccount)\n"));
+        EXPECT_NE(std::string::npos,
+                  content.find("nss_min_uid 1000\n"
+                               "nss_disable_enumeration yes\n"));
+        EXPECT_EQ(std::string::npos, content.find("nss_getgrent_skipmembers"));
+
+        shaping.groupBase = "groups";
+        EXPECT_THROW(config.nssShaping(shaping), InvalidArgument);
+        shaping.groupBase = "ou=groups,dc=corp";
+        shaping.groupFilter = "objectclass=posixGroup";
+        EXPECT_THROW(config.nssShaping(shaping), InvalidArgument);
+        EXPECT_EQ(NssShaping{}, config.nssShaping());
+
+        shaping.passwdBase = "ou=people,dc=corp";
+        shaping.groupFilter = "(&(objectclass=posixGroup)(cn=bmc-*))";
+        shaping.minUid = 0;
+        shaping.skipMembers = true;
+        shaping.disableEnumeration = false;
+        config.nssShaping(shaping);
+        content = readConfig();
+        EXPECT_NE(std::string::npos,
+                  content.find("base passwd ou=people,dc=corp\n"
+                               "base shadow ou=people,dc=corp\n"
+                               "base group ou=groups,dc=corp\n"));
+        EXPECT_NE(std::string::npos,
+                  content.find("filter group "
+                               "(&(objectclass=posixGroup)(cn=bmc-*))\n"));
+        EXPECT_EQ(std::string::npos, content.find("nss_min_uid"));
+        EXPECT_EQ(std::string::npos, content.find("nss_disable_enumeration"));
+        EXPECT_NE(std::string::npos,
+                  content.find("nss_getgrent_skipmembers yes\n"));
+    }
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    EXPECT_TRUE(manager.getOpenLdapConfigPtr()->deserialize());
+    EXPECT_EQ(shaping, manager.getOpenLdapConfigPtr()->nssShaping());
+}
+
+TEST_F(TestLDAPConfig, legacyConfigKeepsNssLookups)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    // Persisted by a version without the NSS settings: the class version
+    // and the fields of version 1, unframed
+    fs::path persistPath = dbusPersistentFilePath + openLDAPDbusObjectPath;
+    fs::create_directories(persistPath);
+    {
+        std::ofstream os(persistPath / "config", std::ios::binary);
+        cereal::BinaryOutputArchive archive(os);
+        archive(uint32_t{1}, true, std::string("ldap://9.194.251.138/"),
+                std::string("cn=Users,dc=com"), std::string("dc=corp"),
+                ldap_base::Config::SearchScope::sub, std::string("MyLdap12"),
+                std::string("uid"), std::string("gid"));
+    }
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.restore();
+    auto& config = *manager.getOpenLdapConfigPtr();
+    ASSERT_TRUE(config.enabled());
+    EXPECT_EQ(legacyNssShaping(ldap_base::Config::Type::OpenLdap),
+              config.nssShaping());
+
+    std::ifstream is(configFilePath);
+    std::string content(std::istreambuf_iterator<char>(is), {});
+    EXPECT_NE(std::string::npos,
+              content.find("filter passwd (objectclass=*)\n"));
+    EXPECT_EQ(std::string::npos, content.find("nss_min_uid"));
+    EXPECT_EQ(std::string::npos, content.find("nss_disable_enumeration"));
+}
+
+TEST_F(TestLDAPConfig, legacyConfigKeepsNslcdLimits)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    // Persisted by a version with the limits hard-coded
+    fs::path persistPath = dbusPersistentFilePath + adDbusObjectPath;
+    fs::create_directories(persistPath);
+    {
+        std::ofstream os(persistPath / "config", std::ios::binary);
+        cereal::BinaryOutputArchive archive(os);
+        archive(uint32_t{1}, true, std::string("ldap://9.194.251.138/"),
+                std::string("cn=Users,dc=com"), std::string("dc=corp"),
+                ldap_base::Config::SearchScope::sub, std::string("MyLdap12"),
+                std::string("uid"), std::string("gid"));
+    }
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.restore();
+    auto& config = *manager.getADConfigPtr();
+    ASSERT_TRUE(config.enabled());
+    EXPECT_EQ(legacyNslcdTuning(), config.tuning());
+
+    std::ifstream is(configFilePath);
+    std::string content(std::istreambuf_iterator<char>(is), {});
+    EXPECT_NE(std::string::npos,
+              content.find("timelimit 30\nbind_timelimit 30\n"
+                           "pagesize 1000\n"));
+    for (const auto& setting : {"idle_timelimit", "reconnect_sleeptime",
+                                "reconnect_retrytime", "threads"})
+    {
+        EXPECT_EQ(std::string::npos, content.find(setting)) << setting;
+    }
+
+    // Changing one limit keeps the others as they were
+    auto tuning = config.tuning();
+    tuning.timelimit = 60;
+    config.tuning(tuning);
+    EXPECT_EQ(tuning, config.tuning());
+}
+
+TEST_F(TestLDAPConfig, nscdIsInvalidatedAndTuned)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+    auto nscdConfigPath = dir / nscdConfFile;
+    {
+        std::ofstream os(nscdConfigPath);
+        os << "# nscd config\n"
+              "\tenable-cache\t\tpasswd\t\tyes\n"
+              "\tpositive-time-to-live\tpasswd\t\t600\n"
+              "\tenable-cache\t\thosts\t\tyes\n"
+              "\tpositive-time-to-live\thosts\t\t3600\n";
+    }
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(0);
+    EXPECT_CALL(manager, invalidateNameCache()).Times(1);
+    manager.createConfig(
+        "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+        "MyLdap12", ldap_base::Create::SearchScope::sub,
+        ldap_base::Create::Type::ActiveDirectory, "uid", "gid");
+    testing::Mock::VerifyAndClearExpectations(&manager);
+
+    // The missing TTLs are added, which takes an nscd restart
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(manager, invalidateNameCache()).Times(0);
+    auto& config = *manager.getADConfigPtr();
+    config.enabled(true);
+    testing::Mock::VerifyAndClearExpectations(&manager);
+    std::string expected = "# nscd config\n"
+                           "\tenable-cache\t\tpasswd\t\tyes\n"
+                           "\tpositive-time-to-live\tpasswd\t\t600\n"
+                           "\tenable-cache\t\thosts\t\tyes\n"
+                           "\tpositive-time-to-live\thosts\t\t3600\n"
+                           "\tnegative-time-to-live\tpasswd\t\t20\n"
+                           "\tpositive-time-to-live\tgroup\t\t3600\n"
+                           "\tnegative-time-to-live\tgroup\t\t60\n";
+    auto readNscdConfig = [&nscdConfigPath]() {
+        std::ifstream is(nscdConfigPath);
+        return std::string(std::istreambuf_iterator<char>(is), {});
+    };
+    EXPECT_EQ(expected, readNscdConfig());
+
+    // An unchanged nslcd.conf leaves the cache alone
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(0);
+    EXPECT_CALL(manager, invalidateNameCache()).Times(0);
+    config.ldapBindDNPassword("MyLdap12");
+    testing::Mock::VerifyAndClearExpectations(&manager);
+
+    // A changed one drops the cached passwd and group entries only
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(0);
+    EXPECT_CALL(manager, invalidateNameCache()).Times(1);
+    config.ldapBaseDN("cn=Users,dc=test");
+    testing::Mock::VerifyAndClearExpectations(&manager);
+
+    NscdTtl ttl;
+    ttl.groupNegative = 3601;
+    EXPECT_THROW(config.nscdTtl(ttl), InvalidArgument);
+    ttl.groupNegative = 5;
+    ttl.passwdPositive = 300;
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(manager, invalidateNameCache()).Times(0);
+    config.nscdTtl(ttl);
+    testing::Mock::VerifyAndClearExpectations(&manager);
+    EXPECT_NE(std::string::npos,
+              readNscdConfig().find(
+                  "\tpositive-time-to-live\tpasswd\t\t300\n"));
+    EXPECT_NE(std::string::npos,
+              readNscdConfig().find("\tnegative-time-to-live\tgroup\t\t5\n"));
+    EXPECT_NE(std::string::npos,
+              readNscdConfig().find(
+                  "\tpositive-time-to-live\thosts\t\t3600\n"));
+}
+
+TEST_F(TestLDAPConfig, failedJobDoesNotDropOtherActions)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+    {
+        // Missing TTLs, so enabling restarts nscd along with nslcd
+        std::ofstream os(dir / nscdConfFile);
+        os << "\tenable-cache\t\tpasswd\t\tyes\n";
+    }
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createConfig(
+        "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+        "MyLdap12", ldap_base::Create::SearchScope::sub,
+        ldap_base::Create::Type::ActiveDirectory, "uid", "gid");
+
+    EXPECT_CALL(manager, restartService("nslcd.service"))
+        .WillOnce(testing::Throw(InternalFailure()));
+    EXPECT_CALL(manager, restartService("nscd.service")).Times(1);
+    EXPECT_NO_THROW(manager.getADConfigPtr()->enabled(true));
+    testing::Mock::VerifyAndClearExpectations(&manager);
+    EXPECT_EQ(manager.serviceStatus("nslcd.service").state,
+              ServiceState::Failed);
+    EXPECT_EQ(0u, manager.metrics().nslcdRestarts());
+}
+
+TEST_F(TestLDAPConfig, warmUpUsersAreValidatedAndPersisted)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    std::vector<std::string> users = {"alice", "bob.smith", "svc_backup"};
+    {
+        testing::NiceMock<MockConfigMgr> manager(
+            bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+            dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+            tlsCertFilePath.c_str());
+        manager.createConfig(
+            "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
+            "MyLdap12", ldap_base::Create::SearchScope::sub,
+            ldap_base::Create::Type::ActiveDirectory, "uid", "gid");
+        auto& config = *manager.getADConfigPtr();
+        EXPECT_TRUE(config.warmUpUsers().empty());
+
+        EXPECT_THROW(config.warmUpUsers({"alice", "bad user"}),
+                     InvalidArgument);
+        EXPECT_THROW(config.warmUpUsers({""}), InvalidArgument);
+        EXPECT_THROW(config.warmUpUsers(std::vector<std::string>(
+                         maxWarmUpUsers + 1, "alice")),
+                     InvalidArgument);
+        EXPECT_TRUE(config.warmUpUsers().empty());
+
+        config.warmUpUsers(users);
+        EXPECT_EQ(users, config.warmUpUsers());
+        // Without warm-up enabled there are no statistics
+        EXPECT_FALSE(manager.warmUpStats());
+    }
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    EXPECT_TRUE(manager.getADConfigPtr()->deserialize());
+    EXPECT_EQ(users, manager.getADConfigPtr()->warmUpUsers());
+}
+
+TEST_F(TestLDAPConfig, groupSearchFollowsNslcdConf)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    testing::NiceMock<MockConfigMgr> manager(
+        bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+        dbusPersistentFilePath.c_str(), tlsCACertFilePath.c_str(),
+        tlsCertFilePath.c_str());
+    manager.createConfig("ldap://9.194.251.138/ ldap://9.194.251.139/",
+                         "cn=Users,dc=com", "cn=Users,dc=corp", "MyLdap12",
+                         ldap_base::Create::SearchScope::one,
+                         ldap_base::Create::Type::ActiveDirectory, "uid",
+                         "gid");
+    auto& config = *manager.getADConfigPtr();
+    NssShaping shaping;
+    shaping.groupBase = "ou=groups,dc=corp";
+    config.nssShaping(shaping);
+    config.enabled(true);
+
+    auto search = config.groupSearch();
+    EXPECT_EQ("ldap://9.194.251.138/ ldap://9.194.251.139/", search.uris);
+    EXPECT_EQ("cn=Users,dc=com", search.bindDN);
+    EXPECT_EQ("MyLdap12", search.bindPassword);
+    EXPECT_EQ(GroupSearch::Scope::One, search.scope);
+    EXPECT_TRUE(search.activeDirectory);
+    EXPECT_FALSE(search.domainSid.empty());
+    EXPECT_EQ("cn=Users,dc=corp", search.userBase);
+    EXPECT_EQ("ou=groups,dc=corp", search.groupBase);
+    // nslcd maps the group name from the user name attribute on AD
+    EXPECT_EQ("uid", search.userNameAttribute);
+    EXPECT_EQ("uid", search.groupNameAttribute);
+    // Same filters as nslcd.conf
+    std::ifstream is(configFilePath);
+    std::string content(std::istreambuf_iterator<char>(is), {});
+    EXPECT_NE(std::string::npos,
+              content.find("filter group " + search.groupFilter + "\n"));
+    EXPECT_NE(std::string::npos,
+              content.find("filter passwd " + search.userFilter + "\n"));
+}
+
 TEST_F(TestLDAPConfig, testLDAPBindDN)
 {
     auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
@@ -361,8 +1330,9 @@ TEST_F(TestLDAPConfig, testLDAPBindDN)
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
 
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(3);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
 
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
@@ -413,8 +1383,9 @@ TEST_F(TestLDAPConfig, testLDAPBaseDN)
                           dbusPersistentFilePath.c_str(),
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(3);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
         "MyLdap12", ldap_base::Create::SearchScope::sub,
@@ -463,8 +1434,9 @@ TEST_F(TestLDAPConfig, testSearchScope)
                           dbusPersistentFilePath.c_str(),
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(3);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
         "MyLdap12", ldap_base::Create::SearchScope::sub,
@@ -502,8 +1474,9 @@ TEST_F(TestLDAPConfig, testLDAPType)
                           dbusPersistentFilePath.c_str(),
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
         "MyLdap12", ldap_base::Create::SearchScope::sub,
@@ -542,8 +1515,9 @@ TEST_F(TestLDAPConfig, testsecureLDAPRestore)
                           dbusPersistentFilePath.c_str(),
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, startService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
     managerPtr->createConfig(
         "ldaps://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
         "MyLdap12", ldap_base::Create::SearchScope::sub,
@@ -575,7 +1549,7 @@ TEST_F(TestLDAPConfig, filePermission)
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(1);
     EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(1);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(1);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
         "MyLdap12", ldap_base::Create::SearchScope::sub,
@@ -612,7 +1586,7 @@ TEST_F(TestLDAPConfig, ConditionalEnableConfig)
                           tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
     EXPECT_CALL(*managerPtr, stopService("nslcd.service")).Times(3);
     EXPECT_CALL(*managerPtr, restartService("nslcd.service")).Times(2);
-    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(2);
+    EXPECT_CALL(*managerPtr, restartService("nscd.service")).Times(0);
     managerPtr->createConfig(
         "ldap://9.194.251.138/", "cn=Users,dc=com", "cn=Users,dc=corp",
         "MyLdap12", ldap_base::Create::SearchScope::sub,
@@ -738,6 +1712,47 @@ TEST_F(TestLDAPConfig, deletePrivMapping)
     eventLoop(2);
 }
 
+TEST_F(TestLDAPConfig, privMappingsOfEnabledConfig)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    if (fs::exists(configFilePath))
+    {
+        fs::remove(configFilePath);
+    }
+    EXPECT_FALSE(fs::exists(configFilePath));
+    MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                          dbusPersistentFilePath.c_str(),
+                          tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    EXPECT_EQ(manager.enabledConfig(), nullptr);
+
+    for (int i = 1; i <= 10; ++i)
+    {
+        manager.getADConfigPtr()->create("group" + std::to_string(i),
+                                         "priv-user");
+    }
+    manager.getADConfigPtr()->enabled(true);
+    ASSERT_EQ(manager.enabledConfig(), manager.getADConfigPtr().get());
+
+    // Same order as the object paths: 1, 10, 2, ..., 9
+    auto mappings = manager.enabledConfig()->privilegeMappings();
+    ASSERT_EQ(mappings.size(), 10);
+    EXPECT_EQ(mappings[0].first, "group1");
+    EXPECT_EQ(mappings[1].first, "group10");
+    EXPECT_EQ(mappings[2].first, "group2");
+    EXPECT_EQ(mappings[9].first, "group9");
+    EXPECT_EQ(mappings[0].second, "priv-user");
+
+    manager.getADConfigPtr()->enabled(false);
+    EXPECT_EQ(manager.enabledConfig(), nullptr);
+    // Process D-Bus calls
+    eventLoop(2);
+}
+
 TEST_F(TestLDAPConfig, restorePrivMapping)
 {
     auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
@@ -785,6 +1800,141 @@ TEST_F(TestLDAPConfig, restorePrivMapping)
         PrivilegeMappingExists);
 }
 
+TEST_F(TestLDAPConfig, resolvePrivilegePicksHighest)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                          dbusPersistentFilePath.c_str(),
+                          tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    auto& config = *manager.getADConfigPtr();
+    config.create("users", "priv-user");
+    config.create("ops", "priv-operator");
+    config.create("admins", "priv-admin");
+
+    EXPECT_EQ("priv-operator", config.resolvePrivilege({"users", "ops"}));
+    EXPECT_EQ("priv-admin",
+              config.resolvePrivilege({"users", "admins", "other"}));
+    EXPECT_EQ("", config.resolvePrivilege({"other"}));
+    EXPECT_EQ("", config.resolvePrivilege({}));
+
+    // Deleting a mapping drops it from the index
+    config.deletePrivilegeMapper(3);
+    EXPECT_EQ("priv-user", config.resolvePrivilege({"users", "admins"}));
+    EXPECT_NO_THROW(config.checkPrivilegeMapper("admins"));
+    EXPECT_THROW(config.checkPrivilegeMapper("ops"), PrivilegeMappingExists);
+}
+
+TEST_F(TestLDAPConfig, restoreMigratesPerFileRoleMapping)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                          dbusPersistentFilePath.c_str(),
+                          tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+
+    auto configPath = std::string(LDAP_CONFIG_ROOT) + "/active_directory";
+    auto mapperPath = configPath + "/role_map/3";
+    fs::path legacyDir = dbusPersistentFilePath + configPath + "/role_map";
+    fs::path journalFile = dbusPersistentFilePath + configPath + '/' +
+                           journal::fileName;
+    {
+        // Persist a mapping the way it used to be, one file per entry
+        LDAPMapperEntry entry(bus, mapperPath.c_str(), "admin", "priv-admin",
+                              *manager.getADConfigPtr());
+        phosphor::ldap::serialize(entry, legacyDir / "3");
+    }
+    ASSERT_TRUE(fs::exists(legacyDir / "3"));
+
+    manager.getADConfigPtr()->restoreRoleMapping();
+    EXPECT_FALSE(fs::exists(legacyDir));
+    EXPECT_TRUE(fs::exists(journalFile));
+    using Mappings = std::vector<std::pair<std::string, std::string>>;
+    EXPECT_EQ(Mappings({{"admin", "priv-admin"}}),
+              manager.getADConfigPtr()->privilegeMappings());
+
+    // New entries continue after the migrated ones
+    auto created = manager.getADConfigPtr()->create("user", "priv-user");
+    EXPECT_EQ(configPath + "/role_map/4", std::string(created));
+
+    // The journal alone restores both
+    manager.getADConfigPtr().reset();
+    manager.createDefaultObjects();
+    manager.getADConfigPtr()->restoreRoleMapping();
+    EXPECT_EQ(Mappings({{"admin", "priv-admin"}, {"user", "priv-user"}}),
+              manager.getADConfigPtr()->privilegeMappings());
+}
+
+TEST_F(TestLDAPConfig, bulkRoleMappings)
+{
+    auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
+    auto tlsCACertFilePath = std::string(dir.c_str()) + "/" + tlsCACertFile;
+    auto tlsCertFilePath = std::string(dir.c_str()) + "/" + tlsCertFile;
+    auto dbusPersistentFilePath = std::string(dir.c_str());
+
+    MockConfigMgr manager(bus, LDAP_CONFIG_ROOT, configFilePath.c_str(),
+                          dbusPersistentFilePath.c_str(),
+                          tlsCACertFilePath.c_str(), tlsCertFilePath.c_str());
+    manager.createDefaultObjects();
+    auto& config = *manager.getADConfigPtr();
+    auto mapperPath = std::string(LDAP_CONFIG_ROOT) +
+                      "/active_directory/role_map/";
+
+    auto paths = config.createMany({{"users", "priv-user"},
+                                    {"ops", "priv-operator"},
+                                    {"admins", "priv-admin"}});
+    ASSERT_EQ(3, paths.size());
+    EXPECT_EQ(mapperPath + "1", std::string(paths[0]));
+    EXPECT_EQ(mapperPath + "3", std::string(paths[2]));
+    EXPECT_EQ("priv-operator", config.resolvePrivilege({"users", "ops"}));
+
+    // A bad mapping anywhere in the list changes nothing
+    EXPECT_THROW(
+        config.createMany({{"new", "priv-user"}, {"ops", "priv-user"}}),
+        PrivilegeMappingExists);
+    EXPECT_THROW(config.createMany({{"a", "priv-user"}, {"a", "priv-admin"}}),
+                 PrivilegeMappingExists);
+    EXPECT_THROW(config.replaceRoleMappings({{"a", "priv-user"}, {"b", ""}}),
+                 InvalidArgument);
+    EXPECT_THROW(config.replaceRoleMappings({{"", "priv-user"}}),
+                 InvalidArgument);
+    EXPECT_EQ(RoleMappings({{"users", "priv-user"},
+                            {"ops", "priv-operator"},
+                            {"admins", "priv-admin"}}),
+              config.privilegeMappings());
+
+    // Kept groups keep their entry, new ones continue after the last
+    config.replaceRoleMappings({{"guests", "priv-user"},
+                                {"ops", "priv-admin"},
+                                {"users", "priv-user"}});
+    RoleMappings expected = {{"users", "priv-user"},
+                             {"ops", "priv-admin"},
+                             {"guests", "priv-user"}};
+    EXPECT_EQ(expected, config.privilegeMappings());
+    EXPECT_NO_THROW(config.checkPrivilegeMapper("admins"));
+    EXPECT_EQ("", config.resolvePrivilege({"admins"}));
+    EXPECT_EQ("priv-admin", config.resolvePrivilege({"ops"}));
+    EXPECT_EQ(mapperPath + "5", std::string(config.create("x", "priv-user")));
+    expected.emplace_back("x", "priv-user");
+
+    // The journal restores the replaced set
+    manager.getADConfigPtr().reset();
+    manager.createDefaultObjects();
+    manager.getADConfigPtr()->restoreRoleMapping();
+    EXPECT_EQ(expected, manager.getADConfigPtr()->privilegeMappings());
+
+    manager.getADConfigPtr()->replaceRoleMappings({});
+    EXPECT_TRUE(manager.getADConfigPtr()->privilegeMappings().empty());
+}
+
 TEST_F(TestLDAPConfig, testPrivileges)
 {
     auto configFilePath = std::string(dir.c_str()) + "/" + ldapConfFile;
@@ -807,11 +1957,10 @@ TEST_F(TestLDAPConfig, testPrivileges)
     size_t entryId = 1;
     auto dbusPath = std::string(LDAP_CONFIG_ROOT) +
                     "/active_directory/role_map/" + std::to_string(entryId);
-    dbusPersistentFilePath += dbusPath;
 
     auto entry = std::make_unique<LDAPMapperEntry>(
-        bus, dbusPath.c_str(), dbusPersistentFilePath.c_str(), groupName,
-        privilege, *(manager.getADConfigPtr()));
+        bus, dbusPath.c_str(), groupName, privilege,
+        *(manager.getADConfigPtr()));
 
     EXPECT_NO_THROW(entry->privilege("priv-operator"));
     EXPECT_NO_THROW(entry->privilege("priv-user"));
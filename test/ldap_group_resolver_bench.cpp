@@ -0,0 +1,257 @@
+#include "phosphor-ldap-config/ldap_group_resolver.hpp"
+
+#include <grp.h>
+#include <ldap.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+/* Compares the two ways of finding a remote user's privilege groups against
+ * a real server, seeded with large posixGroups under ou=bench-groups of the
+ * base DN:
+ *
+ *   LDAP_BENCH_URI=ldap://localhost LDAP_BENCH_BASE=dc=example,dc=com \
+ *   LDAP_BENCH_BIND_DN=cn=admin,dc=example,dc=com LDAP_BENCH_BIND_PW=... \
+ *   ./ldap_group_resolver_bench
+ *
+ * Without LDAP_BENCH_URI every benchmark is skipped. BM_NssGetgrnam is only
+ * meaningful where nslcd points at the same server.
+ */
+
+namespace phosphor
+{
+namespace ldap
+{
+
+constexpr auto benchUser = "benchuser";
+constexpr gid_t benchUserGid = 50000;
+// Groups in the mapping table, the user is a member of the last one only
+constexpr int mappedGroups = 5;
+
+static const char* env(const char* name)
+{
+    const char* value = std::getenv(name);
+    return value != nullptr ? value : "";
+}
+
+class DirectoryFixture
+{
+  public:
+    /** @brief Seed groups of 'members' members each, the user last */
+    explicit DirectoryFixture(int members) :
+        base(env("LDAP_BENCH_BASE")),
+        groupBase("ou=bench-groups," + base)
+    {
+        if (std::getenv("LDAP_BENCH_URI") == nullptr)
+        {
+            return;
+        }
+        if (ldap_initialize(&ld, env("LDAP_BENCH_URI")) != LDAP_SUCCESS)
+        {
+            return;
+        }
+        int version = LDAP_VERSION3;
+        ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version);
+        std::string password = env("LDAP_BENCH_BIND_PW");
+        berval credentials{password.size(), password.data()};
+        if (ldap_sasl_bind_s(ld, env("LDAP_BENCH_BIND_DN"), LDAP_SASL_SIMPLE,
+                             &credentials, nullptr, nullptr,
+                             nullptr) != LDAP_SUCCESS)
+        {
+            return;
+        }
+
+        removeGroups();
+        add(groupBase, {{"objectClass", {"organizationalUnit"}},
+                        {"ou", {"bench-groups"}}});
+        for (int i = 0; i < mappedGroups; ++i)
+        {
+            std::vector<std::string> uids;
+            for (int m = 0; m < members; ++m)
+            {
+                uids.push_back("member" + std::to_string(m));
+            }
+            if (i == mappedGroups - 1)
+            {
+                uids.emplace_back(benchUser);
+            }
+            auto name = groupName(i);
+            add("cn=" + name + "," + groupBase,
+                {{"objectClass", {"posixGroup"}},
+                 {"cn", {name}},
+                 {"gidNumber", {std::to_string(60000 + i)}},
+                 {"memberUid", uids}});
+        }
+        seeded = true;
+    }
+
+    ~DirectoryFixture()
+    {
+        if (ld != nullptr)
+        {
+            removeGroups();
+            ldap_unbind_ext_s(ld, nullptr, nullptr);
+        }
+    }
+
+    static std::string groupName(int i)
+    {
+        return "benchgroup" + std::to_string(i);
+    }
+
+    GroupSearch search() const
+    {
+        GroupSearch search;
+        search.uris = env("LDAP_BENCH_URI");
+        search.bindDN = env("LDAP_BENCH_BIND_DN");
+        search.bindPassword = env("LDAP_BENCH_BIND_PW");
+        search.userBase = base;
+        search.userFilter = "(objectclass=posixAccount)";
+        search.userNameAttribute = "cn";
+        search.groupBase = groupBase;
+        search.groupFilter = "(objectclass=posixGroup)";
+        search.groupNameAttribute = "cn";
+        return search;
+    }
+
+    LDAP* ld = nullptr;
+    const std::string base;
+    const std::string groupBase;
+    bool seeded = false;
+
+  private:
+    using Attributes =
+        std::vector<std::pair<std::string, std::vector<std::string>>>;
+
+    void add(const std::string& dn, const Attributes& attributes)
+    {
+        std::vector<std::vector<char*>> values;
+        std::vector<LDAPMod> mods(attributes.size());
+        std::vector<LDAPMod*> modPtrs;
+        for (size_t i = 0; i < attributes.size(); ++i)
+        {
+            auto& list = values.emplace_back();
+            for (const auto& value : attributes[i].second)
+            {
+                list.push_back(const_cast<char*>(value.c_str()));
+            }
+            list.push_back(nullptr);
+            mods[i].mod_op = LDAP_MOD_ADD;
+            mods[i].mod_type = const_cast<char*>(attributes[i].first.c_str());
+            mods[i].mod_values = list.data();
+            modPtrs.push_back(&mods[i]);
+        }
+        modPtrs.push_back(nullptr);
+        ldap_add_ext_s(ld, dn.c_str(), modPtrs.data(), nullptr, nullptr);
+    }
+
+    void removeGroups()
+    {
+        for (int i = 0; i < mappedGroups; ++i)
+        {
+            ldap_delete_ext_s(ld,
+                              ("cn=" + groupName(i) + "," + groupBase).c_str(),
+                              nullptr, nullptr);
+        }
+        ldap_delete_ext_s(ld, groupBase.c_str(), nullptr, nullptr);
+    }
+};
+
+// What nslcd does for every getgrnam() of the NSS path: fetch the group
+// with all its members, one mapped group after another until a match
+static void BM_GroupEntrySearches(benchmark::State& state)
+{
+    DirectoryFixture fixture(state.range(0));
+    if (!fixture.seeded)
+    {
+        state.SkipWithError("LDAP_BENCH_URI not set or server unavailable");
+        return;
+    }
+    char memberUid[] = "memberUid";
+    char gidNumber[] = "gidNumber";
+    char* attributes[] = {memberUid, gidNumber, nullptr};
+    for (auto _ : state)
+    {
+        for (int i = 0; i < mappedGroups; ++i)
+        {
+            LDAPMessage* message = nullptr;
+            auto filter = "(&(objectclass=posixGroup)(cn=" +
+                          DirectoryFixture::groupName(i) + "))";
+            ldap_search_ext_s(fixture.ld, fixture.groupBase.c_str(),
+                              LDAP_SCOPE_SUBTREE, filter.c_str(), attributes,
+                              0, nullptr, nullptr, nullptr, 0, &message);
+            ldap_msgfree(message);
+        }
+    }
+}
+BENCHMARK(BM_GroupEntrySearches)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+
+// One search for the groups the user is in, on a pooled connection
+static void BM_GroupResolver(benchmark::State& state)
+{
+    DirectoryFixture fixture(state.range(0));
+    if (!fixture.seeded)
+    {
+        state.SkipWithError("LDAP_BENCH_URI not set or server unavailable");
+        return;
+    }
+    GroupResolver resolver;
+    resolver.setSearch(fixture.search());
+    for (auto _ : state)
+    {
+        auto groups = resolver.groupsOf(benchUser, benchUserGid);
+        if (!groups || groups->size() != 1)
+        {
+            state.SkipWithError("Unexpected groups");
+            break;
+        }
+    }
+    state.counters["connects"] =
+        static_cast<double>(resolver.stats().connects);
+}
+BENCHMARK(BM_GroupResolver)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+
+// The NSS path itself, with nscd's cache in the way unless it is disabled
+static void BM_NssGetgrnam(benchmark::State& state)
+{
+    DirectoryFixture fixture(state.range(0));
+    if (!fixture.seeded)
+    {
+        state.SkipWithError("LDAP_BENCH_URI not set or server unavailable");
+        return;
+    }
+    std::vector<char> buffer(1024 * 1024);
+    for (auto _ : state)
+    {
+        for (int i = 0; i < mappedGroups; ++i)
+        {
+            group grp{};
+            group* result = nullptr;
+            getgrnam_r(DirectoryFixture::groupName(i).c_str(), &grp,
+                       buffer.data(), buffer.size(), &result);
+            benchmark::DoNotOptimize(result);
+        }
+    }
+}
+BENCHMARK(BM_NssGetgrnam)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace ldap
+} // namespace phosphor
+
+BENCHMARK_MAIN();
@@ -0,0 +1,146 @@
+#include "fake_ldap_server.hpp"
+#include "phosphor-ldap-config/ldap_group_resolver.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+using namespace std::chrono_literals;
+
+static GroupSearch searchFor(const std::string& uris, bool activeDirectory)
+{
+    GroupSearch search;
+    search.uris = uris;
+    search.bindDN = "cn=admin,dc=example,dc=com";
+    search.bindPassword = "secret";
+    search.timeout = 1s;
+    search.activeDirectory = activeDirectory;
+    search.userBase = "ou=people,dc=example,dc=com";
+    search.groupBase = "ou=groups,dc=example,dc=com";
+    if (activeDirectory)
+    {
+        search.domainSid = "S-1-5-21-1-2-3";
+        search.userFilter = "(objectClass=user)";
+        search.userNameAttribute = "sAMAccountName";
+        search.groupFilter = "(objectClass=group)";
+        search.groupNameAttribute = "sAMAccountName";
+    }
+    else
+    {
+        search.userFilter = "(objectClass=posixAccount)";
+        search.userNameAttribute = "cn";
+        search.groupFilter = "(objectClass=posixGroup)";
+        search.groupNameAttribute = "cn";
+    }
+    return search;
+}
+
+TEST(GroupMembershipFilter, openLdapMatchesMemberUidOrPrimaryGid)
+{
+    auto search = searchFor("", false);
+    EXPECT_EQ("(&(objectClass=posixGroup)"
+              "(|(memberUid=j\\2a)(gidNumber=1000)))",
+              groupMembershipFilter(search, "j*", "", 1000));
+}
+
+TEST(GroupMembershipFilter, activeDirectoryFollowsNestedGroups)
+{
+    auto search = searchFor("", true);
+    // S-1-5-21-1-2-3-513 in binary: revision 1, five subauthorities,
+    // authority 5 big endian, then 21, 1, 2, 3 and 513 little endian
+    EXPECT_EQ("(&(objectClass=group)(|"
+              "(member:1.2.840.113556.1.4.1941:=cn=j\\28x\\29,dc=example)"
+              "(objectSid=\\01\\05\\00\\00\\00\\00\\00\\05"
+              "\\15\\00\\00\\00\\01\\00\\00\\00\\02\\00\\00\\00"
+              "\\03\\00\\00\\00\\01\\02\\00\\00)))",
+              groupMembershipFilter(search, "j", "cn=j(x),dc=example", 513));
+
+    // Without a domain SID there is no primary group to match
+    search.domainSid.clear();
+    EXPECT_EQ("(&(objectClass=group)"
+              "(member:1.2.840.113556.1.4.1941:=cn=j,dc=example))",
+              groupMembershipFilter(search, "j", "cn=j,dc=example", 513));
+}
+
+TEST(GroupResolver, findsGroupsOnPooledConnection)
+{
+    FakeLdapServer server;
+    server.addEntry("cn=admins,ou=groups,dc=example,dc=com", "cn", "admins");
+    server.addEntry("cn=ops,ou=groups,dc=example,dc=com", "cn", "ops");
+    GroupResolver resolver;
+
+    // Nothing to search yet, NSS has to answer
+    EXPECT_FALSE(resolver.groupsOf("alice", 1000));
+
+    resolver.setSearch(searchFor(server.uri(), false));
+    std::vector<std::string> expected = {"admins", "ops"};
+    for (int i = 0; i < 3; ++i)
+    {
+        auto groups = resolver.groupsOf("alice", 1000);
+        ASSERT_TRUE(groups);
+        EXPECT_EQ(expected, *groups);
+    }
+    EXPECT_EQ(1u, server.connections());
+    auto stats = resolver.stats();
+    EXPECT_EQ(4u, stats.lookups);
+    EXPECT_EQ(1u, stats.failures);
+    EXPECT_EQ(1u, stats.connects);
+
+    // An unchanged search keeps the connection, a changed one doesn't
+    resolver.setSearch(searchFor(server.uri(), false));
+    EXPECT_TRUE(resolver.groupsOf("alice", 1000));
+    EXPECT_EQ(1u, resolver.stats().connects);
+    auto search = searchFor(server.uri(), false);
+    search.groupBase = "dc=example,dc=com";
+    resolver.setSearch(search);
+    EXPECT_TRUE(resolver.groupsOf("alice", 1000));
+    EXPECT_EQ(2u, resolver.stats().connects);
+}
+
+TEST(GroupResolver, activeDirectoryLooksUpUserFirst)
+{
+    FakeLdapServer server;
+    // Answers the user search and the group search alike
+    server.addEntry("cn=admins,dc=example,dc=com", "sAMAccountName",
+                    "admins");
+    GroupResolver resolver;
+    resolver.setSearch(searchFor(server.uri(), true));
+
+    auto groups = resolver.groupsOf("alice", 513);
+    ASSERT_TRUE(groups);
+    EXPECT_EQ(std::vector<std::string>{"admins"}, *groups);
+}
+
+TEST(GroupResolver, unknownUserIsInNoGroup)
+{
+    FakeLdapServer server;
+    GroupResolver resolver;
+    resolver.setSearch(searchFor(server.uri(), true));
+
+    auto groups = resolver.groupsOf("nobody", 513);
+    ASSERT_TRUE(groups);
+    EXPECT_TRUE(groups->empty());
+}
+
+TEST(GroupResolver, failuresFallBackToNss)
+{
+    GroupResolver resolver;
+    resolver.setSearch(searchFor(
+        "ldap://127.0.0.1:" + std::to_string(closedPort()), false));
+    EXPECT_FALSE(resolver.groupsOf("alice", 1000));
+
+    FakeLdapServer server(49); // invalidCredentials
+    resolver.setSearch(searchFor(server.uri(), false));
+    EXPECT_FALSE(resolver.groupsOf("alice", 1000));
+    EXPECT_EQ(2u, resolver.stats().failures);
+}
+
+} // namespace ldap
+} // namespace phosphor
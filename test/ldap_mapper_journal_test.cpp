@@ -0,0 +1,161 @@
+#include "phosphor-ldap-config/ldap_mapper_journal.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace fs = std::filesystem;
+
+class TestMapperJournal : public testing::Test
+{
+  public:
+    TestMapperJournal()
+    {
+        char tmpDir[] = "/tmp/test-journal-XXXXXX";
+        dir = mkdtemp(tmpDir);
+        filePath = dir / journal::fileName;
+    }
+
+    ~TestMapperJournal() override
+    {
+        fs::remove_all(dir);
+    }
+
+  protected:
+    fs::path dir;
+    fs::path filePath;
+
+    Mappings reload()
+    {
+        MapperJournal journal(filePath);
+        return journal.load();
+    }
+};
+
+TEST_F(TestMapperJournal, missingJournalIsEmpty)
+{
+    MapperJournal journal(filePath);
+    EXPECT_TRUE(journal.load().empty());
+    EXPECT_FALSE(fs::exists(filePath));
+}
+
+TEST_F(TestMapperJournal, changesSurviveReload)
+{
+    {
+        MapperJournal journal(filePath);
+        journal.put(1, {"admin", "priv-admin"});
+        journal.put(2, {"user", "priv-user"});
+        journal.put(1, {"admin", "priv-operator"});
+        journal.erase(2);
+        journal.put(3, {"ops", "priv-operator"});
+        EXPECT_EQ(5, journal.records());
+    }
+
+    Mappings expected = {{1, {"admin", "priv-operator"}},
+                         {3, {"ops", "priv-operator"}}};
+    EXPECT_EQ(expected, reload());
+}
+
+TEST_F(TestMapperJournal, tornTailIsDropped)
+{
+    {
+        MapperJournal journal(filePath);
+        journal.put(1, {"admin", "priv-admin"});
+        journal.put(2, {"user", "priv-user"});
+    }
+    // Crash in the middle of writing the second record
+    fs::resize_file(filePath, fs::file_size(filePath) - 3);
+
+    MapperJournal journal(filePath);
+    Mappings expected = {{1, {"admin", "priv-admin"}}};
+    EXPECT_EQ(expected, journal.load());
+
+    // Appending cuts the torn record off first
+    journal.put(3, {"ops", "priv-operator"});
+    expected.emplace(3, Mapping{"ops", "priv-operator"});
+    EXPECT_EQ(expected, reload());
+}
+
+TEST_F(TestMapperJournal, corruptRecordStopsReplay)
+{
+    size_t firstRecordEnd = 0;
+    {
+        MapperJournal journal(filePath);
+        journal.put(1, {"admin", "priv-admin"});
+        firstRecordEnd = fs::file_size(filePath);
+        journal.put(2, {"user", "priv-user"});
+        journal.put(3, {"ops", "priv-operator"});
+    }
+    {
+        // Flip a bit in the group name of the second record
+        std::fstream fs(filePath,
+                        std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekg(firstRecordEnd + 21);
+        char c = 0;
+        fs.get(c);
+        fs.seekp(firstRecordEnd + 21);
+        fs.put(static_cast<char>(c ^ 1));
+    }
+
+    Mappings expected = {{1, {"admin", "priv-admin"}}};
+    EXPECT_EQ(expected, reload());
+}
+
+TEST_F(TestMapperJournal, foreignFileStartsOver)
+{
+    {
+        std::ofstream os(filePath);
+        os << "not a journal";
+    }
+    MapperJournal journal(filePath);
+    EXPECT_TRUE(journal.load().empty());
+
+    journal.put(1, {"admin", "priv-admin"});
+    Mappings expected = {{1, {"admin", "priv-admin"}}};
+    EXPECT_EQ(expected, reload());
+}
+
+TEST_F(TestMapperJournal, compactionKeepsLiveMappings)
+{
+    MapperJournal journal(filePath);
+    journal.put(1, {"admin", "priv-admin"});
+    for (size_t i = 0; i < 10 * journal::compactMinRecords; ++i)
+    {
+        journal.put(2, {"user", i % 2 ? "priv-user" : "priv-operator"});
+    }
+    EXPECT_LT(journal.records(), journal::compactMinRecords + 2);
+    EXPECT_LT(fs::file_size(filePath), (journal::compactMinRecords + 2) * 64);
+
+    Mappings expected = {{1, {"admin", "priv-admin"}},
+                         {2, {"user", "priv-user"}}};
+    EXPECT_EQ(expected, journal.mappings());
+    EXPECT_EQ(expected, reload());
+
+    // No temporary files are left behind
+    EXPECT_EQ(1, std::distance(fs::directory_iterator(dir),
+                               fs::directory_iterator()));
+}
+
+TEST_F(TestMapperJournal, replaceWritesOnlyLiveMappings)
+{
+    MapperJournal journal(filePath);
+    journal.put(1, {"admin", "priv-admin"});
+    journal.erase(1);
+
+    Mappings mappings = {{4, {"user", "priv-user"}}};
+    journal.replace(mappings);
+    EXPECT_EQ(1, journal.records());
+    EXPECT_EQ(mappings, reload());
+}
+
+} // namespace ldap
+} // namespace phosphor
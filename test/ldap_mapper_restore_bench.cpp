@@ -0,0 +1,132 @@
+#include "config.h"
+
+#include "phosphor-ldap-config/ldap_mapper_journal.hpp"
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+namespace fs = std::filesystem;
+
+/** @brief Same archive layout as a persisted LDAPMapperEntry, without the
+ *  D-Bus object. Creating the objects costs the same with either layout,
+ *  only reading the persisted state is compared here.
+ */
+struct LegacyMapping
+{
+    std::string groupName;
+    std::string privilege;
+};
+
+template <class Archive>
+void serialize(Archive& archive, LegacyMapping& mapping,
+               const std::uint32_t /*version*/)
+{
+    archive(mapping.groupName, mapping.privilege);
+}
+
+} // namespace ldap
+} // namespace phosphor
+
+CEREAL_CLASS_VERSION(phosphor::ldap::LegacyMapping, CLASS_VERSION);
+
+namespace phosphor
+{
+namespace ldap
+{
+
+class RestoreFixture
+{
+  public:
+    fs::path dir;
+
+    RestoreFixture()
+    {
+        char tmpDir[] = "/tmp/ldap-mapper-bench-XXXXXX";
+        dir = mkdtemp(tmpDir);
+    }
+
+    ~RestoreFixture()
+    {
+        fs::remove_all(dir);
+    }
+
+    static Mapping mappingFor(Id id)
+    {
+        return {"group" + std::to_string(id), "priv-operator"};
+    }
+};
+
+// One cereal file per entry, as restoreRoleMapping used to read them
+static void BM_RestorePerFile(benchmark::State& state)
+{
+    RestoreFixture fixture;
+    auto roleMapDir = fixture.dir / "role_map";
+    fs::create_directories(roleMapDir);
+    for (Id id = 1; id <= static_cast<Id>(state.range(0)); ++id)
+    {
+        auto mapping = RestoreFixture::mappingFor(id);
+        LegacyMapping legacy{mapping.groupName, mapping.privilege};
+        std::ofstream os(roleMapDir / std::to_string(id), std::ios::binary);
+        cereal::BinaryOutputArchive oarchive(os);
+        oarchive(legacy);
+    }
+
+    for (auto _ : state)
+    {
+        Mappings mappings;
+        for (auto& file : fs::directory_iterator(roleMapDir))
+        {
+            Id id = std::stol(file.path().filename().c_str());
+            LegacyMapping legacy;
+            std::ifstream is(file.path(), std::ios::in | std::ios::binary);
+            cereal::BinaryInputArchive iarchive(is);
+            iarchive(legacy);
+            mappings.emplace(id, Mapping{std::move(legacy.groupName),
+                                         std::move(legacy.privilege)});
+        }
+        benchmark::DoNotOptimize(mappings);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RestorePerFile)->Arg(5000)->Unit(benchmark::kMillisecond);
+
+// The journal, replayed with one sequential read
+static void BM_RestoreJournal(benchmark::State& state)
+{
+    RestoreFixture fixture;
+    auto journalFile = fixture.dir / journal::fileName;
+    {
+        Mappings mappings;
+        for (Id id = 1; id <= static_cast<Id>(state.range(0)); ++id)
+        {
+            mappings.emplace(id, RestoreFixture::mappingFor(id));
+        }
+        MapperJournal journal(journalFile);
+        journal.replace(std::move(mappings));
+    }
+
+    for (auto _ : state)
+    {
+        MapperJournal journal(journalFile);
+        benchmark::DoNotOptimize(journal.load());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RestoreJournal)->Arg(5000)->Unit(benchmark::kMillisecond);
+
+} // namespace ldap
+} // namespace phosphor
+
+BENCHMARK_MAIN();
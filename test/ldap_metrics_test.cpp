@@ -0,0 +1,120 @@
+#include "phosphor-ldap-config/ldap_metrics.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+using namespace std::chrono_literals;
+
+TEST(LatencyHistogram, bucketsByUpperBound)
+{
+    LatencyHistogram histogram;
+    histogram.observe(100us);
+    histogram.observe(101us);
+    histogram.observe(5ms);
+    histogram.observe(1min);
+
+    EXPECT_EQ(1u, histogram.buckets[0]);
+    EXPECT_EQ(1u, histogram.buckets[1]);
+    EXPECT_EQ(1u, histogram.buckets[2]);
+    EXPECT_EQ(1u, histogram.buckets.back());
+    EXPECT_EQ(4u, histogram.count);
+    EXPECT_EQ(100us + 101us + 5ms + 1min, histogram.sum);
+}
+
+TEST(Metrics, textIsCumulativeAndLabelled)
+{
+    Metrics metrics;
+    metrics.restarted();
+    metrics.restarted(RestartReason::PropertySet);
+    metrics.restarted(RestartReason::Certificate);
+    metrics.observe(Operation::WriteConfig, 50us);
+    metrics.observe(Operation::WriteConfig, 2ms);
+    EXPECT_EQ(1u, metrics.nslcdRestarts());
+    EXPECT_EQ(1u, metrics.restarts(RestartReason::Certificate));
+    EXPECT_EQ(0u, metrics.restarts(RestartReason::Startup));
+
+    auto text = metrics.text({{"active_directory", 3}});
+    for (const auto& line : {
+             "phosphor_ldap_nslcd_restarts_total 1\n",
+             "phosphor_ldap_nslcd_restart_reasons_total"
+             "{reason=\"certificate\"} 1\n",
+             "phosphor_ldap_nslcd_restart_reasons_total"
+             "{reason=\"startup\"} 0\n",
+             "phosphor_ldap_operation_seconds_bucket"
+             "{operation=\"write_config\",le=\"0.000100\"} 1\n",
+             "phosphor_ldap_operation_seconds_bucket"
+             "{operation=\"write_config\",le=\"0.010000\"} 2\n",
+             "phosphor_ldap_operation_seconds_bucket"
+             "{operation=\"write_config\",le=\"+Inf\"} 2\n",
+             "phosphor_ldap_operation_seconds_sum"
+             "{operation=\"write_config\"} 0.002050\n",
+             "phosphor_ldap_operation_seconds_count"
+             "{operation=\"persist\"} 0\n",
+             "phosphor_ldap_mapper_entries{config=\"active_directory\"} 3\n",
+         })
+    {
+        EXPECT_NE(std::string::npos, text.find(line)) << line;
+    }
+}
+
+TEST(Metrics, probeTextHasCountersAndPercentiles)
+{
+    ProbeStats stats;
+    stats.probes = 5;
+    stats.failures = 1;
+    stats.failuresByStage[static_cast<size_t>(ProbeStage::Bind)] = 1;
+    stats.last = ProbeResult{};
+    stats.last->success = true;
+    stats.stageLatency[static_cast<size_t>(ProbeStage::Connect)].p90 = 2ms;
+    stats.totalLatency.p50 = 15ms;
+
+    auto text = probeText(stats);
+    for (const auto& line : {
+             "phosphor_ldap_probes_total 5\n",
+             "phosphor_ldap_probe_failures_total{stage=\"bind\"} 1\n",
+             "phosphor_ldap_probe_failures_total{stage=\"resolve\"} 0\n",
+             "phosphor_ldap_probe_up 1\n",
+             "phosphor_ldap_probe_seconds"
+             "{stage=\"connect\",quantile=\"0.9\"} 0.002000\n",
+             "phosphor_ldap_probe_seconds"
+             "{stage=\"total\",quantile=\"0.5\"} 0.015000\n",
+         })
+    {
+        EXPECT_NE(std::string::npos, text.find(line)) << line;
+    }
+
+    stats.last->success = false;
+    EXPECT_NE(std::string::npos,
+              probeText(stats).find("phosphor_ldap_probe_up 0\n"));
+}
+
+TEST(Metrics, fileIsReplaced)
+{
+    char tmpDir[] = "/tmp/ldap-metrics-test-XXXXXX";
+    std::filesystem::path dir = mkdtemp(tmpDir);
+    auto file = dir / "run" / "metrics";
+
+    writeMetricsFile(file, "first\n");
+    writeMetricsFile(file, "second\n");
+    std::ifstream in(file);
+    std::string content((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+    EXPECT_EQ("second\n", content);
+    EXPECT_FALSE(std::filesystem::exists(dir / "run" / "metrics.tmp"));
+
+    std::filesystem::remove_all(dir);
+}
+
+} // namespace ldap
+} // namespace phosphor
@@ -0,0 +1,158 @@
+#include "fake_ldap_server.hpp"
+#include "phosphor-ldap-config/ldap_probe.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace ldap
+{
+
+using namespace std::chrono_literals;
+
+static ProbeTarget targetFor(const std::string& uri)
+{
+    ProbeTarget target;
+    target.uri = uri;
+    target.bindDN = "cn=admin,dc=example,dc=com";
+    target.bindPassword = "secret";
+    target.baseDN = "dc=example,dc=com";
+    target.timeout = 1s;
+    return target;
+}
+
+TEST(LdapProbe, succeedsAgainstServer)
+{
+    FakeLdapServer server;
+    auto result = probe(targetFor(server.uri()));
+    EXPECT_TRUE(result.success) << result.error;
+    EXPECT_FALSE(result.failedStage);
+    EXPECT_GT(result.latency[static_cast<size_t>(ProbeStage::Bind)], 0us);
+    EXPECT_GT(result.latency[static_cast<size_t>(ProbeStage::Search)], 0us);
+    EXPECT_EQ(0us, result.latency[static_cast<size_t>(ProbeStage::TLS)]);
+    EXPECT_GE(result.total,
+              result.latency[static_cast<size_t>(ProbeStage::Bind)] +
+                  result.latency[static_cast<size_t>(ProbeStage::Search)]);
+}
+
+TEST(LdapProbe, closedPortFailsAtConnect)
+{
+    auto result = probe(targetFor("ldap://127.0.0.1:" +
+                                  std::to_string(closedPort())));
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(ProbeStage::Connect, result.failedStage);
+    EXPECT_FALSE(result.error.empty());
+    EXPECT_EQ(0us, result.latency[static_cast<size_t>(ProbeStage::Bind)]);
+}
+
+TEST(LdapProbe, rejectedCredentialsFailAtBind)
+{
+    FakeLdapServer server(49); // invalidCredentials
+    auto result = probe(targetFor(server.uri()));
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(ProbeStage::Bind, result.failedStage);
+}
+
+TEST(LdapProbe, proberKeepsStatistics)
+{
+    FakeLdapServer server;
+    Prober prober(10ms);
+    prober.setTarget(targetFor(server.uri()));
+
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (prober.stats().probes < 3 &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(5ms);
+    }
+    auto stats = prober.stats();
+    ASSERT_GE(stats.probes, 3);
+    EXPECT_EQ(0, stats.failures);
+    ASSERT_TRUE(stats.last);
+    EXPECT_TRUE(stats.last->success);
+    EXPECT_GT(stats.totalLatency.p50, 0us);
+    EXPECT_LE(stats.totalLatency.p50, stats.totalLatency.p99);
+
+    // Failures are counted per stage
+    prober.setTarget(
+        targetFor("ldap://127.0.0.1:" + std::to_string(closedPort())));
+    deadline = std::chrono::steady_clock::now() + 5s;
+    while (prober.stats().failures == 0 &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(5ms);
+    }
+    stats = prober.stats();
+    EXPECT_GE(stats.failuresByStage[static_cast<size_t>(ProbeStage::Connect)],
+              1);
+    EXPECT_GT(stats.totalLatency.p50, 0us);
+
+    prober.setTarget(std::nullopt);
+}
+
+TEST(LdapServerRanking, keepsOrderWithinHysteresis)
+{
+    std::vector<std::string> current = {"ldap://a", "ldap://b"};
+    // Faster, but not by enough to be worth an nslcd restart
+    ServerLatencies latencies = {{"ldap://a", 10ms}, {"ldap://b", 9ms}};
+    EXPECT_EQ(current, rankServers(current, latencies));
+    latencies = {{"ldap://a", 1000us}, {"ldap://b", 100us}};
+    EXPECT_EQ(current, rankServers(current, latencies));
+
+    latencies = {{"ldap://a", 20ms}, {"ldap://b", 9ms}};
+    std::vector<std::string> expected = {"ldap://b", "ldap://a"};
+    EXPECT_EQ(expected, rankServers(current, latencies));
+}
+
+TEST(LdapServerRanking, failingServersGoLast)
+{
+    std::vector<std::string> current = {"ldap://a", "ldap://b", "ldap://c"};
+    ServerLatencies latencies = {
+        {"ldap://a", std::nullopt}, {"ldap://b", 30ms}, {"ldap://c", 29ms}};
+    std::vector<std::string> expected = {"ldap://c", "ldap://b", "ldap://a"};
+    EXPECT_EQ(expected, rankServers(current, latencies));
+
+    // Not measured counts as failing, failing ones keep their order
+    current = {"ldap://a", "ldap://b", "ldap://c"};
+    latencies = {{"ldap://b", std::nullopt}, {"ldap://c", 5ms}};
+    expected = {"ldap://c", "ldap://a", "ldap://b"};
+    EXPECT_EQ(expected, rankServers(current, latencies));
+
+    // Nothing healthy, nothing to gain from a restart
+    latencies = {};
+    EXPECT_EQ(current, rankServers(current, latencies));
+}
+
+TEST(LdapServerRanking, rankerPutsHealthyServerFirst)
+{
+    FakeLdapServer server;
+    auto down = "ldap://127.0.0.1:" + std::to_string(closedPort());
+    ServerRanker ranker(10ms);
+    ranker.setServers({targetFor(down), targetFor(server.uri())});
+    std::vector<std::string> expected = {server.uri(), down};
+
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (ranker.order() != expected &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(5ms);
+    }
+    EXPECT_EQ(expected, ranker.order());
+    auto latencies = ranker.latencies();
+    EXPECT_FALSE(latencies[down]);
+    ASSERT_TRUE(latencies[server.uri()]);
+    EXPECT_GT(*latencies[server.uri()], 0us);
+
+    // A new server list starts over in the configured order
+    ranker.setServers({targetFor(down)});
+    expected = {down};
+    EXPECT_EQ(expected, ranker.order());
+}
+
+} // namespace ldap
+} // namespace phosphor
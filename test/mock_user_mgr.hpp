@@ -22,6 +22,9 @@ class MockManager : public UserMgr
     MOCK_CONST_METHOD3(isGroupMember,
                        bool(const std::string& userName, gid_t primaryGid,
                             const std::string& groupName));
+    MOCK_METHOD2(getLdapUserGroups,
+                 std::optional<std::vector<GroupName>>(
+                     const std::string& userName, gid_t primaryGid));
 
     friend class TestUserMgr;
 };
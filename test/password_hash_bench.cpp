@@ -0,0 +1,41 @@
+#include "password_hash.hpp"
+
+#include <benchmark/benchmark.h>
+
+namespace phosphor
+{
+namespace user
+{
+namespace password
+{
+
+// Cost of one hash (and thus one login) against the SHA-512 rounds
+static void BM_HashSha512(benchmark::State& state)
+{
+    auto rounds = static_cast<unsigned long>(state.range(0));
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(hash("0penBmc0", sha512, rounds));
+    }
+}
+BENCHMARK(BM_HashSha512)
+    ->RangeMultiplier(4)
+    ->Range(5000, 320000)
+    ->Unit(benchmark::kMillisecond);
+
+// Cost of one hash against the yescrypt cost factor
+static void BM_HashYescrypt(benchmark::State& state)
+{
+    auto cost = static_cast<unsigned long>(state.range(0));
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(hash("0penBmc0", yescrypt, cost));
+    }
+}
+BENCHMARK(BM_HashYescrypt)->DenseRange(1, 7)->Unit(benchmark::kMillisecond);
+
+} // namespace password
+} // namespace user
+} // namespace phosphor
+
+BENCHMARK_MAIN();
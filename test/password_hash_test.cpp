@@ -0,0 +1,77 @@
+#include "password_hash.hpp"
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace user
+{
+namespace password
+{
+
+TEST(PasswordHash, HashVerifiesWithSamePassword)
+{
+    auto hashed = hash("0penBmc0", sha512, 0);
+    EXPECT_TRUE(hashed.starts_with(sha512));
+    EXPECT_TRUE(verify("0penBmc0", hashed));
+    EXPECT_FALSE(verify("0penBmc1", hashed));
+}
+
+TEST(PasswordHash, SaltIsRandom)
+{
+    EXPECT_NE(hash("0penBmc0", sha512, 0), hash("0penBmc0", sha512, 0));
+}
+
+TEST(PasswordHash, CostIsPartOfTheSetting)
+{
+    auto hashed = hash("0penBmc0", sha512, 6000);
+    EXPECT_TRUE(hashed.starts_with("$6$rounds=6000$"));
+    EXPECT_TRUE(verify("0penBmc0", hashed));
+}
+
+TEST(PasswordHash, YescryptHashVerifies)
+{
+    auto hashed = hash("0penBmc0", yescrypt, 0);
+    EXPECT_TRUE(hashed.starts_with(yescrypt));
+    EXPECT_TRUE(verify("0penBmc0", hashed));
+}
+
+TEST(PasswordHash, UnknownAlgorithmThrows)
+{
+    EXPECT_THROW(hash("0penBmc0", "$unknown$", 0), std::runtime_error);
+}
+
+TEST(PasswordHash, LockedHashNeverVerifies)
+{
+    EXPECT_FALSE(verify("", ""));
+    EXPECT_FALSE(verify("", "!"));
+    EXPECT_FALSE(verify("0penBmc0", "*"));
+    EXPECT_FALSE(verify("0penBmc0", "!" + hash("0penBmc0", sha512, 0)));
+}
+
+TEST(PasswordHash, CalibrateWithoutTargetKeepsDefault)
+{
+    EXPECT_EQ(calibrate(sha512, std::chrono::microseconds(0)), 0);
+}
+
+TEST(PasswordHash, CalibrateStaysWithinBounds)
+{
+    // A tiny target can't push the cost below the library default
+    EXPECT_EQ(calibrate(sha512, std::chrono::microseconds(1)), 5000);
+    EXPECT_EQ(calibrate(yescrypt, std::chrono::microseconds(1)), 5);
+}
+
+TEST(PasswordHash, CalibratedCostIncreasesWithTarget)
+{
+    auto low = calibrate(sha512, std::chrono::milliseconds(10));
+    auto high = calibrate(sha512, std::chrono::milliseconds(100));
+    EXPECT_GT(high, low);
+}
+
+} // namespace password
+} // namespace user
+} // namespace phosphor
@@ -0,0 +1,211 @@
+#include "user_mgr.hpp"
+
+#include <shadow.h>
+#include <unistd.h>
+
+#include <sdbusplus/test/sdbus_mock.hpp>
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+namespace phosphor
+{
+namespace user
+{
+
+constexpr auto objpath = "/dummy/user";
+
+/** @class FixtureManager
+ *  @brief UserMgr reading the shadow entries and the failed login records
+ *         from fixture files instead of the accounts of the host.
+ *  @details The shadow file is parsed on every check, as the files NSS
+ *           module does, and the records are read by a subprocess, as
+ *           faillock is run on every check.
+ */
+class FixtureManager : public UserMgr
+{
+  public:
+    FixtureManager(sdbusplus::bus_t& bus, const std::filesystem::path& dir) :
+        UserMgr(bus, objpath), shadowFile(dir / "shadow"),
+        faillockDir(dir / "faillock")
+    {}
+
+    bool isUserEnabled(const std::string& userName) override
+    {
+        std::array<char, 4096> buffer{};
+        struct spwd spwd;
+        return findShadowEntry(userName, spwd, buffer) && spwd.sp_expire < 0;
+    }
+
+    bool userPasswordExpired(const std::string& userName) override
+    {
+        std::array<char, 4096> buffer{};
+        struct spwd spwd;
+        return findShadowEntry(userName, spwd, buffer) && spwd.sp_lstchg == 0;
+    }
+
+  protected:
+    std::vector<std::string> getFailedAttempt(const char* userName) override
+    {
+        std::string records = faillockDir / userName;
+        return executeCmd("/bin/cat", records.c_str());
+    }
+
+  private:
+    bool findShadowEntry(const std::string& userName, struct spwd& spwd,
+                         std::array<char, 4096>& buffer)
+    {
+        FILE* file = fopen(shadowFile.c_str(), "r");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        struct spwd* resultPtr = nullptr;
+        bool found = false;
+        while (!found && fgetspent_r(file, &spwd, buffer.data(),
+                                     buffer.size(), &resultPtr) == 0)
+        {
+            found = userName == resultPtr->sp_namp;
+        }
+        fclose(file);
+        return found;
+    }
+
+    std::string shadowFile;
+    std::filesystem::path faillockDir;
+};
+
+class TestUserMgr
+{
+  public:
+    testing::NiceMock<sdbusplus::SdBusMock> sdBusMock;
+    sdbusplus::bus_t bus;
+    std::filesystem::path dir;
+    std::unique_ptr<FixtureManager> manager;
+
+    TestUserMgr() : bus(sdbusplus::get_mocked_new(&sdBusMock))
+    {
+        char tmpDir[] = "/tmp/user-mgr-bench-XXXXXX";
+        dir = mkdtemp(tmpDir);
+        std::filesystem::create_directory(dir / "faillock");
+        manager = std::make_unique<FixtureManager>(bus, dir);
+        // Have userLockedForFailedAttempt() query the records, as on a BMC
+        manager->AccountPolicyIface::maxLoginAttemptBeforeLockout(3);
+    }
+
+    ~TestUserMgr()
+    {
+        manager.reset();
+        std::filesystem::remove_all(dir);
+    }
+
+    void createLocalUser(const std::string& userName,
+                         std::vector<std::string> groupNames,
+                         const std::string& priv)
+    {
+        // Fill the shadow file with the other accounts of a typical BMC,
+        // the user being looked up comes last
+        std::ofstream shadow(dir / "shadow", std::ios::app);
+        for (const char* name : {"root", "daemon", "bin", "sys", "sshd",
+                                 "systemd-network", "messagebus", "avahi"})
+        {
+            shadow << name << ":*:19000:0:99999:7:::\n";
+        }
+        shadow << userName << ":$6$salt$hash:19000:0:99999:7:::\n";
+
+        // Two failed logins, fewer than the lockout threshold
+        std::ofstream records(dir / "faillock" / userName);
+        records << userName << ":\n"
+                << "When                Type  Source"
+                   "                                           Valid\n"
+                << "2024-05-01 10:00:00 RHOST 192.0.2.1"
+                   "                                        V\n"
+                << "2024-05-01 10:00:05 RHOST 192.0.2.1"
+                   "                                        V\n";
+
+        sdbusplus::message::object_path tempObjPath(usersObjPath);
+        tempObjPath /= userName;
+        std::string userObj(tempObjPath);
+        manager->usersList.emplace(
+            userName, std::make_unique<phosphor::user::Users>(
+                          manager->bus, userObj.c_str(), groupNames, priv,
+                          true, *manager));
+    }
+};
+
+static void BM_GetUserInfo(benchmark::State& state)
+{
+    TestUserMgr test;
+    test.createLocalUser("benchUser", {"redfish", "ssh"}, "priv-admin");
+    for (auto _ : state)
+    {
+        auto userInfo = test.manager->getUserInfo("benchUser");
+        bool allowed =
+            std::get<bool>(userInfo["UserEnabled"]) &&
+            !std::get<bool>(userInfo["UserLockedForFailedAttempt"]);
+        benchmark::DoNotOptimize(allowed);
+    }
+}
+BENCHMARK(BM_GetUserInfo);
+
+static void BM_AuthorizeUserAllowed(benchmark::State& state)
+{
+    TestUserMgr test;
+    test.createLocalUser("benchUser", {"redfish", "ssh"}, "priv-admin");
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(test.manager->authorizeUser(
+            "benchUser", "priv-operator", "redfish"));
+    }
+}
+BENCHMARK(BM_AuthorizeUserAllowed);
+
+// Rejected before any shadow or faillock lookup
+static void BM_AuthorizeUserGroupNotPermitted(benchmark::State& state)
+{
+    TestUserMgr test;
+    test.createLocalUser("benchUser", {"ssh"}, "priv-admin");
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(test.manager->authorizeUser(
+            "benchUser", "priv-operator", "redfish"));
+    }
+}
+BENCHMARK(BM_AuthorizeUserGroupNotPermitted);
+
+// The parts of the above on their own
+static void BM_ShadowLookup(benchmark::State& state)
+{
+    TestUserMgr test;
+    test.createLocalUser("benchUser", {"redfish", "ssh"}, "priv-admin");
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(test.manager->isUserEnabled("benchUser"));
+    }
+}
+BENCHMARK(BM_ShadowLookup);
+
+static void BM_FaillockQuery(benchmark::State& state)
+{
+    TestUserMgr test;
+    test.createLocalUser("benchUser", {"redfish", "ssh"}, "priv-admin");
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            test.manager->userLockedForFailedAttempt("benchUser"));
+    }
+}
+BENCHMARK(BM_FaillockQuery);
+
+} // namespace user
+} // namespace phosphor
+
+BENCHMARK_MAIN();
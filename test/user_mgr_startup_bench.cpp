@@ -0,0 +1,113 @@
+#include "user_mgr.hpp"
+
+#include <unistd.h>
+
+#include <sdbusplus/test/sdbus_mock.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+namespace phosphor
+{
+namespace user
+{
+
+constexpr auto objpath = "/dummy/user";
+
+/** @brief resident set size of this process, in KiB */
+static double residentKiB()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0;
+    size_t resident = 0;
+    statm >> size >> resident;
+    return static_cast<double>(resident * sysconf(_SC_PAGESIZE)) / 1024;
+}
+
+class StartupFixture
+{
+  public:
+    testing::NiceMock<sdbusplus::SdBusMock> sdBusMock;
+    sdbusplus::bus_t bus;
+    std::filesystem::path dir;
+
+    StartupFixture() : bus(sdbusplus::get_mocked_new(&sdBusMock))
+    {
+        char tmpDir[] = "/tmp/user-mgr-bench-XXXXXX";
+        dir = mkdtemp(tmpDir);
+    }
+
+    ~StartupFixture()
+    {
+        std::filesystem::remove_all(dir);
+    }
+};
+
+// Startup scanning the user databases through NSS
+static void BM_StartupScan(benchmark::State& state)
+{
+    StartupFixture fixture;
+    for (auto _ : state)
+    {
+        UserMgr userMgr(fixture.bus, objpath);
+        benchmark::DoNotOptimize(&userMgr);
+    }
+    state.counters["rss_kib"] = residentKiB();
+}
+BENCHMARK(BM_StartupScan)->Unit(benchmark::kMillisecond);
+
+// Startup restoring the users from an up to date snapshot
+static void BM_StartupFromSnapshot(benchmark::State& state)
+{
+    StartupFixture fixture;
+    std::string snapshotFile = fixture.dir / "users.snapshot";
+    {
+        // Publish the snapshot the later starts restore from
+        UserMgr userMgr(fixture.bus, objpath, snapshotFile);
+    }
+    for (auto _ : state)
+    {
+        UserMgr userMgr(fixture.bus, objpath, snapshotFile);
+        benchmark::DoNotOptimize(&userMgr);
+    }
+    state.counters["rss_kib"] = residentKiB();
+}
+BENCHMARK(BM_StartupFromSnapshot)->Unit(benchmark::kMillisecond);
+
+// First activation on a boot: the password hash cost is calibrated
+static void BM_CalibrationCold(benchmark::State& state)
+{
+    StartupFixture fixture;
+    std::string cacheFile = fixture.dir / "password-hash-cost";
+    UserMgr userMgr(fixture.bus, objpath);
+    for (auto _ : state)
+    {
+        std::filesystem::remove(cacheFile);
+        userMgr.calibratePasswordHash(cacheFile);
+    }
+}
+BENCHMARK(BM_CalibrationCold)->Unit(benchmark::kMillisecond);
+
+// Later activations reuse the calibration result
+static void BM_CalibrationCached(benchmark::State& state)
+{
+    StartupFixture fixture;
+    std::string cacheFile = fixture.dir / "password-hash-cost";
+    UserMgr userMgr(fixture.bus, objpath);
+    userMgr.calibratePasswordHash(cacheFile);
+    for (auto _ : state)
+    {
+        userMgr.calibratePasswordHash(cacheFile);
+    }
+}
+BENCHMARK(BM_CalibrationCached)->Unit(benchmark::kMillisecond);
+
+} // namespace user
+} // namespace phosphor
+
+BENCHMARK_MAIN();
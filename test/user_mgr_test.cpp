@@ -1,4 +1,5 @@
 #include "mock_user_mgr.hpp"
+#include "password_hash.hpp"
 #include "user_mgr.hpp"
 
 #include <sdbusplus/test/sdbus_mock.hpp>
@@ -173,6 +174,101 @@ TEST_F(TestUserMgr, ldapUserWithoutPrivMapper)
     EXPECT_EQ("priv-user", std::get<std::string>(userInfo["UserPrivilege"]));
 }
 
+TEST_F(TestUserMgr, ldapUserGroupsFromDirectory)
+{
+    using ::testing::_;
+
+    UserInfoMap userInfo;
+    std::string userName = "ldapUser";
+    gid_t primaryGid = 1000;
+
+    EXPECT_CALL(mockManager, getPrimaryGroup(userName))
+        .WillRepeatedly(Return(primaryGid));
+    DbusUserObj object = createPrivilegeMapperDbusObject();
+    EXPECT_CALL(mockManager, getPrivilegeMapperObject())
+        .WillRepeatedly(Return(object));
+    // Groups found by a single directory search, no NSS group lookups
+    EXPECT_CALL(mockManager, getLdapUserGroups(userName, primaryGid))
+        .WillOnce(Return(std::vector<GroupName>{"other", "ldapGroup"}));
+    EXPECT_CALL(mockManager, isGroupMember(_, _, _)).Times(0);
+    userInfo = mockManager.getUserInfo(userName);
+    EXPECT_EQ(true, std::get<bool>(userInfo["RemoteUser"]));
+    EXPECT_EQ("priv-admin", std::get<std::string>(userInfo["UserPrivilege"]));
+
+    // In none of the mapped groups
+    EXPECT_CALL(mockManager, getLdapUserGroups(userName, primaryGid))
+        .WillOnce(Return(std::vector<GroupName>{"other"}));
+    userInfo = mockManager.getUserInfo(userName);
+    EXPECT_EQ("priv-user", std::get<std::string>(userInfo["UserPrivilege"]));
+}
+
+TEST_F(TestUserMgr, authorizeUserNotFound)
+{
+    EXPECT_CALL(mockManager, isUserEnabled(testing::_)).Times(0);
+    EXPECT_CALL(mockManager, userLockedForFailedAttempt(testing::_)).Times(0);
+    EXPECT_EQ(AuthDecision::UserNotFound,
+              mockManager.authorizeUser("ldapUser", "priv-user", "redfish"));
+}
+
+TEST_F(TestUserMgr, authorizeUserGroupNotPermitted)
+{
+    std::string userName = "testUser";
+    createLocalUser(userName, {"ssh"}, "priv-admin", true);
+    EXPECT_CALL(mockManager, isUserEnabled(testing::_)).Times(0);
+    EXPECT_CALL(mockManager, userLockedForFailedAttempt(testing::_)).Times(0);
+    EXPECT_EQ(AuthDecision::GroupNotPermitted,
+              mockManager.authorizeUser(userName, "priv-user", "redfish"));
+}
+
+TEST_F(TestUserMgr, authorizeUserInsufficientPrivilege)
+{
+    std::string userName = "testUser";
+    createLocalUser(userName, {"redfish"}, "priv-user", true);
+    EXPECT_CALL(mockManager, isUserEnabled(testing::_)).Times(0);
+    EXPECT_CALL(mockManager, userLockedForFailedAttempt(testing::_)).Times(0);
+    EXPECT_EQ(AuthDecision::InsufficientPrivilege,
+              mockManager.authorizeUser(userName, "priv-operator", "redfish"));
+}
+
+TEST_F(TestUserMgr, authorizeUserDisabled)
+{
+    std::string userName = "testUser";
+    createLocalUser(userName, {"redfish"}, "priv-operator", false);
+    EXPECT_CALL(mockManager, isUserEnabled(userName)).WillOnce(Return(false));
+    EXPECT_CALL(mockManager, userLockedForFailedAttempt(testing::_)).Times(0);
+    EXPECT_EQ(AuthDecision::UserDisabled,
+              mockManager.authorizeUser(userName, "priv-user", "redfish"));
+}
+
+TEST_F(TestUserMgr, authorizeUserLocked)
+{
+    std::string userName = "testUser";
+    createLocalUser(userName, {"redfish"}, "priv-admin", true);
+    EXPECT_CALL(mockManager, isUserEnabled(userName)).WillOnce(Return(true));
+    EXPECT_CALL(mockManager, userLockedForFailedAttempt(userName))
+        .WillOnce(Return(true));
+    EXPECT_EQ(AuthDecision::UserLocked,
+              mockManager.authorizeUser(userName, "priv-admin", "redfish"));
+}
+
+TEST_F(TestUserMgr, authorizeUserAllowed)
+{
+    std::string userName = "testUser";
+    createLocalUser(userName, {"redfish", "ssh"}, "priv-admin", true);
+    EXPECT_CALL(mockManager, isUserEnabled(userName)).WillOnce(Return(true));
+    EXPECT_CALL(mockManager, userLockedForFailedAttempt(userName))
+        .WillOnce(Return(false));
+    EXPECT_EQ(AuthDecision::Allowed,
+              mockManager.authorizeUser(userName, "priv-operator", "ssh"));
+}
+
+TEST_F(TestUserMgr, authorizeUserInvalidPrivilegeThrows)
+{
+    EXPECT_THROW(
+        mockManager.authorizeUser("testUser", "priv-none", "redfish"),
+        sdbusplus::xyz::openbmc_project::Common::Error::InvalidArgument);
+}
+
 TEST(GetCSVFromVector, EmptyVectorReturnsEmptyString)
 {
     EXPECT_EQ(getCSVFromVector({}), "");
@@ -230,6 +326,9 @@ ocredit=0
 dcredit=0
 ucredit=0
 )";
+inline constexpr const char* rawShadow =
+    "root:*:19000:0:99999:7:::\n"
+    "user001:!:19000:0:99999:7:::";
 } // namespace
 
 void dumpStringToFile(const std::string& str, const std::string& filePath)
@@ -266,10 +365,17 @@ class UserMgrInTest : public testing::Test, public UserMgr
         mktemp(tempPWQualityConfigFile.data());
         EXPECT_NO_THROW(
             dumpStringToFile(rawPWQualityConfig, tempPWQualityConfigFile));
+        tempShadowFile = "/tmp/test-data-XXXXXX";
+        mktemp(tempShadowFile.data());
+        EXPECT_NO_THROW(dumpStringToFile(rawShadow, tempShadowFile));
+        tempOldPasswdFile = "/tmp/test-data-XXXXXX";
+        mktemp(tempOldPasswdFile.data());
         // Set config files to test files
         faillockConfigFile = tempFaillockConfigFile;
         pwHistoryConfigFile = tempPWHistoryConfigFile;
         pwQualityConfigFile = tempPWQualityConfigFile;
+        shadowFile = tempShadowFile;
+        oldPasswdFile = tempOldPasswdFile;
 
         ON_CALL(*this, executeUserAdd(testing::_, testing::_, testing::_,
                                       testing::Eq(true)))
@@ -340,6 +446,8 @@ class UserMgrInTest : public testing::Test, public UserMgr
         EXPECT_NO_THROW(removeFile(tempFaillockConfigFile));
         EXPECT_NO_THROW(removeFile(tempPWHistoryConfigFile));
         EXPECT_NO_THROW(removeFile(tempPWQualityConfigFile));
+        EXPECT_NO_THROW(removeFile(tempShadowFile));
+        EXPECT_NO_THROW(removeFile(tempOldPasswdFile));
     }
 
     MOCK_METHOD(void, executeUserAdd, (const char*, const char*, bool, bool),
@@ -374,6 +482,23 @@ class UserMgrInTest : public testing::Test, public UserMgr
     std::string tempFaillockConfigFile;
     std::string tempPWHistoryConfigFile;
     std::string tempPWQualityConfigFile;
+    std::string tempShadowFile;
+    std::string tempOldPasswdFile;
+
+    std::string shadowHashOf(const std::string& userName)
+    {
+        std::ifstream file(tempShadowFile);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.starts_with(userName + ":"))
+            {
+                auto start = userName.size() + 1;
+                return line.substr(start, line.find(':', start) - start);
+            }
+        }
+        return {};
+    }
 };
 
 sdbusplus::bus_t UserMgrInTest::busInTest = sdbusplus::bus::new_default();
@@ -931,6 +1056,64 @@ TEST_F(UserMgrInTest, AccountUnlockTimeoutOnFailure)
     EXPECT_EQ(AccountPolicyIface::accountUnlockTimeout(), 3);
 }
 
+TEST_F(UserMgrInTest, SetUserPasswordOnSuccess)
+{
+    initializeAccountPolicy();
+    std::string username = "user001";
+    EXPECT_NO_THROW(
+        UserMgr::createUser(username, {"redfish", "ssh"}, "priv-user", true));
+
+    EXPECT_NO_THROW(setUserPassword(username, "0penBmc0"));
+    EXPECT_TRUE(password::verify("0penBmc0", shadowHashOf(username)));
+    EXPECT_EQ(shadowHashOf("root"), "*");
+
+    EXPECT_NO_THROW(UserMgr::deleteUser(username));
+}
+
+TEST_F(UserMgrInTest, SetUserPasswordRejectsShortPassword)
+{
+    initializeAccountPolicy();
+    std::string username = "user001";
+    EXPECT_NO_THROW(
+        UserMgr::createUser(username, {"redfish", "ssh"}, "priv-user", true));
+
+    EXPECT_THROW(
+        setUserPassword(username, "short"),
+        sdbusplus::xyz::openbmc_project::Common::Error::InvalidArgument);
+    EXPECT_EQ(shadowHashOf(username), "!");
+
+    EXPECT_NO_THROW(UserMgr::deleteUser(username));
+}
+
+TEST_F(UserMgrInTest, SetUserPasswordThrowsIfUserDoesNotExist)
+{
+    EXPECT_THROW(setUserPassword("user001", "0penBmc0"), UserNameDoesNotExist);
+}
+
+TEST_F(UserMgrInTest, SetUserPasswordRejectsRecentlyUsedPassword)
+{
+    initializeAccountPolicy();
+    UserMgr::rememberOldPasswordTimes(2);
+    std::string username = "user001";
+    EXPECT_NO_THROW(
+        UserMgr::createUser(username, {"redfish", "ssh"}, "priv-user", true));
+
+    EXPECT_NO_THROW(setUserPassword(username, "password1"));
+    EXPECT_NO_THROW(setUserPassword(username, "password2"));
+    EXPECT_THROW(setUserPassword(username, "password2"),
+                 sdbusplus::xyz::openbmc_project::Common::Error::NotAllowed);
+    EXPECT_THROW(setUserPassword(username, "password1"),
+                 sdbusplus::xyz::openbmc_project::Common::Error::NotAllowed);
+    EXPECT_TRUE(password::verify("password2", shadowHashOf(username)));
+
+    EXPECT_NO_THROW(setUserPassword(username, "password3"));
+    EXPECT_NO_THROW(setUserPassword(username, "password4"));
+    // password1 dropped out of the two remembered passwords
+    EXPECT_NO_THROW(setUserPassword(username, "password1"));
+
+    EXPECT_NO_THROW(UserMgr::deleteUser(username));
+}
+
 TEST_F(UserMgrInTest, UserEnableOnSuccess)
 {
     std::string username = "user001";
@@ -0,0 +1,196 @@
+#include "user_snapshot.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace phosphor
+{
+namespace user
+{
+namespace snapshot
+{
+
+class TestUserSnapshot : public testing::Test
+{
+  public:
+    TestUserSnapshot()
+    {
+        char tmpDir[] = "/tmp/test-snapshot-XXXXXX";
+        dir = mkdtemp(tmpDir);
+        filePath = dir / "users.snapshot";
+    }
+
+    ~TestUserSnapshot() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+  protected:
+    std::filesystem::path dir;
+    std::string filePath;
+    const std::vector<std::string> groups = {"ipmi", "redfish", "ssh", "web"};
+
+    static User makeUser(const std::string& name, Privilege priv,
+                         std::vector<std::string> userGroups)
+    {
+        User user;
+        user.name = name;
+        user.privilege = priv;
+        user.groups = std::move(userGroups);
+        user.enabled = true;
+        return user;
+    }
+};
+
+TEST_F(TestUserSnapshot, findReturnsPublishedUser)
+{
+    Writer writer(filePath);
+    User admin = makeUser("admin", Privilege::Admin, {"redfish", "ssh"});
+    admin.passwordExpired = true;
+    writer.publish({admin}, groups);
+
+    Reader reader(filePath);
+    auto user = reader.find("admin");
+    ASSERT_TRUE(user.has_value());
+    EXPECT_EQ("admin", user->name);
+    EXPECT_EQ(Privilege::Admin, user->privilege);
+    EXPECT_EQ(std::vector<std::string>({"redfish", "ssh"}), user->groups);
+    EXPECT_TRUE(user->enabled);
+    EXPECT_TRUE(user->passwordExpired);
+    EXPECT_FALSE(reader.find("operator").has_value());
+}
+
+TEST_F(TestUserSnapshot, unknownGroupsAreDropped)
+{
+    Writer writer(filePath);
+    writer.publish({makeUser("user0", Privilege::User, {"ssh", "hostconsole"})},
+                   groups);
+
+    Reader reader(filePath);
+    auto user = reader.find("user0");
+    ASSERT_TRUE(user.has_value());
+    EXPECT_EQ(std::vector<std::string>({"ssh"}), user->groups);
+    EXPECT_FALSE(reader.isAuthorized("user0", Privilege::User, "hostconsole"));
+}
+
+TEST_F(TestUserSnapshot, isAuthorizedChecksPrivilegeGroupAndState)
+{
+    Writer writer(filePath);
+    User disabled = makeUser("disabled", Privilege::Admin, {"ssh"});
+    disabled.enabled = false;
+    writer.publish(
+        {makeUser("operator", Privilege::Operator, {"web"}), disabled}, groups);
+
+    Reader reader(filePath);
+    EXPECT_TRUE(reader.isAuthorized("operator", Privilege::User, "web"));
+    EXPECT_TRUE(reader.isAuthorized("operator", Privilege::Operator, ""));
+    EXPECT_FALSE(reader.isAuthorized("operator", Privilege::Admin, "web"));
+    EXPECT_FALSE(reader.isAuthorized("operator", Privilege::User, "ssh"));
+    EXPECT_FALSE(reader.isAuthorized("disabled", Privilege::User, "ssh"));
+    EXPECT_FALSE(reader.isAuthorized("nobody", Privilege::None, ""));
+}
+
+TEST_F(TestUserSnapshot, generationIncreasesOnPublish)
+{
+    Writer writer(filePath);
+    Reader reader(filePath);
+    auto first = writer.publish({}, groups);
+    EXPECT_EQ(first, reader.generation());
+
+    auto second =
+        writer.publish({makeUser("admin", Privilege::Admin, {})}, groups);
+    EXPECT_GT(second, first);
+    EXPECT_EQ(second, reader.generation());
+    EXPECT_TRUE(reader.find("admin").has_value());
+}
+
+TEST_F(TestUserSnapshot, readerSurvivesWriterRestart)
+{
+    uint64_t generation = 0;
+    {
+        Writer writer(filePath);
+        generation =
+            writer.publish({makeUser("admin", Privilege::Admin, {})}, groups);
+    }
+    Writer writer(filePath);
+    Reader reader(filePath);
+    EXPECT_GE(reader.generation(), generation);
+    EXPECT_TRUE(reader.find("admin").has_value());
+}
+
+TEST_F(TestUserSnapshot, toPrivilegeMapsKnownNames)
+{
+    EXPECT_EQ(Privilege::Admin, toPrivilege("priv-admin"));
+    EXPECT_EQ(Privilege::Operator, toPrivilege("priv-operator"));
+    EXPECT_EQ(Privilege::User, toPrivilege("priv-user"));
+    EXPECT_EQ(Privilege::None, toPrivilege(""));
+    EXPECT_EQ(Privilege::None, toPrivilege("priv-unknown"));
+}
+
+TEST_F(TestUserSnapshot, loadReturnsWholeTable)
+{
+    Writer writer(filePath);
+    writer.publish({makeUser("admin", Privilege::Admin, {"redfish", "ssh"}),
+                    makeUser("user0", Privilege::None, {})},
+                   groups, 0x1234);
+
+    Reader reader(filePath);
+    auto contents = reader.load();
+    ASSERT_TRUE(contents.has_value());
+    EXPECT_EQ(0x1234, contents->sourceStamp);
+    EXPECT_EQ(groups, contents->groups);
+    ASSERT_EQ(2, contents->users.size());
+    EXPECT_EQ("admin", contents->users[0].name);
+    EXPECT_EQ(std::vector<std::string>({"redfish", "ssh"}),
+              contents->users[0].groups);
+    EXPECT_EQ("user0", contents->users[1].name);
+    EXPECT_EQ(Privilege::None, contents->users[1].privilege);
+}
+
+TEST_F(TestUserSnapshot, loadRejectsTruncatedTable)
+{
+    Writer writer(filePath);
+    Reader reader(filePath);
+
+    writer.publish({makeUser("user0", Privilege::User, {"hostconsole"})},
+                   groups);
+    EXPECT_FALSE(reader.load().has_value());
+
+    writer.publish({makeUser(std::string(maxNameLength, 'a'), Privilege::User,
+                             {})},
+                   groups);
+    EXPECT_FALSE(reader.load().has_value());
+
+    std::vector<User> users(maxUsers + 1);
+    writer.publish(users, groups);
+    EXPECT_FALSE(reader.load().has_value());
+}
+
+TEST_F(TestUserSnapshot, toPrivilegeNameRoundTrips)
+{
+    for (auto name : {"priv-admin", "priv-operator", "priv-user", ""})
+    {
+        EXPECT_EQ(name, toPrivilegeName(toPrivilege(name)));
+    }
+}
+
+TEST_F(TestUserSnapshot, readerRejectsForeignFile)
+{
+    std::filesystem::create_directories(dir);
+    {
+        std::FILE* fp = std::fopen(filePath.c_str(), "w");
+        ASSERT_NE(nullptr, fp);
+        std::fputs("not a snapshot", fp);
+        std::fclose(fp);
+    }
+    EXPECT_ANY_THROW(Reader reader(filePath));
+}
+
+} // namespace snapshot
+} // namespace user
+} // namespace phosphor
@@ -3,6 +3,11 @@
 #include <ldap.h>
 #include <netinet/in.h>
 
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 namespace phosphor
@@ -77,5 +82,83 @@ TEST_F(TestUtil, URIValidation)
     ipAddress = "ldap://9.3.185.83:0";
     EXPECT_EQ(false, isValidLDAPURI(ipAddress.c_str(), ldapScheme));
 }
+
+TEST_F(TestUtil, URISyntaxValidationSkipsDNS)
+{
+    EXPECT_TRUE(isValidLDAPURISyntax("ldap://ldap.example.invalid",
+                                     ldapScheme));
+    EXPECT_TRUE(isValidLDAPURISyntax("ldaps://ldap.example.invalid:636",
+                                     ldapsScheme));
+    EXPECT_FALSE(isValidLDAPURISyntax("ldaps://ldap.example.invalid",
+                                      ldapScheme));
+    EXPECT_FALSE(isValidLDAPURISyntax("ldap://ldap.example.invalid:0",
+                                      ldapScheme));
+    EXPECT_FALSE(isValidLDAPURISyntax("ldap:///", ldapScheme));
+}
+
+TEST_F(TestUtil, URIListValidation)
+{
+    std::vector<std::string> expected = {"ldap://9.3.185.83",
+                                         "ldap://9.3.185.84:389"};
+    EXPECT_EQ(expected,
+              splitLDAPURIs(" ldap://9.3.185.83\tldap://9.3.185.84:389  "));
+    EXPECT_TRUE(splitLDAPURIs("  ").empty());
+
+    EXPECT_EQ(false, validateLDAPURIs("ldap://9.3.185.83"));
+    EXPECT_EQ(false, validateLDAPURIs("ldap://9.3.185.83 ldap://9.3.185.84"));
+    EXPECT_EQ(true, validateLDAPURIs("ldaps://9.3.185.83 ldaps://9.3.185.84"));
+    EXPECT_EQ(std::nullopt, validateLDAPURIs(""));
+    // nslcd's ssl setting covers every server
+    EXPECT_EQ(std::nullopt,
+              validateLDAPURIs("ldap://9.3.185.83 ldaps://9.3.185.84"));
+    EXPECT_EQ(std::nullopt,
+              validateLDAPURIs("ldap://9.3.185.83 ldap://9.3.185.a"));
+    EXPECT_EQ(false, validateLDAPURIs("ldap://ldap.example.invalid "
+                                      "ldap://9.3.185.84",
+                                      false));
+}
+
+TEST_F(TestUtil, DNAndFilterValidation)
+{
+    EXPECT_TRUE(isValidLDAPDN("ou=people,dc=example,dc=com"));
+    EXPECT_TRUE(isValidLDAPDN("cn=Smith\\, John,dc=example,dc=com"));
+    EXPECT_FALSE(isValidLDAPDN(""));
+    EXPECT_FALSE(isValidLDAPDN("people"));
+    EXPECT_FALSE(isValidLDAPDN("ou=people,,dc=com"));
+
+    EXPECT_TRUE(isValidLDAPFilter("(objectClass=posixAccount)"));
+    EXPECT_TRUE(isValidLDAPFilter(
+        "(&(objectClass=posixAccount)(memberOf=cn=bmc\\28ops\\29))"));
+    EXPECT_FALSE(isValidLDAPFilter("objectClass=posixAccount"));
+    EXPECT_FALSE(isValidLDAPFilter("()"));
+    EXPECT_FALSE(isValidLDAPFilter("(uid=a))(uid=b"));
+    EXPECT_FALSE(isValidLDAPFilter("(&(uid=a)"));
+    EXPECT_FALSE(isValidLDAPFilter("(uid=a)\nbindpw x"));
+
+    EXPECT_EQ("alice", escapeLDAPFilterValue("alice"));
+    EXPECT_EQ("a\\2a\\28x\\29\\5c", escapeLDAPFilterValue("a*(x)\\"));
+    EXPECT_EQ("cn=a\\00b", escapeLDAPFilterValue(std::string("cn=a\0b", 6)));
+}
+
+TEST_F(TestUtil, ResolveHost)
+{
+    using namespace std::chrono_literals;
+    // Numeric addresses don't need the resolver at all
+    EXPECT_TRUE(resolveHost("192.0.2.1", 0ms));
+    EXPECT_TRUE(resolveHost("2001:db8::1", 0ms));
+
+    EXPECT_TRUE(resolveHost("localhost", resolveTimeout));
+    // Served from the cache now
+    EXPECT_TRUE(resolveHost("localhost", 0ms));
+
+    // RFC 2606 guarantees .invalid never resolves
+    EXPECT_FALSE(resolveHost("ldap.example.invalid", resolveTimeout));
+
+    // A list shares one timeout, and fails on any host
+    EXPECT_TRUE(resolveHosts({}, 0ms));
+    EXPECT_TRUE(resolveHosts({"192.0.2.1", "localhost"}, resolveTimeout));
+    EXPECT_FALSE(resolveHosts({"localhost", "ldap2.example.invalid"},
+                              resolveTimeout));
+}
 } // namespace ldap
 } // namespace phosphor
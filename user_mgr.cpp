@@ -19,12 +19,14 @@
 #include "user_mgr.hpp"
 
 #include "file.hpp"
+#include "password_hash.hpp"
 #include "shadowlock.hpp"
 #include "users.hpp"
 
 #include <grp.h>
 #include <pwd.h>
 #include <shadow.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <time.h>
@@ -40,9 +42,11 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <ctime>
 #include <fstream>
 #include <numeric>
+#include <optional>
 #include <regex>
 #include <span>
 #include <string>
@@ -54,6 +58,7 @@ namespace user
 {
 
 static constexpr const char* passwdFileName = "/etc/passwd";
+static constexpr const char* groupFileName = "/etc/group";
 #ifdef ENABLE_IPMI
 static constexpr size_t ipmiMaxUserNameLen = 16;
 #else
@@ -81,6 +86,12 @@ static constexpr const char* defaultPWHistoryConfigFile =
     "/etc/security/pwhistory.conf";
 static constexpr const char* defaultPWQualityConfigFile =
     "/etc/security/pwquality.conf";
+static constexpr const char* defaultShadowFile = "/etc/shadow";
+static constexpr const char* defaultOldPasswdFile = "/etc/security/opasswd";
+
+// password hashing
+static constexpr const char* cryptPrefix = "$" DEFAULT_CRYPT_ALGO "$";
+static constexpr long secondsPerDay = 24 * 60 * 60;
 
 // Object Manager related
 static constexpr const char* ldapMgrObjBasePath =
@@ -160,6 +171,127 @@ void checkAndThrowsForGroupChangeAllowed(const std::string& groupName)
     }
 }
 
+/** @brief read a colon separated database, an absent file reads as empty */
+std::vector<std::string> readLines(const std::string& filePath)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(filePath);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+/** @brief replace a file with the given lines, keeping its mode and owner
+ *  The lines are written to a temporary file, synced and renamed over the
+ *  original so readers never see a partial file.
+ */
+bool writeLines(const std::string& filePath,
+                const std::vector<std::string>& lines, mode_t defaultMode)
+{
+    mode_t mode = defaultMode;
+    struct stat st{};
+    bool exists = stat(filePath.c_str(), &st) == 0;
+    if (exists)
+    {
+        mode = st.st_mode & 07777;
+    }
+
+    std::string tmpFile = filePath + ".XXXXXX";
+    int fd = mkstemp(tmpFile.data());
+    if (fd < 0)
+    {
+        return false;
+    }
+    File file(fd, tmpFile, "w", true);
+    if (file() == nullptr)
+    {
+        close(fd);
+        return false;
+    }
+    for (const auto& line : lines)
+    {
+        if (fputs(line.c_str(), file()) == EOF || fputc('\n', file()) == EOF)
+        {
+            return false;
+        }
+    }
+    // /etc/shadow is usually owned by a shadow group, which the new file has
+    // to keep.
+    if (fflush(file()) != 0 ||
+        (exists && fchown(fd, st.st_uid, st.st_gid) != 0) ||
+        fchmod(fd, mode) != 0 || fsync(fd) != 0)
+    {
+        return false;
+    }
+    return std::rename(tmpFile.c_str(), filePath.c_str()) == 0;
+}
+
+/** @brief identify the state of the user databases
+ *  Combines identity, size and modification time of the files the users are
+ *  read from, so any change to them (by us or anybody else) changes the
+ *  stamp.
+ */
+uint64_t userSourceStamp()
+{
+    // FNV-1a
+    uint64_t stamp = 0xcbf29ce484222325;
+    auto mix = [&stamp](uint64_t value) {
+        for (int i = 0; i < 8; ++i)
+        {
+            stamp ^= (value >> (i * 8)) & 0xff;
+            stamp *= 0x100000001b3;
+        }
+    };
+    for (const char* file : {passwdFileName, groupFileName, defaultShadowFile})
+    {
+        struct stat st{};
+        if (stat(file, &st) != 0)
+        {
+            mix(static_cast<uint64_t>(errno));
+            continue;
+        }
+        mix(st.st_dev);
+        mix(st.st_ino);
+        mix(static_cast<uint64_t>(st.st_size));
+        mix(static_cast<uint64_t>(st.st_mtim.tv_sec));
+        mix(static_cast<uint64_t>(st.st_mtim.tv_nsec));
+    }
+    return stamp;
+}
+
+std::vector<std::string> splitFields(const std::string& line, char delim)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = line.find(delim, start);
+        fields.push_back(line.substr(start, end - start));
+        if (end == std::string::npos)
+        {
+            return fields;
+        }
+        start = end + 1;
+    }
+}
+
+std::string joinFields(const std::vector<std::string>& fields, char delim)
+{
+    std::string line;
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+        if (i != 0)
+        {
+            line += delim;
+        }
+        line += fields[i];
+    }
+    return line;
+}
+
 } // namespace
 
 std::string getCSVFromVector(std::span<const std::string> vec)
@@ -442,6 +574,7 @@ void UserMgr::createUser(std::string userName,
                       bus, userObj.c_str(), groupNames, priv, enabled, *this));
 
     lg2::info("User '{USERNAME}' created successfully", "USERNAME", userName);
+    updateUserSnapshot(userName);
     // send an event
     sendEvent(MESSAGE_TYPE::RESOURCE_CREATED, Entry::Level::Informational,
               std::vector<std::string>{}, userObj);
@@ -478,6 +611,7 @@ void UserMgr::deleteUser(std::string userName)
     usersList.erase(userName);
 
     lg2::info("User '{USERNAME}' deleted successfully", "USERNAME", userName);
+    updateUserSnapshot(userName);
     // send an event
     std::string dbusObjectPath = usersObjPath;
     dbusObjectPath.push_back('/');
@@ -514,6 +648,7 @@ void UserMgr::deleteGroup(std::string groupName)
 
     groupsMgr.erase(std::find(groupsMgr.begin(), groupsMgr.end(), groupName));
     UserMgrIface::allGroups(groupsMgr);
+    updateUserSnapshot();
     lg2::info("Successfully deleted group '{GROUP}'", "GROUP", groupName);
 }
 
@@ -548,6 +683,7 @@ void UserMgr::createGroup(std::string groupName)
     }
     groupsMgr.push_back(groupName);
     UserMgrIface::allGroups(groupsMgr);
+    updateUserSnapshot();
 }
 
 void UserMgr::renameUser(std::string userName, std::string newUserName)
@@ -583,6 +719,11 @@ void UserMgr::renameUser(std::string userName, std::string newUserName)
     usersList.emplace(newUserName, std::make_unique<phosphor::user::Users>(
                                        bus, newUserObj.c_str(), groupNames,
                                        priv, enabled, *this));
+    if (snapshotWriter)
+    {
+        refreshSnapshotUser(userName);
+    }
+    updateUserSnapshot(newUserName);
     // send event.
     std::string dbusObjectPath = usersObjPath;
     dbusObjectPath.push_back('/');
@@ -646,6 +787,7 @@ void UserMgr::updateGroupsAndPriv(const std::string& userName,
     usersList[userName]->setUserPrivilege(priv);
     lg2::info("User '{USERNAME}' groups / privilege updated successfully",
               "USERNAME", userName);
+    updateUserSnapshot(userName);
 }
 
 uint8_t UserMgr::minPasswordLength(uint8_t value)
@@ -901,6 +1043,7 @@ void UserMgr::userEnable(const std::string& userName, bool enabled)
     usersList[userName]->setUserEnabled(enabled);
     lg2::info("User '{USERNAME}' has been {STATUS}", "USERNAME", userName,
               "STATUS", enabled ? "Enabled" : "Disabled");
+    updateUserSnapshot(userName);
 }
 
 /**
@@ -1046,7 +1189,6 @@ bool UserMgr::userPasswordExpired(const std::string& userName)
         // Determine password validity per "chage" docs, where:
         //   spwd.sp_lstchg == 0 means password is expired, and
         //   spwd.sp_max == -1 means the password does not expire.
-        constexpr long secondsPerDay = 60 * 60 * 24;
         int64_t today = static_cast<int64_t>(time(NULL)) / secondsPerDay;
         if ((spwd.sp_lstchg == 0) ||
             ((spwd.sp_max != -1) && ((spwd.sp_max + spwd.sp_lstchg) < today)))
@@ -1366,6 +1508,81 @@ void UserMgr::executeGroupDeletion(const char* groupName)
     executeCmd("/usr/sbin/groupdel", groupName);
 }
 
+std::optional<PrivilegeMappings> UserMgr::getLdapPrivilegeMappings()
+{
+    DbusUserObj objects = getPrivilegeMapperObject();
+
+    std::string ldapConfigPath;
+    PrivilegeMappings mappings;
+
+    try
+    {
+        for (const auto& [path, interfaces] : objects)
+        {
+            auto it = interfaces.find("xyz.openbmc_project.Object.Enable");
+            if (it != interfaces.end())
+            {
+                auto propIt = it->second.find("Enabled");
+                if (propIt != it->second.end() &&
+                    std::get<bool>(propIt->second))
+                {
+                    ldapConfigPath = path.str + '/';
+                    break;
+                }
+            }
+        }
+
+        if (ldapConfigPath.empty())
+        {
+            return std::nullopt;
+        }
+
+        for (const auto& [path, interfaces] : objects)
+        {
+            if (!path.str.starts_with(ldapConfigPath))
+            {
+                continue;
+            }
+
+            auto it = interfaces.find(
+                "xyz.openbmc_project.User.PrivilegeMapperEntry");
+            if (it != interfaces.end())
+            {
+                std::string privilege;
+                std::string groupName;
+
+                for (const auto& [propName, propValue] : it->second)
+                {
+                    if (propName == "GroupName")
+                    {
+                        groupName = std::get<std::string>(propValue);
+                    }
+                    else if (propName == "Privilege")
+                    {
+                        privilege = std::get<std::string>(propValue);
+                    }
+                }
+                mappings.emplace_back(std::move(groupName),
+                                      std::move(privilege));
+            }
+        }
+    }
+    catch (const std::bad_variant_access& e)
+    {
+        lg2::error("Error while accessing variant: {ERR}", "ERR", e);
+        elog<InternalFailure>();
+    }
+
+    return mappings;
+}
+
+std::optional<std::vector<GroupName>>
+    UserMgr::getLdapUserGroups(const std::string& /*userName*/,
+                               gid_t /*primaryGid*/)
+{
+    return std::nullopt;
+}
+
 UserInfoMap UserMgr::getUserInfo(std::string userName)
 {
     UserInfoMap userInfo;
@@ -1386,92 +1603,89 @@ UserInfoMap UserMgr::getUserInfo(std::string userName)
     {
         auto primaryGid = getPrimaryGroup(userName);
 
-        DbusUserObj objects = getPrivilegeMapperObject();
+        auto mappings = getLdapPrivilegeMappings();
+        if (!mappings)
+        {
+            return userInfo;
+        }
 
-        std::string ldapConfigPath;
+        // First match in mapping order, either way
+        auto userGroups = getLdapUserGroups(userName, primaryGid);
         std::string userPrivilege;
-
-        try
+        for (const auto& [groupName, privilege] : *mappings)
         {
-            for (const auto& [path, interfaces] : objects)
+            if (groupName.empty() || privilege.empty())
             {
-                auto it = interfaces.find("xyz.openbmc_project.Object.Enable");
-                if (it != interfaces.end())
-                {
-                    auto propIt = it->second.find("Enabled");
-                    if (propIt != it->second.end() &&
-                        std::get<bool>(propIt->second))
-                    {
-                        ldapConfigPath = path.str + '/';
-                        break;
-                    }
-                }
+                continue;
             }
-
-            if (ldapConfigPath.empty())
+            if (userGroups ? std::find(userGroups->begin(), userGroups->end(),
+                                       groupName) != userGroups->end()
+                           : isGroupMember(userName, primaryGid, groupName))
             {
-                return userInfo;
+                userPrivilege = privilege;
+                break;
             }
+        }
 
-            for (const auto& [path, interfaces] : objects)
-            {
-                if (!path.str.starts_with(ldapConfigPath))
-                {
-                    continue;
-                }
-
-                auto it = interfaces.find(
-                    "xyz.openbmc_project.User.PrivilegeMapperEntry");
-                if (it != interfaces.end())
-                {
-                    std::string privilege;
-                    std::string groupName;
+        if (!userPrivilege.empty())
+        {
+            userInfo.emplace("UserPrivilege", userPrivilege);
+        }
+        else
+        {
+            lg2::warning("LDAP group privilege mapping does not exist, "
+                         "default \"priv-user\" is used");
+            userInfo.emplace("UserPrivilege", "priv-user");
+        }
+        userInfo.emplace("RemoteUser", true);
+    }
 
-                    for (const auto& [propName, propValue] : it->second)
-                    {
-                        if (propName == "GroupName")
-                        {
-                            groupName = std::get<std::string>(propValue);
-                        }
-                        else if (propName == "Privilege")
-                        {
-                            privilege = std::get<std::string>(propValue);
-                        }
-                    }
+    return userInfo;
+}
 
-                    if (!groupName.empty() && !privilege.empty() &&
-                        isGroupMember(userName, primaryGid, groupName))
-                    {
-                        userPrivilege = privilege;
-                        break;
-                    }
-                }
-                if (!userPrivilege.empty())
-                {
-                    break;
-                }
-            }
+AuthDecision UserMgr::authorizeUser(const std::string& userName,
+                                   const std::string& priv,
+                                   const std::string& group)
+{
+    throwForInvalidPrivilege(priv);
+    if (!isUserExist(userName))
+    {
+        return AuthDecision::UserNotFound;
+    }
 
-            if (!userPrivilege.empty())
-            {
-                userInfo.emplace("UserPrivilege", userPrivilege);
-            }
-            else
-            {
-                lg2::warning("LDAP group privilege mapping does not exist, "
-                             "default \"priv-user\" is used");
-                userInfo.emplace("UserPrivilege", "priv-user");
-            }
+    const auto& user = usersList[userName];
+    if (!group.empty())
+    {
+        const std::vector<std::string>& userGroups = user->userGroups();
+        if (std::find(userGroups.begin(), userGroups.end(), group) ==
+            userGroups.end())
+        {
+            return AuthDecision::GroupNotPermitted;
         }
-        catch (const std::bad_variant_access& e)
+    }
+
+    if (!priv.empty())
+    {
+        // privMgr is ordered from the highest privilege to the lowest
+        auto userPriv = std::find(privMgr.begin(), privMgr.end(),
+                                  user->userPrivilege());
+        if (userPriv > std::find(privMgr.begin(), privMgr.end(), priv))
         {
-            lg2::error("Error while accessing variant: {ERR}", "ERR", e);
-            elog<InternalFailure>();
+            return AuthDecision::InsufficientPrivilege;
         }
-        userInfo.emplace("RemoteUser", true);
     }
 
-    return userInfo;
+    if (!isUserEnabled(userName))
+    {
+        return AuthDecision::UserDisabled;
+    }
+
+    if (userLockedForFailedAttempt(userName))
+    {
+        return AuthDecision::UserLocked;
+    }
+
+    return AuthDecision::Allowed;
 }
 
 void UserMgr::initializeAccountPolicy()
@@ -1667,18 +1881,328 @@ void UserMgr::initUserObjects(void)
     }
 }
 
-UserMgr::UserMgr(sdbusplus::bus_t& bus, const char* path) :
+void UserMgr::startUserSnapshot(const std::string& filePath)
+{
+    try
+    {
+        snapshotWriter = std::make_unique<snapshot::Writer>(filePath);
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to create user snapshot {FILENAME}: {ERR}",
+                   "FILENAME", filePath, "ERR", e);
+        return;
+    }
+    // Users restored from the snapshot are published as they were
+    for (const auto& [userName, user] : usersList)
+    {
+        if (!snapshotUsers.contains(userName))
+        {
+            refreshSnapshotUser(userName);
+        }
+    }
+    publishUserSnapshot();
+}
+
+void UserMgr::setUserPassword(const std::string& userName,
+                              const std::string& password)
+{
+    throwForUserDoesNotExist(userName);
+    if (password.size() < AccountPolicyIface::minPasswordLength() ||
+        password.find('\0') != std::string::npos)
+    {
+        lg2::error("Password of user '{USERNAME}' is not acceptable",
+                   "USERNAME", userName);
+        elog<InvalidArgument>(Argument::ARGUMENT_NAME("Password"),
+                              Argument::ARGUMENT_VALUE("******"));
+    }
+
+    // lckpwdf(3) guards the system files only, tests work on copies
+    std::optional<shadow::Lock> lock;
+    if (shadowFile == defaultShadowFile)
+    {
+        lock.emplace();
+    }
+
+    auto shadowLines = readLines(shadowFile);
+    auto entry = std::find_if(shadowLines.begin(), shadowLines.end(),
+                              [&userName](const std::string& line) {
+        return line.starts_with(userName + ":");
+    });
+    std::vector<std::string> fields;
+    if (entry != shadowLines.end())
+    {
+        fields = splitFields(*entry, ':');
+    }
+    if (fields.size() < 3)
+    {
+        lg2::error("User '{USERNAME}' has no valid shadow entry", "USERNAME",
+                   userName);
+        elog<InternalFailure>();
+    }
+    const std::string oldHash = fields[1];
+
+    // Password history, in the format of pam_pwhistory:
+    //   name:uid:count:hash,hash,...
+    size_t remember = AccountPolicyIface::rememberOldPasswordTimes();
+    std::vector<std::string> historyLines;
+    std::vector<std::string> history;
+    auto historyEntry = historyLines.end();
+    if (remember > 0)
+    {
+        historyLines = readLines(oldPasswdFile);
+        historyEntry = std::find_if(historyLines.begin(), historyLines.end(),
+                                    [&userName](const std::string& line) {
+            return line.starts_with(userName + ":");
+        });
+        if (historyEntry != historyLines.end())
+        {
+            auto historyFields = splitFields(*historyEntry, ':');
+            if (historyFields.size() == 4 && !historyFields[3].empty())
+            {
+                history = splitFields(historyFields[3], ',');
+            }
+        }
+
+        // Only the most recent entries count if the policy was lowered
+        bool reused = password::verify(password, oldHash);
+        size_t first = history.size() > remember ? history.size() - remember
+                                                 : 0;
+        for (size_t i = first; !reused && i < history.size(); ++i)
+        {
+            reused = password::verify(password, history[i]);
+        }
+        if (reused)
+        {
+            lg2::error("Password of user '{USERNAME}' was used recently",
+                       "USERNAME", userName);
+            elog<NotAllowed>(Reason("Password was used recently"));
+        }
+    }
+
+    try
+    {
+        fields[1] = password::hash(password, cryptPrefix, passwordHashCost);
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Unable to hash password of user '{USERNAME}': {ERR}",
+                   "USERNAME", userName, "ERR", e);
+        elog<InternalFailure>();
+    }
+    fields[2] = std::to_string(std::time(nullptr) / secondsPerDay);
+    *entry = joinFields(fields, ':');
+    if (!writeLines(shadowFile, shadowLines, S_IRUSR))
+    {
+        lg2::error("Unable to update {FILENAME}", "FILENAME", shadowFile);
+        elog<InternalFailure>();
+    }
+    lg2::info("Password of user '{USERNAME}' updated", "USERNAME", userName);
+
+    if (remember > 0 && oldHash.starts_with('$'))
+    {
+        history.push_back(oldHash);
+        if (history.size() > remember)
+        {
+            history.erase(history.begin(), history.end() - remember);
+        }
+        struct passwd* pw = getpwnam(userName.c_str());
+        std::string line = userName + ":" +
+                           (pw ? std::to_string(pw->pw_uid) : "") + ":" +
+                           std::to_string(history.size()) + ":" +
+                           joinFields(history, ',');
+        if (historyEntry != historyLines.end())
+        {
+            *historyEntry = line;
+        }
+        else
+        {
+            historyLines.push_back(line);
+        }
+        // The password is already changed, a lost history entry only
+        // weakens the reuse check.
+        if (!writeLines(oldPasswdFile, historyLines, S_IRUSR | S_IWUSR))
+        {
+            lg2::error("Unable to update {FILENAME}", "FILENAME",
+                       oldPasswdFile);
+        }
+    }
+    updateUserSnapshot(userName);
+}
+
+void UserMgr::calibratePasswordHash(const std::string& cacheFile)
+{
+    // The cache holds "<prefix> <target ms> <cost>"
+    std::string prefix;
+    long target = -1;
+    unsigned long cost = 0;
+    std::ifstream cache(cacheFile);
+    if (cache >> prefix >> target >> cost && prefix == cryptPrefix &&
+        target == PASSWORD_HASH_TARGET_MS)
+    {
+        passwordHashCost = cost;
+        lg2::info("Password hash cost {COST} restored", "COST", cost);
+        return;
+    }
+
+    try
+    {
+        passwordHashCost = password::calibrate(
+            cryptPrefix, std::chrono::milliseconds(PASSWORD_HASH_TARGET_MS));
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Password hash calibration failed: {ERR}", "ERR", e);
+        passwordHashCost = 0;
+        return;
+    }
+    lg2::info("Password hash cost {COST} for a {TARGET}ms target", "COST",
+              passwordHashCost, "TARGET", PASSWORD_HASH_TARGET_MS);
+
+    std::vector<std::string> lines{std::string(cryptPrefix) + " " +
+                                   std::to_string(PASSWORD_HASH_TARGET_MS) +
+                                   " " + std::to_string(passwordHashCost)};
+    if (!writeLines(cacheFile, lines, S_IRUSR | S_IWUSR))
+    {
+        lg2::error("Unable to update {FILENAME}", "FILENAME", cacheFile);
+    }
+}
+
+void UserMgr::refreshSnapshotUser(const std::string& userName)
+{
+    snapshotUnread.erase(userName);
+    if (!usersList.contains(userName))
+    {
+        snapshotUsers.erase(userName);
+        return;
+    }
+
+    // Only the shadow entry is read, the failed login lockout isn't published
+    // as reading it forks faillock.
+    snapshot::User entry;
+    entry.name = userName;
+    try
+    {
+        entry.enabled = isUserEnabled(userName);
+        entry.passwordExpired = userPasswordExpired(userName);
+    }
+    catch (const std::exception& e)
+    {
+        // Leave the user out rather than publish a made up state.
+        lg2::error("Unable to read state of user '{USERNAME}': {ERR}",
+                   "USERNAME", userName, "ERR", e);
+        snapshotUsers.erase(userName);
+        snapshotUnread.insert(userName);
+        return;
+    }
+    snapshotUsers.insert_or_assign(userName, std::move(entry));
+}
+
+void UserMgr::publishUserSnapshot()
+{
+    std::vector<snapshot::User> users;
+    users.reserve(snapshotUsers.size());
+    for (const auto& [userName, entry] : snapshotUsers)
+    {
+        auto user = usersList.find(userName);
+        if (user == usersList.end())
+        {
+            continue;
+        }
+        snapshot::User& published = users.emplace_back(entry);
+        const auto& object = *user->second;
+        published.privilege = snapshot::toPrivilege(object.userPrivilege());
+        published.groups = object.userGroups();
+    }
+
+    // A snapshot leaving out users isn't restarted from
+    uint64_t sourceStamp = snapshotUnread.empty() ? userSourceStamp() : 0;
+    auto generation = snapshotWriter->publish(users, groupsMgr, sourceStamp);
+    lg2::debug("Published user snapshot generation {GENERATION}", "GENERATION",
+               generation);
+}
+
+void UserMgr::updateUserSnapshot(const std::string& userName)
+{
+    if (!snapshotWriter)
+    {
+        return;
+    }
+    refreshSnapshotUser(userName);
+    publishUserSnapshot();
+}
+
+void UserMgr::updateUserSnapshot()
+{
+    if (!snapshotWriter)
+    {
+        return;
+    }
+    publishUserSnapshot();
+}
+
+bool UserMgr::restoreUserObjects(const std::string& filePath)
+{
+    std::optional<snapshot::Contents> contents;
+    try
+    {
+        snapshot::Reader reader(filePath);
+        contents = reader.load();
+    }
+    catch (const std::exception& e)
+    {
+        lg2::info("No user snapshot to restore from: {ERR}", "ERR", e);
+        return false;
+    }
+    if (!contents || contents->sourceStamp == 0 ||
+        contents->sourceStamp != userSourceStamp())
+    {
+        lg2::info("User snapshot {FILENAME} is out of date", "FILENAME",
+                  filePath);
+        return false;
+    }
+
+    groupsMgr = std::move(contents->groups);
+    for (auto& user : contents->users)
+    {
+        sdbusplus::message::object_path tempObjPath(usersObjPath);
+        tempObjPath /= user.name;
+        std::string objPath(tempObjPath);
+        std::sort(user.groups.begin(), user.groups.end());
+        std::string userPriv(snapshot::toPrivilegeName(user.privilege));
+        usersList.emplace(user.name, std::make_unique<phosphor::user::Users>(
+                                         bus, objPath.c_str(), user.groups,
+                                         userPriv, user.enabled, *this));
+        snapshotUsers.emplace(user.name, user);
+    }
+    lg2::info("Restored {COUNT} users from {FILENAME}", "COUNT",
+              usersList.size(), "FILENAME", filePath);
+    return true;
+}
+
+UserMgr::UserMgr(sdbusplus::bus_t& bus, const char* path,
+                 const std::string& snapshotFile,
+                 std::unique_ptr<HomeDirWorker> homeDirWorker) :
     Ifaces(bus, path, Ifaces::action::defer_emit), bus(bus), path(path),
+    homeDirWorker(std::move(homeDirWorker)),
     faillockConfigFile(defaultFaillockConfigFile),
     pwHistoryConfigFile(defaultPWHistoryConfigFile),
-    pwQualityConfigFile(defaultPWQualityConfigFile)
+    pwQualityConfigFile(defaultPWQualityConfigFile),
+    shadowFile(defaultShadowFile), oldPasswdFile(defaultOldPasswdFile)
 {
     UserMgrIface::allPrivileges(privMgr);
-    groupsMgr = readAllGroupsOnSystem();
-    std::sort(groupsMgr.begin(), groupsMgr.end());
+    if (snapshotFile.empty() || !restoreUserObjects(snapshotFile))
+    {
+        groupsMgr = readAllGroupsOnSystem();
+        std::sort(groupsMgr.begin(), groupsMgr.end());
+        initUserObjects();
+    }
     UserMgrIface::allGroups(groupsMgr);
     initializeAccountPolicy();
-    initUserObjects();
+    if (!snapshotFile.empty())
+    {
+        startUserSnapshot(snapshotFile);
+    }
 
     // emit the signal
     this->emit_object_added();
@@ -1689,20 +2213,33 @@ void UserMgr::executeUserAdd(const char* userName, const char* groups,
 {
     // set EXPIRE_DATE to 0 to disable user, PAM takes 0 as expire on
     // 1970-01-01, that's an implementation-defined behavior
-
-#ifdef ENABLE_USER_HOME_DIR_CREATE
-    const char* homeDirOption = "-m";
-#else
-    const char* homeDirOption = "-M";
-#endif
-
-    executeCmd("/usr/sbin/useradd", userName, "-G", groups, homeDirOption, "-N",
-               "-s", (sshRequested ? "/bin/sh" : "/sbin/nologin"), "-e",
+    // The home directory is never created by useradd itself, copying the
+    // skeleton is left to the home directory worker.
+    executeCmd("/usr/sbin/useradd", userName, "-G", groups, "-M", "-N", "-s",
+               (sshRequested ? "/bin/sh" : "/sbin/nologin"), "-e",
                (enabled ? "" : "1970-01-01"));
+
+    if (homeDirWorker)
+    {
+        struct passwd* pw = getpwnam(userName);
+        if (pw == nullptr)
+        {
+            lg2::error("Unable to create home of user '{USERNAME}'",
+                       "USERNAME", userName);
+            return;
+        }
+        homeDirWorker->create(userName, pw->pw_uid, pw->pw_gid);
+    }
 }
 
 void UserMgr::executeUserDelete(const char* userName)
 {
+    if (homeDirWorker)
+    {
+        executeCmd("/usr/sbin/userdel", userName);
+        homeDirWorker->remove(userName);
+        return;
+    }
     executeCmd("/usr/sbin/userdel", userName, "-r");
 }
 
@@ -1715,6 +2252,13 @@ void UserMgr::executeUserRename(const char* userName, const char* newUserName)
 {
     std::string newHomeDir = "/home/";
     newHomeDir += newUserName;
+    if (homeDirWorker)
+    {
+        executeCmd("/usr/sbin/usermod", "-l", newUserName, userName, "-d",
+                   newHomeDir.c_str());
+        homeDirWorker->rename(userName, newUserName);
+        return;
+    }
     executeCmd("/usr/sbin/usermod", "-l", newUserName, userName, "-d",
                newHomeDir.c_str(), "-m");
 }
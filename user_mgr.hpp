@@ -14,6 +14,8 @@
 // limitations under the License.
 */
 #pragma once
+#include "home_dir_worker.hpp"
+#include "user_snapshot.hpp"
 #include "users.hpp"
 
 #include <boost/process/child.hpp>
@@ -27,9 +29,14 @@
 #include <xyz/openbmc_project/User/AccountPolicy/server.hpp>
 #include <xyz/openbmc_project/User/Manager/server.hpp>
 
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
 #include <span>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -78,6 +85,23 @@ using DbusUserObjValue = std::map<Interface, DbusUserObjProperties>;
 
 using DbusUserObj = std::map<DbusUserObjPath, DbusUserObjValue>;
 
+using GroupName = std::string;
+
+using PrivilegeMappings = std::vector<std::pair<GroupName, Privilege>>;
+
+/** @brief Outcome of an authorization check, ordered by the check that
+ *         produced it.
+ */
+enum class AuthDecision : uint8_t
+{
+    Allowed,
+    UserNotFound,
+    GroupNotPermitted,
+    InsufficientPrivilege,
+    UserDisabled,
+    UserLocked,
+};
+
 std::string getCSVFromVector(std::span<const std::string> vec);
 
 bool removeStringFromCSV(std::string& csvStr, const std::string& delStr);
@@ -128,8 +152,15 @@ class UserMgr : public Ifaces
      *
      *  @param[in] bus  - sdbusplus handler
      *  @param[in] path - D-Bus path
+     *  @param[in] snapshotFile - user snapshot to publish and to restart
+     *                            from, empty to disable
+     *  @param[in] homeDirWorker - worker managing the home directories,
+     *                             nullptr to leave them to useradd, usermod
+     *                             and userdel
      */
-    UserMgr(sdbusplus::bus_t& bus, const char* path);
+    UserMgr(sdbusplus::bus_t& bus, const char* path,
+            const std::string& snapshotFile = {},
+            std::unique_ptr<HomeDirWorker> homeDirWorker = nullptr);
 
     /** @brief create user method.
      *  This method creates a new user as requested
@@ -254,6 +285,24 @@ class UserMgr : public Ifaces
      **/
     UserInfoMap getUserInfo(std::string userName) override;
 
+    /** @brief checks whether a local user may log in right now
+     * Lightweight alternative to getUserInfo() for the login path. Checks are
+     * done cheapest first and stop at the first failure: user existence,
+     * interface group membership and privilege level (all in memory), enabled
+     * state (shadow lookup) and finally the failed-login lockout (faillock).
+     * Remote (LDAP) users are reported as UserNotFound, callers have to fall
+     * back to getUserInfo() for them.
+     *
+     * @param[in] userName - name of the user
+     * @param[in] priv - minimum privilege required, empty for any
+     * @param[in] group - interface group the user must belong to, empty for
+     *                    any
+     * @return - authorization decision
+     **/
+    AuthDecision authorizeUser(const std::string& userName,
+                               const std::string& priv,
+                               const std::string& group);
+
     /** @brief get IPMI user count
      *  method to get IPMI user count
      *
@@ -274,6 +323,26 @@ class UserMgr : public Ifaces
 
     static std::vector<std::string> readAllGroupsOnSystem();
 
+    /** @brief set the password of a user
+     *  Hashes the password with crypt(3) and writes it to the shadow file.
+     *  Passwords shorter than minPasswordLength are rejected, as are the
+     *  current and the last rememberOldPasswordTimes passwords.
+     *
+     *  @param[in] userName - name of the user
+     *  @param[in] password - clear text password
+     */
+    void setUserPassword(const std::string& userName,
+                         const std::string& password);
+
+    /** @brief pick the password hash cost for this machine
+     *  Measures the configured crypt algorithm and chooses the cost that
+     *  makes a password verify take about PASSWORD_HASH_TARGET_MS. The result
+     *  is kept in cacheFile and reused by later starts with the same settings.
+     *
+     *  @param[in] cacheFile - file caching the calibration result
+     */
+    void calibratePasswordHash(const std::string& cacheFile);
+
   protected:
     /** @brief get pam argument value
      *  method to get argument value from pam configuration
@@ -446,6 +515,65 @@ class UserMgr : public Ifaces
      */
     std::vector<std::string> getUsersInGroup(const std::string& groupName);
 
+    /** @brief creates, moves and removes home directories in the
+     *  background, only set when home directories are managed
+     */
+    std::unique_ptr<HomeDirWorker> homeDirWorker;
+
+    /** @brief snapshot of the user table shared with other daemons */
+    std::unique_ptr<snapshot::Writer> snapshotWriter;
+
+    /** @brief snapshot records by user name, read one user at a time */
+    std::map<std::string, snapshot::User> snapshotUsers;
+
+    /** @brief users whose state couldn't be read and are left out of the
+     *  snapshot, which is then not restarted from
+     */
+    std::set<std::string> snapshotUnread;
+
+    /** @brief reread the state of one user into its snapshot record
+     *  Only /etc/shadow is read. A user no longer managed is dropped.
+     *
+     *  @param[in] userName - name of the user
+     */
+    void refreshSnapshotUser(const std::string& userName);
+
+    /** @brief publish the snapshot records, with the privilege and groups of
+     *  the user objects
+     */
+    void publishUserSnapshot();
+
+    /** @brief republish the user table snapshot after a user changed, if
+     *  enabled
+     *  Only that user's state is reread. Failures are logged, they never fail
+     *  the account change itself.
+     *
+     *  @param[in] userName - name of the changed, created or deleted user
+     */
+    void updateUserSnapshot(const std::string& userName);
+
+    /** @brief republish the user table snapshot after the groups changed, if
+     *  enabled
+     */
+    void updateUserSnapshot();
+
+    /** @brief start publishing the user table snapshot
+     *  Creates the shared snapshot file read by co-located daemons and
+     *  publishes the current users; the snapshot is then republished on every
+     *  account change.
+     *
+     *  @param[in] filePath - path of the snapshot file
+     */
+    void startUserSnapshot(const std::string& filePath);
+
+    /** @brief create the user objects from the snapshot file
+     *  Only done if the snapshot was taken from the current user databases.
+     *
+     *  @param[in] filePath - path of the snapshot file
+     *  @return - true if the users and groups were restored
+     */
+    bool restoreUserObjects(const std::string& filePath);
+
     /** @brief get user & SSH users list
      *  method to get the users and ssh users list.
      *
@@ -493,11 +621,36 @@ class UserMgr : public Ifaces
      */
     virtual DbusUserObj getPrivilegeMapperObject(void);
 
+    /** @brief get LDAP privilege mappings
+     *  method to get the group to privilege mappings of the enabled LDAP
+     *  config, by default read from the LDAP config manager over D-Bus
+     *
+     *  @return - mappings in match order, nullopt if LDAP is disabled
+     */
+    virtual std::optional<PrivilegeMappings> getLdapPrivilegeMappings();
+
+    /** @brief get the LDAP groups of a user
+     *  method to look up the groups of a remote user straight from the
+     *  directory, cheaper than fetching every mapped group with all its
+     *  members through NSS. Not available by default.
+     *
+     *  @param[in] userName - name of the remote user
+     *  @param[in] primaryGid - gid of the user's primary group
+     *  @return - group names, nullopt to check the mapped groups via NSS
+     */
+    virtual std::optional<std::vector<GroupName>>
+        getLdapUserGroups(const std::string& userName, gid_t primaryGid);
+
     friend class TestUserMgr;
 
     std::string faillockConfigFile;
     std::string pwHistoryConfigFile;
     std::string pwQualityConfigFile;
+    std::string shadowFile;
+    std::string oldPasswdFile;
+
+    /** @brief crypt(3) cost of new password hashes, 0 for the default */
+    unsigned long passwordHashCost = 0;
 };
 
 } // namespace user
@@ -0,0 +1,392 @@
+#include "user_snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+namespace phosphor
+{
+namespace user
+{
+namespace snapshot
+{
+
+namespace
+{
+
+// A writer only holds the sequence odd for a memcpy of the table, readers
+// give up (and fail closed) if that takes longer than this many retries,
+// e.g. because the writer died in the middle of an update.
+constexpr size_t maxReadRetries = 100000;
+
+std::string_view fixedString(const char* str, size_t size)
+{
+    return {str, strnlen(str, size)};
+}
+
+template <size_t N>
+void copyFixedString(char (&dest)[N], std::string_view src)
+{
+    std::memset(dest, 0, N);
+    std::memcpy(dest, src.data(), std::min(src.size(), N - 1));
+}
+
+std::atomic_ref<uint32_t> sequenceOf(const Table* table)
+{
+    // The reader mapping is read-only, loads are all the reader ever does.
+    return std::atomic_ref<uint32_t>(const_cast<uint32_t&>(table->sequence));
+}
+
+/** @brief Run func on a consistent view of the table (seqlock read side).
+ *  @return - result of func, or std::nullopt if no consistent view could be
+ *            obtained.
+ */
+template <typename Func>
+auto readConsistent(const Table* table, Func&& func)
+    -> std::optional<decltype(func(*table))>
+{
+    auto sequence = sequenceOf(table);
+    for (size_t retry = 0; retry < maxReadRetries; ++retry)
+    {
+        uint32_t begin = sequence.load(std::memory_order_acquire);
+        if (begin & 1)
+        {
+            continue;
+        }
+        auto result = func(*table);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == begin)
+        {
+            return result;
+        }
+    }
+    return std::nullopt;
+}
+
+User decodeUser(const UserRecord& record,
+                const char (&groupNames)[maxGroups][maxGroupNameLength],
+                size_t groupCount)
+{
+    User user;
+    user.name = fixedString(record.name, maxNameLength);
+    user.privilege = static_cast<Privilege>(record.privilege);
+    for (size_t i = 0; i < groupCount; ++i)
+    {
+        if (record.groups & (uint64_t{1} << i))
+        {
+            user.groups.emplace_back(
+                fixedString(groupNames[i], maxGroupNameLength));
+        }
+    }
+    user.enabled = record.flags & Flags::enabled;
+    user.passwordExpired = record.flags & Flags::passwordExpired;
+    return user;
+}
+
+const UserRecord* findRecord(const Table& table, std::string_view userName)
+{
+    auto count = std::min<size_t>(table.userCount, maxUsers);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (fixedString(table.users[i].name, maxNameLength) == userName)
+        {
+            return &table.users[i];
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+Privilege toPrivilege(std::string_view priv)
+{
+    if (priv == "priv-admin")
+    {
+        return Privilege::Admin;
+    }
+    if (priv == "priv-operator")
+    {
+        return Privilege::Operator;
+    }
+    if (priv == "priv-user")
+    {
+        return Privilege::User;
+    }
+    return Privilege::None;
+}
+
+std::string_view toPrivilegeName(Privilege priv)
+{
+    switch (priv)
+    {
+        case Privilege::Admin:
+            return "priv-admin";
+        case Privilege::Operator:
+            return "priv-operator";
+        case Privilege::User:
+            return "priv-user";
+        case Privilege::None:
+            break;
+    }
+    return {};
+}
+
+Writer::Writer(const std::string& filePath)
+{
+    std::filesystem::create_directories(
+        std::filesystem::path(filePath).parent_path());
+
+    int fd = open(filePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "open " + filePath);
+    }
+    // Readers are unprivileged daemons, don't let the umask get in the way.
+    struct stat st
+    {};
+    if (fchmod(fd, 0644) < 0 || fstat(fd, &st) < 0 ||
+        (st.st_size != sizeof(Table) && ftruncate(fd, sizeof(Table)) < 0))
+    {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(),
+                                "resize " + filePath);
+    }
+    void* addr = mmap(nullptr, sizeof(Table), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "mmap " + filePath);
+    }
+    table = static_cast<Table*>(addr);
+
+    auto sequence = sequenceOf(table);
+    if (sequence.load(std::memory_order_relaxed) & 1)
+    {
+        // A previous writer died in the middle of an update.
+        sequence.fetch_add(1, std::memory_order_release);
+    }
+    if (table->magic != magic || table->version != formatVersion)
+    {
+        publish({}, {});
+    }
+}
+
+Writer::~Writer()
+{
+    munmap(table, sizeof(Table));
+}
+
+uint64_t Writer::publish(const std::vector<User>& users,
+                         const std::vector<std::string>& groups,
+                         uint64_t sourceStamp)
+{
+    // Build the new table aside, so the sequence is odd only for a memcpy.
+    Table next{};
+    next.magic = magic;
+    next.version = formatVersion;
+    next.sourceStamp = sourceStamp;
+    next.complete = groups.size() <= maxGroups && users.size() <= maxUsers;
+    next.groupCount = std::min(groups.size(), maxGroups);
+    for (size_t i = 0; i < next.groupCount; ++i)
+    {
+        next.complete &= groups[i].size() < maxGroupNameLength;
+        copyFixedString(next.groupNames[i], groups[i]);
+    }
+    next.userCount = std::min(users.size(), maxUsers);
+    for (size_t i = 0; i < next.userCount; ++i)
+    {
+        const User& user = users[i];
+        UserRecord& record = next.users[i];
+        next.complete &= user.name.size() < maxNameLength;
+        copyFixedString(record.name, user.name);
+        record.privilege = static_cast<uint8_t>(user.privilege);
+        for (const auto& group : user.groups)
+        {
+            auto it = std::find(groups.begin(),
+                                groups.begin() + next.groupCount, group);
+            if (it != groups.begin() + next.groupCount)
+            {
+                record.groups |= uint64_t{1} << (it - groups.begin());
+            }
+            else
+            {
+                next.complete = false;
+            }
+        }
+        record.flags = (user.enabled ? Flags::enabled : 0) |
+                       (user.passwordExpired ? Flags::passwordExpired : 0);
+    }
+
+    auto sequence = sequenceOf(table);
+    uint32_t begin = sequence.load(std::memory_order_relaxed);
+    next.sequence = begin + 1;
+    next.generation = table->generation + 1;
+
+    sequence.store(begin + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(static_cast<void*>(table), &next, sizeof(Table));
+    sequence.store(begin + 2, std::memory_order_release);
+
+    return next.generation;
+}
+
+Reader::Reader(const std::string& filePath)
+{
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "open " + filePath);
+    }
+    struct stat st
+    {};
+    if (fstat(fd, &st) < 0)
+    {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(),
+                                "stat " + filePath);
+    }
+    if (st.st_size < static_cast<off_t>(sizeof(Table)))
+    {
+        close(fd);
+        throw std::runtime_error("Incompatible user snapshot " + filePath);
+    }
+    void* addr = mmap(nullptr, sizeof(Table), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "mmap " + filePath);
+    }
+    table = static_cast<const Table*>(addr);
+
+    auto header = readConsistent(table, [](const Table& t) {
+        return t.magic == magic && t.version == formatVersion;
+    });
+    if (!header.value_or(false))
+    {
+        munmap(const_cast<Table*>(table), sizeof(Table));
+        throw std::runtime_error("Incompatible user snapshot " + filePath);
+    }
+}
+
+Reader::~Reader()
+{
+    munmap(const_cast<Table*>(table), sizeof(Table));
+}
+
+uint64_t Reader::generation() const
+{
+    return readConsistent(table, [](const Table& t) {
+        return t.generation;
+    }).value_or(0);
+}
+
+std::optional<User> Reader::find(std::string_view userName) const
+{
+    struct Copy
+    {
+        bool found = false;
+        UserRecord record{};
+        uint32_t groupCount = 0;
+        char groupNames[maxGroups][maxGroupNameLength]{};
+    };
+    auto copy = readConsistent(table, [userName](const Table& t) {
+        Copy copy;
+        const UserRecord* record = findRecord(t, userName);
+        if (record != nullptr)
+        {
+            copy.found = true;
+            copy.record = *record;
+            copy.groupCount = std::min<uint32_t>(t.groupCount, maxGroups);
+            std::memcpy(copy.groupNames, t.groupNames, sizeof(t.groupNames));
+        }
+        return copy;
+    });
+    if (!copy || !copy->found)
+    {
+        return std::nullopt;
+    }
+
+    return decodeUser(copy->record, copy->groupNames, copy->groupCount);
+}
+
+std::optional<Contents> Reader::load() const
+{
+    // The table is small and fixed size, copy it as a whole.
+    auto copy = std::make_unique<Table>();
+    bool consistent = readConsistent(table, [&copy](const Table& t) {
+        std::memcpy(static_cast<void*>(copy.get()), &t, sizeof(Table));
+        return true;
+    }).has_value();
+    if (!consistent || !copy->complete)
+    {
+        return std::nullopt;
+    }
+
+    Contents contents;
+    contents.sourceStamp = copy->sourceStamp;
+    auto groupCount = std::min<size_t>(copy->groupCount, maxGroups);
+    for (size_t i = 0; i < groupCount; ++i)
+    {
+        contents.groups.emplace_back(
+            fixedString(copy->groupNames[i], maxGroupNameLength));
+    }
+    auto userCount = std::min<size_t>(copy->userCount, maxUsers);
+    for (size_t i = 0; i < userCount; ++i)
+    {
+        contents.users.push_back(
+            decodeUser(copy->users[i], copy->groupNames, groupCount));
+    }
+    return contents;
+}
+
+bool Reader::isAuthorized(std::string_view userName, Privilege priv,
+                          std::string_view group) const
+{
+    auto authorized = readConsistent(table, [&](const Table& t) {
+        const UserRecord* record = findRecord(t, userName);
+        if (record == nullptr || record->privilege < static_cast<uint8_t>(priv))
+        {
+            return false;
+        }
+        if ((record->flags & Flags::enabled) == 0)
+        {
+            return false;
+        }
+        if (group.empty())
+        {
+            return true;
+        }
+        auto count = std::min<size_t>(t.groupCount, maxGroups);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fixedString(t.groupNames[i], maxGroupNameLength) == group)
+            {
+                return (record->groups & (uint64_t{1} << i)) != 0;
+            }
+        }
+        return false;
+    });
+    // Fail closed if no consistent view could be read.
+    return authorized.value_or(false);
+}
+
+} // namespace snapshot
+} // namespace user
+} // namespace phosphor
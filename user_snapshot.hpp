@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace phosphor
+{
+namespace user
+{
+namespace snapshot
+{
+
+/** @brief Default location of the user table snapshot (tmpfs) */
+inline constexpr const char* defaultFile =
+    "/run/phosphor-user-manager/users.snapshot";
+
+inline constexpr uint32_t magic = 0x504d5553;
+inline constexpr uint32_t formatVersion = 3;
+inline constexpr size_t maxUsers = 64;
+inline constexpr size_t maxGroups = 64; // width of the groups bitmask
+inline constexpr size_t maxNameLength = 32;
+inline constexpr size_t maxGroupNameLength = 33;
+
+/** @brief User privilege, ordered from the lowest to the highest */
+enum class Privilege : uint8_t
+{
+    None = 0,
+    User = 1,
+    Operator = 2,
+    Admin = 3,
+};
+
+/** @brief Convert "priv-admin" style privilege names */
+Privilege toPrivilege(std::string_view priv);
+
+/** @brief Convert back to the "priv-admin" style name, empty for None */
+std::string_view toPrivilegeName(Privilege priv);
+
+/** @brief State of a user, as of the last publish of the user
+ *  @details The failed login lockout is kept by pam_faillock and changes
+ *  without the user manager noticing, so it isn't published (bit 1 is no
+ *  longer used). Neither is a password expiring by elapsed time noticed.
+ */
+enum Flags : uint8_t
+{
+    enabled = 1 << 0,
+    passwordExpired = 1 << 2,
+};
+
+/** @struct UserRecord
+ *  @brief One entry of the user table, as laid out in the shared file.
+ */
+struct UserRecord
+{
+    char name[maxNameLength];
+    uint64_t groups;
+    uint8_t privilege;
+    uint8_t flags;
+    uint8_t reserved[6];
+};
+
+/** @struct Table
+ *  @brief Layout of the shared file.
+ *  @details The writer bumps 'sequence' to an odd value before modifying the
+ *  table and to the next even value afterwards (seqlock). Readers copy what
+ *  they need and retry if the sequence was odd or changed meanwhile.
+ *  'generation' is incremented on every publish so readers can cheaply tell
+ *  whether their cached view is stale. 'complete' is cleared if users, groups
+ *  or names had to be cut to fit. 'sourceStamp' is opaque to readers, the
+ *  user manager uses it to tell whether it can restart from the table.
+ */
+struct Table
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sequence;
+    uint32_t userCount;
+    uint64_t generation;
+    uint32_t groupCount;
+    uint32_t complete;
+    uint64_t sourceStamp;
+    char groupNames[maxGroups][maxGroupNameLength];
+    UserRecord users[maxUsers];
+};
+
+/** @struct User
+ *  @brief Decoded copy of a user record.
+ */
+struct User
+{
+    std::string name;
+    Privilege privilege = Privilege::None;
+    std::vector<std::string> groups;
+    bool enabled = false;
+    bool passwordExpired = false;
+};
+
+/** @struct Contents
+ *  @brief Decoded copy of the whole table.
+ */
+struct Contents
+{
+    uint64_t sourceStamp = 0;
+    std::vector<std::string> groups;
+    std::vector<User> users;
+};
+
+/** @class Writer
+ *  @brief Publishes the user table into a shared, world readable file.
+ */
+class Writer
+{
+  public:
+    Writer() = delete;
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    Writer(Writer&&) = delete;
+    Writer& operator=(Writer&&) = delete;
+
+    /** @brief Creates (or reuses) and maps the snapshot file.
+     *
+     *  @param[in] filePath - path of the snapshot file
+     *  @throws std::system_error on failure
+     */
+    explicit Writer(const std::string& filePath);
+    ~Writer();
+
+    /** @brief Replace the published user table.
+     *
+     *  @param[in] users - users to publish, at most maxUsers
+     *  @param[in] groups - group names the bitmask refers to, at most
+     *                      maxGroups; groups of a user not listed here are
+     *                      dropped
+     *  @param[in] sourceStamp - identifies the state the users were read from
+     *  @return - generation number of the published table
+     */
+    uint64_t publish(const std::vector<User>& users,
+                     const std::vector<std::string>& groups,
+                     uint64_t sourceStamp = 0);
+
+  private:
+    Table* table = nullptr;
+};
+
+/** @class Reader
+ *  @brief Lock free, read-only access to the published user table.
+ */
+class Reader
+{
+  public:
+    Reader() = delete;
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+    Reader(Reader&&) = delete;
+    Reader& operator=(Reader&&) = delete;
+
+    /** @brief Maps the snapshot file read-only.
+     *
+     *  @param[in] filePath - path of the snapshot file
+     *  @throws std::system_error if the file can't be mapped and
+     *          std::runtime_error if it isn't a compatible snapshot
+     */
+    explicit Reader(const std::string& filePath = defaultFile);
+    ~Reader();
+
+    /** @brief generation of the currently published table */
+    uint64_t generation() const;
+
+    /** @brief Look up one user.
+     *
+     *  @param[in] userName - name of the user
+     *  @return - decoded user or std::nullopt if the user doesn't exist
+     */
+    std::optional<User> find(std::string_view userName) const;
+
+    /** @brief Copy the whole table.
+     *
+     *  @return - all users and groups, or std::nullopt if the table was cut
+     *            to fit or no consistent view could be read
+     */
+    std::optional<Contents> load() const;
+
+    /** @brief Check a user's privilege, group and state, without allocating.
+     *
+     *  @param[in] userName - name of the user
+     *  @param[in] priv - minimum privilege required
+     *  @param[in] group - group the user must belong to, empty for any
+     *  @return - true if the user exists, is a member of the group, has at
+     *            least the given privilege and is enabled
+     *  @note The failed login lockout is not covered, it has to be checked
+     *        live (pam_faillock or UserMgr::userLockedForFailedAttempt).
+     */
+    bool isAuthorized(std::string_view userName, Privilege priv,
+                      std::string_view group) const;
+
+  private:
+    const Table* table = nullptr;
+};
+
+} // namespace snapshot
+} // namespace user
+} // namespace phosphor
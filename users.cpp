@@ -226,5 +226,23 @@ bool Users::userPasswordExpired(void) const
     return manager.userPasswordExpired(userName);
 }
 
+/** @brief set the user's password
+ *
+ * @param[in] password - clear text password
+ **/
+void Users::setPassword(const std::string& password)
+{
+    manager.setUserPassword(userName, password);
+
+    std::string dbusObjectPath = usersObjPath;
+    dbusObjectPath.push_back('/');
+    dbusObjectPath += userName;
+
+    std::vector<std::string> messageArgs = {"Password", "******"};
+    // send event.
+    sendEvent(MESSAGE_TYPE::PROPERTY_VALUE_MODIFIED,
+              Entry::Level::Informational, messageArgs, dbusObjectPath);
+}
+
 } // namespace user
 } // namespace phosphor
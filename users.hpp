@@ -121,6 +121,12 @@ class Users : public Interfaces
      **/
     bool userPasswordExpired(void) const override;
 
+    /** @brief set the user's password
+     *
+     *  @param[in] password - clear text password
+     */
+    void setPassword(const std::string& password);
+
   private:
     std::string userName;
     UserMgr& manager;